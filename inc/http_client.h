@@ -0,0 +1,92 @@
+#ifndef HTTP_CLIENT_H_
+#define HTTP_CLIENT_H_
+
+#include <string>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "http_request.h"
+#include "natsu_error.h"
+
+namespace natsu {
+namespace http {
+
+class HttpClientResponse
+{
+public:
+    HttpClientResponse() : code_(0) {}
+
+    int& code() { return code_; }
+    std::string header(const std::string& k);
+    void header(const std::string& k, const std::string& v);
+    std::map<std::string,std::string>& headers() { return header_; }
+    std::string& body() { return body_; }
+
+private:
+    int code_;
+    std::map<std::string,std::string> header_;
+    std::string body_;
+};
+
+struct HttpClientRequest
+{
+    HttpClientRequest(Method m = GET, const std::string& u = "", const std::string& b = "")
+    : method(m), url(u), body(b) {}
+
+    Method method;
+    std::string url;
+    std::string body;
+    std::map<std::string,std::string> headers;
+};
+
+struct HttpClientOptions
+{
+    HttpClientOptions()
+    : connect_timeout(3000), timeout(5000), max_idle(16), idle_timeout(60) {}
+
+    int connect_timeout;    // milliseconds
+    int timeout;            // milliseconds, applies to every read and write
+    size_t max_idle;        // idle keep-alive connections kept per host
+    int idle_timeout;       // seconds an idle connection is kept
+};
+
+/* *
+ * HttpClient
+ * HTTP/1.1 client for use inside coroutines, it blocks only the calling
+ * coroutine. keep-alive connections are pooled per host:port, urls must be
+ * plain http://host[:port]/path
+*/
+class HttpClient
+{
+public:
+    static HttpClient& instance();
+
+    void options(const HttpClientOptions& opts);
+    HttpClientOptions& options();
+
+    std::shared_ptr<HttpClientResponse> request(const HttpClientRequest& req, NatsuError& err);
+    std::shared_ptr<HttpClientResponse> get(const std::string& url, NatsuError& err);
+    std::shared_ptr<HttpClientResponse> post(const std::string& url, const std::string& body,
+                                             const std::string& content_type, NatsuError& err);
+    std::shared_ptr<HttpClientResponse> put(const std::string& url, const std::string& body,
+                                            const std::string& content_type, NatsuError& err);
+
+    /* *
+     * pipeline
+     * write every request on one connection before reading, responses are
+     * returned in request order. all urls must share the same host:port.
+     * a batch lost on a stale pooled connection is resent once, but only
+     * when it holds no POST
+    */
+    std::vector<std::shared_ptr<HttpClientResponse>> pipeline(const std::vector<HttpClientRequest>& reqs,
+                                                              NatsuError& err);
+
+private:
+    HttpClient() {}
+    HttpClientOptions options_;
+};
+
+}}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef HTTP_PROXY_H_
+#define HTTP_PROXY_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "http_request.h"
+#include "http_response.h"
+
+namespace natsu {
+namespace http {
+
+struct HttpProxyOptions
+{
+    HttpProxyOptions()
+    : splice_threshold(64 * 1024) {}
+
+    size_t splice_threshold;    // response bodies at least this long are moved with splice()
+    std::string strip_prefix;   // removed from the request path before forwarding
+};
+
+/* *
+ * HttpProxy
+ * reverse proxy handler, forwards the request to one of the upstreams
+ * ("host:port" each) and streams the upstream response back to the client.
+ * the upstream with the fewest outstanding requests wins, connections are
+ * kept alive in HttpConnectionPool.
+ *
+ * app.register_handler("^/api/", HttpProxy({"10.0.0.1:8080", "10.0.0.2:8080"}), POST);
+*/
+class HttpProxy
+{
+public:
+    HttpProxy(const std::vector<std::string>& upstreams, const HttpProxyOptions& opts = HttpProxyOptions());
+
+    void operator()(std::shared_ptr<HttpRequest> req, std::shared_ptr<HttpResponse> rsp);
+
+private:
+    class HttpProxyImpl;
+    std::shared_ptr<HttpProxyImpl> proxy_;
+};
+
+}}
+
+#endif
@@ -30,14 +30,20 @@ public:
     std::string parameters();
     std::string fragment();
     std::string document();
+    const std::string& path() { return path_; }
     Method& method() { return method_; }
     std::string& body() { return body_; }
+    const std::map<std::string,std::string>& headers() { return header_; }
+
+    // peer address of the connection, without port
+    std::string& remote() { return remote_; }
 
 private:
     Method method_;
     std::string path_;
     std::map<std::string,std::string> header_;
     std::string body_;
+    std::string remote_;
 };
 
 
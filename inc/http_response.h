@@ -4,6 +4,7 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <functional>
 
 namespace natsu {
 namespace http {
@@ -11,18 +12,40 @@ namespace http {
 class HttpResponse
 {
 public:
+    // writes the body straight to the client socket, returns false on error
+    typedef std::function<bool(int)> StreamWriter;
+
     HttpResponse();
 
     void header(const std::string& key, const std::string& value);
+    // "" when not set
+    std::string header(const std::string& key);
+    const std::map<std::string,std::string>& headers();
     void response(const std::string& resp, const std::string& ct = "");
     void response(const std::map<std::string,std::string>& resp);
     void response(int code);
 
     void redirect(const std::string& url);
 
+    // deep copy of code, headers and body, the two stay independent
+    void assign(const HttpResponse& other);
+
+    /* *
+     * stream
+     * the head is sent first, then w produces the body on the socket.
+     * set Content-Length or Transfer-Encoding with header() yourself,
+     * the connection is closed once w returns
+    */
+    void stream(StreamWriter w);
+    bool streaming();
+    StreamWriter& writer();
+
 public:
+    // for streaming responses this is the head only
     std::string str(); 
     bool empty();
+    int code();
+    std::string& body();
 
 private:
     class HttpResponseImpl;
@@ -0,0 +1,50 @@
+#ifndef HTTP_STATIC_H_
+#define HTTP_STATIC_H_
+
+#include <string>
+#include <memory>
+
+#include "http_request.h"
+#include "http_response.h"
+
+namespace natsu {
+namespace http {
+
+struct StaticFilesOptions
+{
+    StaticFilesOptions()
+    : index("index.html"), max_age(-1), gzip(true), max_files(1024), mmap_limit(16 * 1024) {}
+
+    std::string index;          // served for a directory, no listings are generated
+    std::string strip_prefix;   // removed from the request path before it is mapped to a file
+    int max_age;                // Cache-Control max-age seconds, -1 sends none
+    bool gzip;                  // serve file.gz for file when the client accepts gzip
+    size_t max_files;           // files kept open, the least recently served are closed
+    size_t mmap_limit;          // files up to this size are mapped, larger ones are sent with sendfile()
+};
+
+/* *
+ * StaticFiles
+ * serves the files below root. open files stay cached and are dropped as
+ * soon as inotify reports a change, bodies go out with sendfile() or from
+ * the mapping, so nothing is copied through user space.
+ * answers single Range requests, If-None-Match/If-Modified-Since with 304
+ * and prefers a precompressed .gz next to the file.
+ *
+ * app.register_handler("/assets/", StaticFiles("/var/www/assets", opts));
+*/
+class StaticFiles
+{
+public:
+    StaticFiles(const std::string& root, const StaticFilesOptions& opts = StaticFilesOptions());
+
+    void operator()(std::shared_ptr<HttpRequest> req, std::shared_ptr<HttpResponse> rsp);
+
+private:
+    class StaticFilesImpl;
+    std::shared_ptr<StaticFilesImpl> files_;
+};
+
+}}
+
+#endif
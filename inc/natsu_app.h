@@ -17,6 +17,7 @@
 
 #include "http_request.h"
 #include "http_response.h"
+#include "natsu_websocket.h"
 
 namespace natsu {
 
@@ -29,6 +30,40 @@ public:
 };
 
 
+struct ListenOptions
+{
+    ListenOptions()
+    : backlog(1024), nodelay(true), defer_accept(0), fastopen(0), rcvbuf(0), sndbuf(0), h2c(false) {}
+
+    int backlog;            // listen() queue length
+    bool nodelay;           // TCP_NODELAY, inherited by accepted sockets
+    int defer_accept;       // TCP_DEFER_ACCEPT seconds, wake only once data arrived. 0 off
+    int fastopen;           // TCP_FASTOPEN pending queue length. 0 off
+    int rcvbuf;             // SO_RCVBUF bytes, inherited by accepted sockets. 0 system default
+    int sndbuf;             // SO_SNDBUF bytes, inherited by accepted sockets. 0 system default
+    bool h2c;               // connections opening with the HTTP/2 preface speak HTTP/2, prior knowledge only
+};
+
+enum Execution
+{
+    EXEC_INLINE,            // on the connection coroutine
+    EXEC_PROCESSOR,         // on a coroutine of the worker threads, which never take connection work
+    EXEC_THREAD_POOL,       // on a plain thread of the pool, for code that blocks without hooks
+};
+
+struct RouteOptions
+{
+    RouteOptions(Execution e = EXEC_INLINE, bool c = false, int t = 0)
+    : execution(e), coalesce(c), timeout(t) {}
+
+    Execution execution;    // the connection coroutine is parked until the handler returned
+    bool coalesce;          // concurrent GETs of the same path, query, Authorization, Cookie and
+                            // Accept-Encoding share one handler run. only for replies that
+                            // depend on nothing else of the request
+    int timeout;            // milliseconds the handler may take, see natsu_deadline.h. 0 unbounded,
+                            // the X-Request-Timeout header of a request can only lower it
+};
+
 class NatsuApp
 {
 public:
@@ -38,19 +73,50 @@ public:
     void provide_service(const std::string& servicename, const std::string& etcdaddr);
     void produce_service(const std::string& servicename, const std::string& etcdaddr);
     
-    void listen(const std::string& ip, unsigned short port);
+    /* *
+     * listen
+     * add a tcp listener and serve until no coroutine is left.
+     * ip is an IPv4 or IPv6 address, "" listens on every IPv4 address
+    */
+    void listen(const std::string& ip, unsigned short port, const ListenOptions& opts = ListenOptions());
+
+    // listeners are served by run(), false when the address can't be listened on
+    bool add_listener(const std::string& ip, unsigned short port, const ListenOptions& opts = ListenOptions());
+    // unix domain socket, a leading '@' names an abstract socket
+    bool add_unix_listener(const std::string& path, const ListenOptions& opts = ListenOptions());
+
     void run();
 
 	void register_handler(const std::string& pattern, 
-		std::function<void(std::shared_ptr<natsu::http::HttpRequest>,std::shared_ptr<natsu::http::HttpResponse>)> h, natsu::http::Method m = natsu::http::GET);
+		std::function<void(std::shared_ptr<natsu::http::HttpRequest>,std::shared_ptr<natsu::http::HttpResponse>)> h, natsu::http::Method m = natsu::http::GET,
+		const RouteOptions& opts = RouteOptions());
+
+    /* *
+     * register_websocket
+     * GET requests asking to upgrade are handed to h on a coroutine of its
+     * own once the handshake is done, the connection coroutine ends there.
+    */
+    void register_websocket(const std::string& pattern, natsu::http::WebSocketHandler h,
+        const natsu::http::WebSocketOptions& opts = natsu::http::WebSocketOptions());
+
+    /* *
+     * worker_threads
+     * threads serving EXEC_PROCESSOR and EXEC_THREAD_POOL routes, started
+     * with the first such route. 0 picks the number of cores.
+     * call before registering handlers.
+    */
+    void worker_threads(unsigned processors, unsigned pool = 0);
 
 private:
-    void handle(int sockfd);
-    void wait(unsigned short port);
+    bool open_listener(const sockaddr* addr, socklen_t len, const ListenOptions& opts);
+    void handle(int sockfd, const std::string& remote, bool h2c);
+    // injects and routing, false once the connection was taken over
+    bool process(int sockfd, std::shared_ptr<natsu::http::HttpRequest>& req, std::shared_ptr<natsu::http::HttpResponse>& resp);
+    bool upgrade(int sockfd, std::shared_ptr<natsu::http::HttpRequest>& req, const std::string& remote);
+    void wait(int sock, bool h2c);
 
 private:
     std::shared_ptr<natsu::Inject> inject_;
-    int sock_;
 };
 
 }
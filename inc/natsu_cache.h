@@ -0,0 +1,97 @@
+#ifndef NATSU_CACHE_H_
+#define NATSU_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace natsu {
+
+struct CacheOptions
+{
+    CacheOptions()
+    : capacity(64 << 20), shards(64), ttl(0), admission(true) {}
+
+    size_t capacity;    // bytes of keys and values, plus a fixed overhead per entry
+    unsigned shards;    // rounded up to a power of two
+    int64_t ttl;        // default milliseconds an entry lives, 0 for no expiry
+    bool admission;     // TinyLFU: a new key evicts only a less frequently used one
+};
+
+struct CacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t rejections;    // insertions refused by admission or for their size
+    size_t entries;
+    size_t bytes;
+};
+
+/* *
+ * Cache
+ * in process string cache sharded by key hash, every shard an LRU list under
+ * a spin lock held for a lookup and a list splice, never across IO or a copy
+ * of the value, so a hit doesn't park the coroutine. values are shared and
+ * immutable, a reader keeps its copy alive after the entry is evicted.
+ * with admission on, each shard counts accesses in a 4 bit count-min sketch
+ * that halves itself now and then, and a key that is not yet cached must be
+ * used more often than the LRU entry it would push out, so one pass over
+ * cold keys doesn't flush the hot ones.
+ *
+ *     static natsu::Cache cache(opts);
+ *     auto v = cache.get_or_load(key, [&](const std::string& k, std::string& value) {
+ *         RedisError err;
+ *         value = redis->get(k, err);
+ *         return err.code() == 0;
+ *     });
+*/
+class Cache
+{
+public:
+    // @return false when there is nothing to cache, value is then ignored
+    typedef std::function<bool(const std::string& key, std::string& value)> Loader;
+
+    explicit Cache(const CacheOptions& opts = CacheOptions());
+    ~Cache();
+
+    // NULL on a miss or an expired entry
+    std::shared_ptr<const std::string> get(const std::string& key);
+    bool get(const std::string& key, std::string& value);
+
+    // @param ttl : milliseconds, -1 for the default, 0 for no expiry
+    // @return false when admission or the size of the entry refused it
+    bool set(const std::string& key, const std::string& value, int64_t ttl = -1);
+    void erase(const std::string& key);
+    void clear();
+
+    /* *
+     * get_or_load
+     * the cached value, or the one loader produced. concurrent misses on a key
+     * run loader once, the other callers park on a channel until it returned
+     * and share its result, or its exception. loader runs without any lock
+     * held and may block on IO.
+     * @return NULL when loader returned false
+    */
+    std::shared_ptr<const std::string> get_or_load(const std::string& key, const Loader& loader, int64_t ttl = -1);
+
+    CacheStats stats();
+
+private:
+    Cache(const Cache&);
+    Cache& operator=(const Cache&);
+
+    struct Shard;
+    Shard& shard(uint64_t hash);
+    int64_t effective_ttl(int64_t ttl) const { return ttl < 0 ? ttl_ : ttl; }
+
+    Shard* shards_;
+    uint64_t mask_;
+    int64_t ttl_;
+};
+
+}
+
+#endif
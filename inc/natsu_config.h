@@ -1,17 +1,96 @@
 #ifndef NATSU_CONFIG_H_
 #define NATSU_CONFIG_H_
 
+#include <stdint.h>
+#include <string.h>
+#include <functional>
+#include <map>
+#include <memory>
 #include <string>
 
 namespace natsu{
 
+/* *
+ * ConfigSnapshot
+ * one immutable generation of the configuration. values are parsed once when
+ * the snapshot is built, typed reads are a map lookup. absent keys, and
+ * values that don't read as the asked type, give the default.
+*/
+class ConfigSnapshot
+{
+public:
+    explicit ConfigSnapshot(const std::map<std::string, std::string>& values, uint64_t version = 0);
+
+    bool contains(const char* k) const { return entries_.find(k) != entries_.end(); }
+    // NULL when absent, valid as long as the snapshot
+    const std::string* find(const char* k) const;
+
+    std::string get(const char* k, const std::string& def = std::string()) const;
+    int64_t get_int(const char* k, int64_t def = 0) const;
+    double get_double(const char* k, double def = 0) const;
+    // true/false, yes/no, on/off, 1/0
+    bool get_bool(const char* k, bool def = false) const;
+
+    size_t size() const { return entries_.size(); }
+    uint64_t version() const { return version_; }
+
+private:
+    struct Entry
+    {
+        std::string value;
+        int64_t int_;
+        double double_;
+        bool bool_;
+        bool is_int;
+        bool is_double;
+        bool is_bool;
+    };
+
+    // std::less<> finds by const char* without building a string
+    std::map<std::string, Entry, std::less<>> entries_;
+    uint64_t version_;
+};
+
+/* *
+ * NatsuConfig
+ * the process wide configuration, published RCU style: a writer builds a whole
+ * new snapshot and stores it with std::atomic_store, readers never take the
+ * writers' lock. every scheduler thread keeps the snapshot it saw last and
+ * checks one atomic version per read, it loads the new one on its first read
+ * after a swap. an old snapshot is freed with its last reference.
+ *
+ * the static getters copy their result out and are safe from any coroutine.
+ * one that reads several keys, or across a yield, holds snapshot() instead.
+ * keys set with config(k, v) override those loaded from a file.
+*/
 class NatsuConfig
 {
 public:
-	static void config(const std::string& k, const std::string& v);
-	static std::string config(const std::string& k);
+    static void config(const std::string& k, const std::string& v);
+    static std::string config(const std::string& k);
+
+    static int64_t get_int(const char* k, int64_t def = 0) { return snapshot()->get_int(k, def); }
+    static double get_double(const char* k, double def = 0) { return snapshot()->get_double(k, def); }
+    static bool get_bool(const char* k, bool def = false) { return snapshot()->get_bool(k, def); }
+
+    // the current generation, it stays valid when the coroutine moves to another thread
+    static std::shared_ptr<const ConfigSnapshot> snapshot();
+
+    /* *
+     * load
+     * reads "key = value" lines, '#' starts a comment line, and replaces
+     * every key an earlier load gave with them in one swap
+     * @return false when the file can't be read, the old values stay
+    */
+    static bool load(const std::string& path);
+
+    // load() now and again each time the file is written or replaced, from a coroutine
+    static bool watch(const std::string& path);
+
+    // called on the reloading coroutine after each swap
+    static void on_reload(std::function<void(const ConfigSnapshot&)> fn);
 };
 
 }
 
-#endif
\ No newline at end of file
+#endif
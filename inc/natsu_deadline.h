@@ -0,0 +1,51 @@
+#ifndef NATSU_DEADLINE_H_
+#define NATSU_DEADLINE_H_
+
+#include <chrono>
+#include <exception>
+
+namespace natsu {
+
+typedef std::chrono::steady_clock::time_point Deadline;
+
+/* *
+ * deadline
+ * @return Deadline : when the work of the calling coroutine has to be done,
+ *                    Deadline::max() when it has none.
+ *
+ * past it hooked socket IO fails with ETIMEDOUT, blocking channel operations
+ * throw std::system_error, invoke_rpc() returns NULL and newRedisInstance()
+ * an empty pointer. handlers of routes with a timeout run under one, a
+ * client lowers it with the X-Request-Timeout header in milliseconds.
+*/
+Deadline deadline();
+
+// milliseconds left, -1 without a deadline, 0 once it passed
+int deadline_remaining();
+
+// whether e was thrown because the deadline passed
+bool deadline_exceeded(const std::exception& e);
+
+/* *
+ * DeadlineScope
+ * tighten the deadline of the calling coroutine until the scope ends, a
+ * deadline later than the current one changes nothing. outside coroutines
+ * it applies to the calling thread.
+*/
+class DeadlineScope
+{
+public:
+    explicit DeadlineScope(Deadline d);
+    explicit DeadlineScope(std::chrono::milliseconds timeout);
+    ~DeadlineScope();
+
+private:
+    DeadlineScope(const DeadlineScope&);
+    DeadlineScope& operator=(const DeadlineScope&);
+
+    Deadline saved_;
+};
+
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef NATSU_ETAG_H_
+#define NATSU_ETAG_H_
+
+#include <string>
+#include <memory>
+
+#include "natsu_app.h"
+
+namespace natsu {
+
+// strong validator from the bytes of a body
+std::string make_etag(const std::string& body);
+
+// If-None-Match comparison, weak as required for GET, "*" matches anything
+bool etag_matches(const std::string& if_none_match, const std::string& etag);
+
+/* *
+ * ETagInject
+ * tags every finished 200 reply to a GET with a hash of its body and
+ * turns it into a bodyless 304 once the client already holds that body.
+ * replies that carry an ETag of their own or are streamed are left alone.
+ *
+ * natsu::NatsuApp app(std::make_shared<natsu::ETagInject>(my_inject));
+*/
+class ETagInject : public Inject
+{
+public:
+    ETagInject(std::shared_ptr<Inject> next = std::make_shared<Inject>());
+
+    virtual void before(std::shared_ptr<natsu::http::HttpRequest>&,std::shared_ptr<natsu::http::HttpResponse>&);
+    virtual void after(std::shared_ptr<natsu::http::HttpRequest>&,std::shared_ptr<natsu::http::HttpResponse>&);
+    virtual void fail(std::shared_ptr<natsu::http::HttpRequest>&,std::shared_ptr<natsu::http::HttpResponse>&);
+
+private:
+    std::shared_ptr<Inject> next_;
+};
+
+}
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef NATSU_JSON_H_
+#define NATSU_JSON_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace natsu {
+namespace json {
+
+enum Type
+{
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT,
+};
+
+struct Member;
+
+/* *
+ * Value
+ * a node of a parsed document, 16 bytes. strings point into the document's
+ * copy of the input, elements and members into its arena, so a Value is
+ * copied like a pointer and lives as long as its Document.
+ * lookups of absent keys or indexes give a null Value, as_*() of the wrong
+ * type throws std::logic_error.
+*/
+class Value
+{
+public:
+    Value() : size_(0), type_(JSON_NULL), integral_(false) { u_.int_ = 0; }
+
+    Type type() const { return static_cast<Type>(type_); }
+    bool is_null() const { return type_ == JSON_NULL; }
+    bool is_bool() const { return type_ == JSON_BOOL; }
+    bool is_number() const { return type_ == JSON_NUMBER; }
+    bool is_string() const { return type_ == JSON_STRING; }
+    bool is_array() const { return type_ == JSON_ARRAY; }
+    bool is_object() const { return type_ == JSON_OBJECT; }
+    // numbers without fraction or exponent that fit in 64 bits
+    bool is_integer() const { return type_ == JSON_NUMBER && integral_; }
+
+    bool as_bool() const;
+    int64_t as_int() const;
+    double as_double() const;
+    std::string as_string() const;
+
+    // the decoded string, NUL terminated and size() bytes long
+    const char* c_str() const;
+
+    // bytes of a string, elements of an array, members of an object, else 0
+    size_t size() const { return type_ >= JSON_STRING ? size_ : 0; }
+    bool empty() const { return size() == 0; }
+
+    const Value& operator[](size_t index) const;
+    const Value& operator[](int index) const { return (*this)[static_cast<size_t>(index)]; }
+    const Value& operator[](const char* key) const;
+    const Value& operator[](const std::string& key) const;
+
+    // NULL when this is no object or has no such key
+    const Value* find(const char* key, size_t len) const;
+    const Value* find(const char* key) const { return find(key, strlen(key)); }
+    bool contains(const char* key) const { return find(key) != NULL; }
+
+    // arrays: elements in order
+    const Value* begin() const { return type_ == JSON_ARRAY ? u_.items_ : NULL; }
+    const Value* end() const { return type_ == JSON_ARRAY ? u_.items_ + size_ : NULL; }
+
+    // objects: members in document order, duplicates kept
+    const Member* member_begin() const;
+    const Member* member_end() const;
+
+    bool equals(const char* s, size_t len) const { return type_ == JSON_STRING && size_ == len && memcmp(u_.str_, s, len) == 0; }
+
+    // compact JSON text of this value
+    std::string to_string() const;
+    void dump(std::string& out) const;
+
+private:
+    friend class Parser;
+
+    union
+    {
+        const char* str_;
+        const Value* items_;
+        const Member* members_;
+        double real_;
+        int64_t int_;
+        bool bool_;
+    } u_;
+    uint32_t size_;
+    uint8_t type_;
+    bool integral_;
+};
+
+struct Member
+{
+    Value name;
+    Value value;
+};
+
+inline const Member* Value::member_begin() const { return type_ == JSON_OBJECT ? u_.members_ : NULL; }
+inline const Member* Value::member_end() const { return type_ == JSON_OBJECT ? u_.members_ + size_ : NULL; }
+
+/* *
+ * Document
+ * owns one parse: a copy of the input where strings are decoded in place,
+ * and an arena holding every node. a parse costs one arena block sized from
+ * the input plus a scratch stack reused by the next parse, nothing is freed
+ * node by node. parsing again or destroying the document invalidates all
+ * Values taken from it.
+*/
+class Document
+{
+public:
+    Document();
+    ~Document();
+
+    // @return false on malformed input, see error()
+    bool parse(const char* p, size_t n);
+    bool parse(const std::string& s) { return parse(s.data(), s.size()); }
+
+    const Value& root() const { return root_; }
+    const Value& operator[](const char* key) const { return root_[key]; }
+    const Value& operator[](size_t index) const { return root_[index]; }
+
+    // why the last parse failed, "" after success
+    const std::string& error() const { return error_; }
+
+private:
+    Document(const Document&);
+    Document& operator=(const Document&);
+
+    friend class Parser;
+
+    void* allocate(size_t n);
+    void release();
+
+private:
+    struct Block;
+    Block* blocks_;
+    Value root_;
+    std::vector<Value> stack_;
+    std::string error_;
+};
+
+/* *
+ * Writer
+ * SAX style output appended straight to a string, normally resp.body(), so
+ * no tree is built on the way. commas and colons are placed by the writer,
+ * balancing begin and end is up to the caller:
+ *
+ *     json::Writer w(resp.body());
+ *     w.begin_object().key("code").value(0).key("users").begin_array();
+ *     for(auto& u : users)
+ *         w.begin_object().key("id").value(u.id).key("name").value(u.name).end_object();
+ *     w.end_array().end_object();
+ *
+ * strings are escaped as needed and must be UTF-8, integers are exact,
+ * doubles the shortest text that reads back the same, NaN and infinities
+ * become null.
+*/
+class Writer
+{
+public:
+    explicit Writer(std::string& out) : out_(out), comma_(false) {}
+
+    Writer& begin_object();
+    Writer& end_object();
+    Writer& begin_array();
+    Writer& end_array();
+
+    Writer& key(const char* k, size_t len);
+    Writer& key(const char* k) { return key(k, strlen(k)); }
+    Writer& key(const std::string& k) { return key(k.data(), k.size()); }
+    // a key already quoted, escaped and followed by ':', as the binding macros bake them
+    Writer& raw_key(const char* text, size_t len);
+
+    Writer& value(const char* s, size_t len);
+    Writer& value(const char* s) { return value(s, strlen(s)); }
+    Writer& value(const std::string& s) { return value(s.data(), s.size()); }
+    Writer& value(bool b);
+    Writer& value(int v) { return integer(v); }
+    Writer& value(long v) { return integer(v); }
+    Writer& value(long long v) { return integer(v); }
+    Writer& value(unsigned v) { return unsigned_integer(v); }
+    Writer& value(unsigned long v) { return unsigned_integer(v); }
+    Writer& value(unsigned long long v) { return unsigned_integer(v); }
+    Writer& value(double v);
+    // a parsed node, written compact
+    Writer& value(const Value& v);
+    Writer& null();
+
+    // text that already is JSON, inserted as one value without checking
+    Writer& raw(const char* json, size_t len);
+
+private:
+    Writer(const Writer&);
+    Writer& operator=(const Writer&);
+
+    Writer& integer(int64_t v);
+    Writer& unsigned_integer(uint64_t v);
+    void string(const char* s, size_t len);
+
+    // a comma before any value or key except the first of its container
+    void separate()
+    {
+        if(comma_)
+            out_.push_back(',');
+    }
+
+private:
+    std::string& out_;
+    bool comma_;
+};
+
+}}
+
+#endif
@@ -0,0 +1,268 @@
+#ifndef NATSU_JSON_BIND_H_
+#define NATSU_JSON_BIND_H_
+
+#include "natsu_json.h"
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace natsu {
+namespace json {
+
+/* *
+ * Reader
+ * pull parser over a text it does not copy, values go straight into C++
+ * variables without a Document in between. read() of a bound struct
+ * (NATSU_JSON below) fills the members it finds keys for and skips the rest,
+ * absent keys and null leave a member as it was. every call returns false
+ * once the text is malformed or of another shape than asked for, error()
+ * then tells where.
+*/
+class Reader
+{
+public:
+    Reader(const char* p, size_t n);
+    explicit Reader(const std::string& s);
+
+    bool read(bool& v);
+    bool read(int& v);
+    bool read(long& v);
+    bool read(long long& v);
+    bool read(unsigned& v);
+    bool read(unsigned long& v);
+    bool read(unsigned long long& v);
+    bool read(double& v);
+    bool read(float& v);
+    bool read(std::string& v);
+
+    template<class T>
+    bool read(std::vector<T>& v)
+    {
+        if(null())
+            return true;
+        if(!begin_array())
+            return false;
+
+        v.clear();
+        while(next_element())
+        {
+            v.emplace_back();
+            if(!read(v.back()))
+                return false;
+        }
+        return !failed_;
+    }
+
+    // structs declared with NATSU_JSON
+    template<class T>
+    auto read(T& v) -> decltype(natsu_json_read(*this, v, static_cast<const char*>(NULL), size_t()), bool())
+    {
+        if(null())
+            return true;
+        if(!begin_object())
+            return false;
+
+        const char* key;
+        size_t len;
+        while(next_member(key, len))
+        {
+            if(!natsu_json_read(*this, v, key, len))
+                return false;
+        }
+        return !failed_;
+    }
+
+    // passes over one value of any kind
+    bool skip();
+
+    // after the top level value, true when only whitespace is left
+    bool finish();
+
+    bool failed() const { return failed_; }
+    const std::string& error() const { return error_; }
+
+    /* *
+     * the pieces the templates are built of, usable by hand written readers.
+     * next_member() and next_element() return false at the closing bracket
+     * as well as on error, failed() tells the two apart. a key is valid until
+     * the next call and not NUL terminated.
+    */
+    bool begin_object();
+    bool next_member(const char*& key, size_t& len);
+    bool begin_array();
+    bool next_element();
+    // consumes a null if one is next
+    bool null();
+
+private:
+    bool signed_integer(int64_t& v, int64_t min, int64_t max);
+    bool unsigned_integer(uint64_t& v, uint64_t max);
+    bool digits(uint64_t limit, uint64_t& v);
+    // validates a number and steps over it
+    bool number(bool& integral);
+    bool string(std::string& out, const char*& s, size_t& len);
+    bool skip_string();
+    bool skip_key();
+    bool skip_scalar();
+    bool more(char close);
+    bool fail(const char* what);
+
+    void skip_ws()
+    {
+        while(p_ != end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t'))
+            ++p_;
+    }
+
+private:
+    const char* begin_;
+    const char* p_;
+    const char* end_;
+    bool first_;        // a container was just opened, no comma before its first entry
+    bool failed_;
+    std::string key_;   // escaped keys are decoded here
+    std::string error_;
+};
+
+// vectors and bound structs for the writer, beside its own overloads
+template<class T>
+auto write(Writer& w, const T& v) -> decltype(w.value(v))
+{
+    return w.value(v);
+}
+
+template<class T>
+Writer& write(Writer& w, const std::vector<T>& v)
+{
+    w.begin_array();
+    for(const T& e : v)
+        write(w, e);
+    return w.end_array();
+}
+
+template<class T>
+auto write(Writer& w, const T& v) -> decltype(natsu_json_write(w, v), w)
+{
+    natsu_json_write(w, v);
+    return w;
+}
+
+/* *
+ * from_json / to_json
+ * the whole of a text into v and v appended to out as JSON
+ * @return false on malformed text or a shape v can't take, why in *error
+*/
+template<class T>
+bool from_json(const char* p, size_t n, T& v, std::string* error = NULL)
+{
+    Reader r(p, n);
+    if(r.read(v) && r.finish())
+        return true;
+
+    if(error)
+        *error = r.error();
+    return false;
+}
+
+template<class T>
+bool from_json(const std::string& s, T& v, std::string* error = NULL)
+{
+    return from_json(s.data(), s.size(), v, error);
+}
+
+template<class T>
+void to_json(const T& v, std::string& out)
+{
+    Writer w(out);
+    write(w, v);
+}
+
+template<class T>
+std::string to_json(const T& v)
+{
+    std::string out;
+    to_json(v, out);
+    return out;
+}
+
+}}
+
+/* *
+ * NATSU_JSON(Type, field...)
+ * binds up to 32 members of a struct to the JSON keys of the same names, at
+ * namespace scope in the namespace of Type:
+ *
+ *     struct User { int64_t id; std::string name; std::vector<std::string> tags; };
+ *     NATSU_JSON(User, id, name, tags)
+ *
+ *     User u;
+ *     if(!json::from_json(req.body(), u, &error)) ...
+ *     json::to_json(u, resp.body());
+ *
+ * members are bool, integers, float, double, std::string, std::vector of
+ * those and other bound structs. it generates one function that compares a
+ * key against each name by length and memcmp, and one that writes the
+ * members with their quoted names as literals.
+*/
+#define NATSU_JSON(Type, ...) \
+    inline bool natsu_json_read(::natsu::json::Reader& r, Type& v, const char* key, size_t len) \
+    { \
+        NATSU_JSON_EACH(NATSU_JSON_READ_FIELD, __VA_ARGS__) \
+        return r.skip(); \
+    } \
+    inline void natsu_json_write(::natsu::json::Writer& w, const Type& v) \
+    { \
+        w.begin_object(); \
+        NATSU_JSON_EACH(NATSU_JSON_WRITE_FIELD, __VA_ARGS__) \
+        w.end_object(); \
+    }
+
+#define NATSU_JSON_READ_FIELD(f) \
+    if(len == sizeof(#f) - 1 && memcmp(key, #f, sizeof(#f) - 1) == 0) \
+        return r.read(v.f);
+
+#define NATSU_JSON_WRITE_FIELD(f) \
+    ::natsu::json::write(w.raw_key("\"" #f "\":", sizeof("\"" #f "\":") - 1), v.f);
+
+#define NATSU_JSON_EXPAND(x) x
+#define NATSU_JSON_PICK(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, \
+                        _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, NAME, ...) NAME
+#define NATSU_JSON_EACH(what, ...) NATSU_JSON_EXPAND(NATSU_JSON_PICK(__VA_ARGS__, \
+    NATSU_JSON_E32, NATSU_JSON_E31, NATSU_JSON_E30, NATSU_JSON_E29, NATSU_JSON_E28, NATSU_JSON_E27, NATSU_JSON_E26, NATSU_JSON_E25, \
+    NATSU_JSON_E24, NATSU_JSON_E23, NATSU_JSON_E22, NATSU_JSON_E21, NATSU_JSON_E20, NATSU_JSON_E19, NATSU_JSON_E18, NATSU_JSON_E17, \
+    NATSU_JSON_E16, NATSU_JSON_E15, NATSU_JSON_E14, NATSU_JSON_E13, NATSU_JSON_E12, NATSU_JSON_E11, NATSU_JSON_E10, NATSU_JSON_E9, \
+    NATSU_JSON_E8, NATSU_JSON_E7, NATSU_JSON_E6, NATSU_JSON_E5, NATSU_JSON_E4, NATSU_JSON_E3, NATSU_JSON_E2, NATSU_JSON_E1)(what, __VA_ARGS__))
+#define NATSU_JSON_E1(what, x) what(x)
+#define NATSU_JSON_E2(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E1(what, __VA_ARGS__))
+#define NATSU_JSON_E3(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E2(what, __VA_ARGS__))
+#define NATSU_JSON_E4(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E3(what, __VA_ARGS__))
+#define NATSU_JSON_E5(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E4(what, __VA_ARGS__))
+#define NATSU_JSON_E6(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E5(what, __VA_ARGS__))
+#define NATSU_JSON_E7(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E6(what, __VA_ARGS__))
+#define NATSU_JSON_E8(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E7(what, __VA_ARGS__))
+#define NATSU_JSON_E9(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E8(what, __VA_ARGS__))
+#define NATSU_JSON_E10(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E9(what, __VA_ARGS__))
+#define NATSU_JSON_E11(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E10(what, __VA_ARGS__))
+#define NATSU_JSON_E12(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E11(what, __VA_ARGS__))
+#define NATSU_JSON_E13(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E12(what, __VA_ARGS__))
+#define NATSU_JSON_E14(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E13(what, __VA_ARGS__))
+#define NATSU_JSON_E15(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E14(what, __VA_ARGS__))
+#define NATSU_JSON_E16(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E15(what, __VA_ARGS__))
+#define NATSU_JSON_E17(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E16(what, __VA_ARGS__))
+#define NATSU_JSON_E18(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E17(what, __VA_ARGS__))
+#define NATSU_JSON_E19(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E18(what, __VA_ARGS__))
+#define NATSU_JSON_E20(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E19(what, __VA_ARGS__))
+#define NATSU_JSON_E21(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E20(what, __VA_ARGS__))
+#define NATSU_JSON_E22(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E21(what, __VA_ARGS__))
+#define NATSU_JSON_E23(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E22(what, __VA_ARGS__))
+#define NATSU_JSON_E24(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E23(what, __VA_ARGS__))
+#define NATSU_JSON_E25(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E24(what, __VA_ARGS__))
+#define NATSU_JSON_E26(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E25(what, __VA_ARGS__))
+#define NATSU_JSON_E27(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E26(what, __VA_ARGS__))
+#define NATSU_JSON_E28(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E27(what, __VA_ARGS__))
+#define NATSU_JSON_E29(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E28(what, __VA_ARGS__))
+#define NATSU_JSON_E30(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E29(what, __VA_ARGS__))
+#define NATSU_JSON_E31(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E30(what, __VA_ARGS__))
+#define NATSU_JSON_E32(what, x, ...) what(x) NATSU_JSON_EXPAND(NATSU_JSON_E31(what, __VA_ARGS__))
+
+#endif
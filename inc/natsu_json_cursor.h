@@ -0,0 +1,88 @@
+#ifndef NATSU_JSON_CURSOR_H_
+#define NATSU_JSON_CURSOR_H_
+
+#include "natsu_json.h"
+#include "natsu_json_bind.h"
+#include <string.h>
+#include <string>
+
+namespace natsu {
+namespace json {
+
+/* *
+ * Cursor
+ * on demand access to a text nobody parsed: a cursor is the position of one
+ * value and a lookup scans forward from there, stepping over the members and
+ * elements it passes by counting brackets without decoding them. only what is
+ * asked for gets decoded, so a few fields out of a large body cost a scan of
+ * the bytes before them instead of a whole Document:
+ *
+ *     json::Cursor root(resp.body());
+ *     std::string v = root.at("/node/nodes/0/value").as_string();
+ *
+ * the text must outlive the cursors taken from it. skipped subtrees are not
+ * validated, a lookup that runs into malformed text, an absent key or an
+ * index out of range gives an invalid cursor that is null to every accessor.
+ * as_*() of the wrong type throws std::logic_error like Value.
+*/
+class Cursor
+{
+public:
+    Cursor() : p_(NULL), end_(NULL) {}
+    Cursor(const char* p, size_t n);
+    explicit Cursor(const std::string& s) : Cursor(s.data(), s.size()) {}
+
+    bool valid() const { return p_ != NULL; }
+    explicit operator bool() const { return valid(); }
+
+    // from the first byte, invalid cursors are JSON_NULL
+    Type type() const;
+    bool is_null() const { return type() == JSON_NULL; }
+    bool is_bool() const { return type() == JSON_BOOL; }
+    bool is_number() const { return type() == JSON_NUMBER; }
+    bool is_string() const { return type() == JSON_STRING; }
+    bool is_array() const { return type() == JSON_ARRAY; }
+    bool is_object() const { return type() == JSON_OBJECT; }
+
+    bool as_bool() const;
+    int64_t as_int() const;
+    double as_double() const;
+    std::string as_string() const;
+
+    // the value read into v as Reader::read() does, bound structs included
+    template<class T>
+    bool get(T& v) const
+    {
+        if(!p_)
+            return false;
+        Reader r(p_, end_ - p_);
+        return r.read(v);
+    }
+
+    Cursor operator[](size_t index) const;
+    Cursor operator[](int index) const { return (*this)[static_cast<size_t>(index)]; }
+    Cursor operator[](const char* key) const { return find(key, strlen(key)); }
+    Cursor operator[](const std::string& key) const { return find(key.data(), key.size()); }
+
+    // the first member named key, matched against the decoded name
+    Cursor find(const char* key, size_t len) const;
+
+    // RFC 6901 JSON pointer relative to this value, "" is the value itself
+    Cursor at(const char* pointer, size_t len) const;
+    Cursor at(const char* pointer) const { return at(pointer, strlen(pointer)); }
+    Cursor at(const std::string& pointer) const { return at(pointer.data(), pointer.size()); }
+
+    // the text of this value as it appears in the input, "" when invalid
+    std::string raw() const;
+
+private:
+    Cursor(const char* p, const char* end) : p_(p), end_(end) {}
+
+private:
+    const char* p_;     // first byte of the value
+    const char* end_;   // end of the whole text
+};
+
+}}
+
+#endif
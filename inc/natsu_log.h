@@ -0,0 +1,103 @@
+#ifndef NATSU_LOG_H_
+#define NATSU_LOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+
+namespace natsu {
+
+enum LogLevel
+{
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR,
+    LOG_ACCESS,
+};
+
+/* *
+ * log_init
+ * @param fd : output file descriptor, default stderr
+ * @param level : records below level are discarded before formatting
+ * @param access : enable per-request access records
+ *
+ * producers copy the format pointer and the raw arguments into a fixed-size
+ * record of a per-thread ring and never block, a background thread runs the
+ * printf formatting and writev()s records in batches. when a ring is full the
+ * record is dropped and counted, drops are reported once a second.
+*/
+void log_init(int fd = STDERR_FILENO, LogLevel level = LOG_INFO, bool access = false);
+
+/* *
+ * log_enabled
+ * @return bool : whether records of level are kept
+*/
+bool log_enabled(LogLevel level);
+
+/* *
+ * LogArg
+ * one printf argument as the producer packs it. strings are copied into the
+ * record, only fmt itself is kept by pointer and must be a string literal.
+*/
+struct LogArg
+{
+    enum Type { kInt, kUint, kDouble, kString, kPointer };
+
+    LogArg() : type(kInt), i(0) {}
+    LogArg(int v) : type(kInt), i(v) {}
+    LogArg(long v) : type(kInt), i(v) {}
+    LogArg(long long v) : type(kInt), i(v) {}
+    LogArg(unsigned v) : type(kUint), u(v) {}
+    LogArg(unsigned long v) : type(kUint), u(v) {}
+    LogArg(unsigned long long v) : type(kUint), u(v) {}
+    LogArg(double v) : type(kDouble), d(v) {}
+    LogArg(const char* v) : type(kString), s(v) {}
+    template<class T> LogArg(const T* v) : type(kPointer), p(v) {}
+
+    Type type;
+    union
+    {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const char* s;
+        const void* p;
+    };
+};
+
+void log_push(LogLevel level, const char* fmt, const LogArg* args, size_t n);
+
+// never called, lets the compiler check the arguments against fmt
+inline void log_check(const char*, ...) __attribute__((format(printf, 1, 2)));
+inline void log_check(const char*, ...) {}
+
+template<class... Args>
+void log_write(LogLevel level, const char* fmt, const Args&... args)
+{
+    const LogArg packed[sizeof...(Args) + 1] = { LogArg(args)... };
+    log_push(level, fmt, packed, sizeof...(Args));
+}
+
+/* *
+ * log_flush
+ * drain every ring synchronously, called at exit
+*/
+void log_flush();
+
+}
+
+// "" fmt only compiles for a literal, the record keeps the pointer
+#define NATSU_LOG(level, fmt, ...) \
+    do { \
+        if (false) ::natsu::log_check(fmt, ##__VA_ARGS__); \
+        if (::natsu::log_enabled(level)) ::natsu::log_write(level, "" fmt, ##__VA_ARGS__); \
+    } while (0)
+
+#define NATSU_LOG_DEBUG(fmt, ...)  NATSU_LOG(::natsu::LOG_DEBUG, fmt, ##__VA_ARGS__)
+#define NATSU_LOG_INFO(fmt, ...)   NATSU_LOG(::natsu::LOG_INFO, fmt, ##__VA_ARGS__)
+#define NATSU_LOG_WARN(fmt, ...)   NATSU_LOG(::natsu::LOG_WARN, fmt, ##__VA_ARGS__)
+#define NATSU_LOG_ERROR(fmt, ...)  NATSU_LOG(::natsu::LOG_ERROR, fmt, ##__VA_ARGS__)
+#define NATSU_LOG_ACCESS(fmt, ...) NATSU_LOG(::natsu::LOG_ACCESS, fmt, ##__VA_ARGS__)
+
+#endif
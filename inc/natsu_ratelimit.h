@@ -0,0 +1,75 @@
+#ifndef NATSU_RATELIMIT_H_
+#define NATSU_RATELIMIT_H_
+
+#include <stdint.h>
+#include <string>
+#include <memory>
+
+#include "natsu_app.h"
+
+namespace natsu {
+
+struct RateLimitOptions
+{
+    RateLimitOptions()
+    : rate(100), burst(100), max_keys(65536) {}
+
+    double rate;            // requests per second per key
+    unsigned burst;         // requests a key may send at once
+    size_t max_keys;        // keys tracked, the least recently active ones are evicted
+    std::string header;     // request header the key is read from, empty keys by client ip
+};
+
+/* *
+ * RateLimiter
+ * token bucket per key, lock free. every bucket is one atomic word holding
+ * the time it refills completely (GCRA), so a decision is one CAS.
+ * buckets live in a fixed table of cache line sized sets, a key competes
+ * only with the keys of its set and the idlest one is evicted.
+*/
+class RateLimiter
+{
+public:
+    RateLimiter(const RateLimitOptions& opts);
+    ~RateLimiter();
+
+    // @param retry_after : seconds until the key is allowed again, set when denied
+    bool allow(const char* key, size_t len, unsigned& retry_after);
+    bool allow(const std::string& key);
+
+private:
+    RateLimiter(const RateLimiter&);
+    RateLimiter& operator=(const RateLimiter&);
+
+    struct Set;
+    Set* sets_;
+    uint64_t mask_;
+    uint64_t interval_;     // nanoseconds per token
+    uint64_t tolerance_;    // nanoseconds of burst
+};
+
+/* *
+ * RateLimitInject
+ * answers 429 before routing once a client is over its limit, everything
+ * else is passed on to next.
+ *
+ * natsu::NatsuApp app(std::make_shared<natsu::RateLimitInject>(opts, my_inject));
+*/
+class RateLimitInject : public Inject
+{
+public:
+    RateLimitInject(const RateLimitOptions& opts, std::shared_ptr<Inject> next = std::make_shared<Inject>());
+
+    virtual void before(std::shared_ptr<natsu::http::HttpRequest>&,std::shared_ptr<natsu::http::HttpResponse>&);
+    virtual void after(std::shared_ptr<natsu::http::HttpRequest>&,std::shared_ptr<natsu::http::HttpResponse>&);
+    virtual void fail(std::shared_ptr<natsu::http::HttpRequest>&,std::shared_ptr<natsu::http::HttpResponse>&);
+
+private:
+    RateLimiter limiter_;
+    std::string header_;
+    std::shared_ptr<Inject> next_;
+};
+
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef NATSU_SSE_H_
+#define NATSU_SSE_H_
+
+#include <string>
+#include <memory>
+
+#include "http_response.h"
+
+namespace natsu {
+namespace http {
+
+struct SseOptions
+{
+    SseOptions()
+    : max_queue(64), keepalive(15), retry(0) {}
+
+    size_t max_queue;   // events waiting for a subscriber, one more drops it
+    int keepalive;      // seconds of silence before a comment line probes the connection
+    int retry;          // reconnect delay advertised to clients in milliseconds, 0 sends none
+};
+
+/* *
+ * SseBroadcaster
+ * server-sent events by topic. publish() formats an event once, every
+ * subscriber gets a reference to the same buffer and its own coroutine
+ * writes it out, so a slow client never holds up the others. a client
+ * falling max_queue events behind is disconnected.
+ *
+ * app.register_handler("/events", [&](std::shared_ptr<HttpRequest> req, std::shared_ptr<HttpResponse> rsp) {
+ *     events.subscribe(req->data("topic"), rsp);
+ * });
+ * events.publish("prices", "{\"btc\":1}");
+*/
+class SseBroadcaster
+{
+public:
+    SseBroadcaster(const SseOptions& opts = SseOptions());
+
+    // turn rsp into an event stream of topic
+    void subscribe(const std::string& topic, std::shared_ptr<HttpResponse> rsp);
+
+    // @return subscribers the event was queued for
+    size_t publish(const std::string& topic, const std::string& data,
+                   const std::string& event = "", const std::string& id = "");
+
+    size_t subscribers(const std::string& topic);
+
+private:
+    class SseBroadcasterImpl;
+    std::shared_ptr<SseBroadcasterImpl> broadcaster_;
+};
+
+}}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef NATSU_WEBSOCKET_H_
+#define NATSU_WEBSOCKET_H_
+
+#include <stdint.h>
+#include <string>
+#include <memory>
+#include <functional>
+
+#include "http_request.h"
+
+namespace natsu {
+namespace http {
+
+struct WebSocketOptions
+{
+    WebSocketOptions()
+    : max_message(1024 * 1024), stack_size(256 * 1024) {}
+
+    size_t max_message;     // larger messages close the connection with 1009
+    size_t stack_size;      // stack of the coroutine running the handler, reads spill 16KB onto it
+};
+
+/* *
+ * WebSocket
+ * an upgraded connection. receive() parks the calling coroutine until a
+ * whole message arrived, fragments are joined and pings answered on the
+ * way. send() may be called from any coroutine, frames never interleave.
+ * the connection is closed when the handler returned and the last
+ * reference is gone.
+*/
+class WebSocket
+{
+public:
+    enum Opcode
+    {
+        CONTINUATION = 0x0,
+        TEXT = 0x1,
+        BINARY = 0x2,
+        CLOSE = 0x8,
+        PING = 0x9,
+        PONG = 0xA,
+    };
+
+    WebSocket(int sockfd, const std::string& remote, const WebSocketOptions& opts);
+    ~WebSocket();
+
+    // @return false once the connection is closed
+    bool receive(std::string& message, Opcode* opcode = NULL);
+
+    bool send(const std::string& message, Opcode opcode = TEXT);
+    bool send(const char* data, size_t len, Opcode opcode = TEXT);
+    bool ping(const std::string& payload = "");
+
+    // send a close frame, receive() returns false from now on
+    void close(uint16_t code = 1000, const std::string& reason = "");
+    bool closed();
+
+    const std::string& remote();
+
+private:
+    WebSocket(const WebSocket&);
+    WebSocket& operator=(const WebSocket&);
+
+    class WebSocketImpl;
+    std::unique_ptr<WebSocketImpl> socket_;
+};
+
+typedef std::function<void(std::shared_ptr<HttpRequest>, std::shared_ptr<WebSocket>)> WebSocketHandler;
+
+}}
+
+#endif
@@ -8,6 +8,13 @@
 namespace co
 {
 
+// 当前协程设置了截止时间时返回true, 阻塞的读写最多等到截止时间, 超时抛出ec_deadline_exceeded
+inline bool GetTaskDeadline(std::chrono::steady_clock::time_point & deadline)
+{
+    deadline = g_Scheduler.GetCurrentTaskDeadline();
+    return deadline != std::chrono::steady_clock::time_point::max();
+}
+
 template <typename T>
 class Channel
 {
@@ -121,6 +128,13 @@ private:
         template <typename U>
         void operator<<(U && t)
         {
+            std::chrono::steady_clock::time_point deadline;
+            if (GetTaskDeadline(deadline)) {
+                if (!TimedPush(std::forward<U>(t), deadline))
+                    ThrowError(eCoErrorCode::ec_deadline_exceeded);
+                return ;
+            }
+
             write_block_.CoBlockWait();
 
             {
@@ -135,6 +149,13 @@ private:
         template <typename U>
         void operator>>(U & t)
         {
+            std::chrono::steady_clock::time_point deadline;
+            if (GetTaskDeadline(deadline)) {
+                if (!TimedPop(t, deadline))
+                    ThrowError(eCoErrorCode::ec_deadline_exceeded);
+                return ;
+            }
+
             write_block_.Wakeup();
             read_block_.CoBlockWait();
 
@@ -148,6 +169,13 @@ private:
         // read and ignore
         void operator>>(nullptr_t ignore)
         {
+            std::chrono::steady_clock::time_point deadline;
+            if (GetTaskDeadline(deadline)) {
+                if (!TimedPop(ignore, deadline))
+                    ThrowError(eCoErrorCode::ec_deadline_exceeded);
+                return ;
+            }
+
             write_block_.Wakeup();
             read_block_.CoBlockWait();
 
@@ -364,6 +392,13 @@ private:
         // write
         void operator<<(nullptr_t ignore)
         {
+            std::chrono::steady_clock::time_point deadline;
+            if (GetTaskDeadline(deadline)) {
+                if (!TimedPush(ignore, deadline))
+                    ThrowError(eCoErrorCode::ec_deadline_exceeded);
+                return ;
+            }
+
             write_block_.CoBlockWait();
             read_block_.Wakeup();
         }
@@ -371,6 +406,13 @@ private:
         // read and ignore
         void operator>>(nullptr_t ignore)
         {
+            std::chrono::steady_clock::time_point deadline;
+            if (GetTaskDeadline(deadline)) {
+                if (!TimedPop(ignore, deadline))
+                    ThrowError(eCoErrorCode::ec_deadline_exceeded);
+                return ;
+            }
+
             write_block_.Wakeup();
             read_block_.CoBlockWait();
         }
@@ -38,6 +38,7 @@ sendmsg_t sendmsg_f = &sendmsg;
 poll_t poll_f = &poll;
 select_t select_f = &select;
 accept_t accept_f = &accept;
+accept4_t accept4_f = &accept4;
 sleep_t sleep_f = &sleep;
 usleep_t usleep_f = &usleep;
 nanosleep_t nanosleep_f = &nanosleep;
@@ -43,6 +43,9 @@ std::string co_error_category::message(int v) const
             return "std thread link error.\n"
                 "if static-link use flags: '-Wl,--whole-archive -lpthread -Wl,--no-whole-archive -static' on link step;\n"
                 "if dynamic-link use flags: '-pthread' on compile step and link step;\n";
+
+        case (int)eCoErrorCode::ec_deadline_exceeded:
+            return "deadline exceeded";
     }
 
     return "";
@@ -17,6 +17,7 @@ enum class eCoErrorCode : int
     ec_iocpinit_failed,
     ec_protect_stack_failed,
     ec_std_thread_link_error,
+    ec_deadline_exceeded,
 };
 
 class co_error_category
@@ -100,20 +100,17 @@ void IoWait::__IOBlockTriggered(IoSentryPtr io_sentry)
 
 int IoWait::reactor_ctl(int epollfd, int epoll_ctl_mod, int fd, uint32_t poll_events, bool is_socket)
 {
-    if (is_socket) {
-        epoll_event ev;
-        ev.events = PollEvent2Epoll(poll_events);
-        ev.data.fd = fd;
-        int res = epoll_ctl(epollfd, epoll_ctl_mod, fd, &ev);
-        DebugPrint(dbg_ioblock, "epoll_ctl(fd:%d, MOD:%s, events:%s) returns %d",
-                fd, EpollMod2Str(epoll_ctl_mod),
-                EpollEvent2Str(ev.events).c_str(), res);
-        return res;
-    }
-
-    // TODO: poll模拟
-    errno = EPERM;
-    return -1;
+    // pipe, eventfd, inotify等非socket的fd同样可以加入epoll,
+    // 普通文件epoll_ctl会返回EPERM, 由调用方按无效fd处理.
+    (void)is_socket;
+    epoll_event ev;
+    ev.events = PollEvent2Epoll(poll_events);
+    ev.data.fd = fd;
+    int res = epoll_ctl(epollfd, epoll_ctl_mod, fd, &ev);
+    DebugPrint(dbg_ioblock, "epoll_ctl(fd:%d, MOD:%s, events:%s) returns %d",
+            fd, EpollMod2Str(epoll_ctl_mod),
+            EpollEvent2Str(ev.events).c_str(), res);
+    return res;
 }
 int IoWait::WaitLoop(int wait_milliseconds)
 {
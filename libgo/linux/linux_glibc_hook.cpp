@@ -6,6 +6,7 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <assert.h>
 #include <chrono>
 #include <map>
@@ -19,6 +20,25 @@ namespace co {
     void coroutine_hook_init();
 }
 
+// 按协程的截止时间收紧等待时间(毫秒, -1为无限时), 已过期时返回0
+static int deadline_timeout(Task* tk, int timeout_ms)
+{
+    if (tk->deadline_ == std::chrono::steady_clock::time_point::max())
+        return timeout_ms;
+
+    auto now = std::chrono::steady_clock::now();
+    if (tk->deadline_ <= now)
+        return 0;
+
+    // 向上取整, 避免在到期前的最后1毫秒内空转
+    long long left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            tk->deadline_ - now + std::chrono::microseconds(999)).count();
+    if (timeout_ms < 0 || left < timeout_ms)
+        return (int)left;
+
+    return timeout_ms;
+}
+
 template <typename OriginF, typename ... Args>
 static ssize_t read_write_mode(int fd, OriginF fn, const char* hook_fn_name, uint32_t event, int timeout_so, Args && ... args)
 {
@@ -73,7 +93,8 @@ eintr:
             if (errno == EINTR) goto eintr;
             return -1;
         } else if (0 == triggers) {  // poll等待超时
-            errno = EAGAIN;
+            // 协程截止时间已过, 与SO_RCVTIMEO超时区分开, 避免调用者按EAGAIN重试
+            errno = (tk->deadline_ <= std::chrono::steady_clock::now()) ? ETIMEDOUT : EAGAIN;
             return -1;
         }
 
@@ -113,6 +134,7 @@ sendmsg_t sendmsg_f = NULL;
 poll_t poll_f = NULL;
 select_t select_f = NULL;
 accept_t accept_f = NULL;
+accept4_t accept4_f = NULL;
 sleep_t sleep_f = NULL;
 usleep_t usleep_f = NULL;
 nanosleep_t nanosleep_f = NULL;
@@ -181,6 +203,13 @@ int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
     return read_write_mode(sockfd, accept_f, "accept", POLLIN, SO_RCVTIMEO, addr, addrlen);
 }
 
+// 与socket()相同, SOCK_NONBLOCK只省去fd初始化时的fcntl, 在协程中的读写仍由hook接管
+int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags)
+{
+    if (!accept4_f) coroutine_hook_init();
+    return read_write_mode(sockfd, accept4_f, "accept4", POLLIN, SO_RCVTIMEO, addr, addrlen, flags);
+}
+
 ssize_t read(int fd, void *buf, size_t count)
 {
     if (!read_f) coroutine_hook_init();
@@ -275,9 +304,12 @@ int poll(struct pollfd *fds, nfds_t nfds, int timeout)
     }
     // --------------------------------
 
+    // 协程设置了截止时间时, 最多等到截止时间
+    timeout = deadline_timeout(tk, timeout);
+
     // 执行一次非阻塞的poll, 检测异常或无效fd.
     int res = poll_f(fds, nfds, 0);
-    if (res != 0)
+    if (res != 0 || timeout == 0)
         return res;
 
     // create io-sentry
@@ -733,6 +765,12 @@ extern ssize_t __sendto(int sockfd, const void *buf, size_t len, int flags,
         const struct sockaddr *dest_addr, socklen_t addrlen);
 extern ssize_t __sendmsg(int sockfd, const struct msghdr *msg, int flags);
 extern int __libc_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
+
+// libc.a没有导出__libc_accept4, 直接走系统调用.
+static int __accept4_syscall(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags)
+{
+    return syscall(SYS_accept4, sockfd, addr, addrlen, flags);
+}
 extern int __poll(struct pollfd *fds, nfds_t nfds, int timeout);
 extern int __select(int nfds, fd_set *readfds, fd_set *writefds,
                           fd_set *exceptfds, struct timeval *timeout);
@@ -781,6 +819,7 @@ void coroutine_hook_init()
     sendto_f = (sendto_t)dlsym(RTLD_NEXT, "sendto");
     sendmsg_f = (sendmsg_t)dlsym(RTLD_NEXT, "sendmsg");
     accept_f = (accept_t)dlsym(RTLD_NEXT, "accept");
+    accept4_f = (accept4_t)dlsym(RTLD_NEXT, "accept4");
     poll_f = (poll_t)dlsym(RTLD_NEXT, "poll");
     select_f = (select_t)dlsym(RTLD_NEXT, "select");
     sleep_f = (sleep_t)dlsym(RTLD_NEXT, "sleep");
@@ -807,6 +846,7 @@ void coroutine_hook_init()
     sendto_f = &__sendto;
     sendmsg_f = &__sendmsg;
     accept_f = &__libc_accept;
+    accept4_f = &__accept4_syscall;
     poll_f = &__poll;
     select_f = &__select;
     sleep_f = &__sleep;
@@ -823,7 +863,7 @@ void coroutine_hook_init()
 #endif
 
     if (!connect_f || !read_f || !write_f || !readv_f || !writev_f || !send_f
-            || !sendto_f || !sendmsg_f || !accept_f || !poll_f || !select_f
+            || !sendto_f || !sendmsg_f || !accept_f || !accept4_f || !poll_f || !select_f
             || !sleep_f|| !usleep_f || !nanosleep_f || !close_f || !fcntl_f || !setsockopt_f
             || !getsockopt_f || !dup_f || !dup2_f || !dup3_f)
     {
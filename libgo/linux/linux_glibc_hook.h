@@ -48,6 +48,9 @@ extern select_t select_f;
 typedef int(*accept_t)(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
 extern accept_t accept_f;
 
+typedef int(*accept4_t)(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+extern accept4_t accept4_f;
+
 typedef unsigned int(*sleep_t)(unsigned int seconds);
 extern sleep_t sleep_f;
 
@@ -20,6 +20,9 @@ private:
     static std::atomic<uint32_t> s_id_;
 
 public:
+    // 所属分组, 只在同组的P之间偷取协程
+    int group_ = 0;
+
     explicit Processer();
 
     void AddTaskRunnable(Task *tk);
@@ -92,6 +92,7 @@ uint32_t Scheduler::Run(int flags)
     if (info.thread_id < 0) {
         info.thread_id = thread_id_++;
         info.proc = GetProcesser(info.thread_id);
+        info.proc->group_ = info.group;
     }
 
     uint32_t run_task_count = 0;
@@ -179,6 +180,17 @@ uint32_t Scheduler::DoRunnable(bool allow_steal)
             int r = rand() % thread_count;
             if (r == info.thread_id)    // 不能选到当前线程
                 r = info.thread_id > 0 ? (info.thread_id - 1) : (info.thread_id + 1);
+
+            // 只偷取同组的线程
+            for (std::size_t i = 0; i < thread_count; ++i) {
+                Processer* p = run_proc_list_[r];
+                if (r != info.thread_id && p->group_ == info.proc->group_)
+                    break;
+                r = (r + 1) % thread_count;
+            }
+            if (r == info.thread_id || run_proc_list_[r]->group_ != info.proc->group_)
+                return do_count;
+
             std::size_t steal_count = run_proc_list_[r]->StealHalf(*info.proc);
             if (steal_count) {
                 return DoRunnable(false);
@@ -226,6 +238,27 @@ void Scheduler::RunLoop()
     for (;;) Run();
 }
 
+void Scheduler::RunLoop(int group)
+{
+    GetLocalInfo().group = group;
+    RunLoop();
+}
+
+int Scheduler::GroupDispatch(int group)
+{
+    std::unique_lock<LFLock> lock(proc_init_lock_);
+    std::vector<int> members;
+    for (std::size_t i = 0; i < run_proc_list_.size(); ++i)
+        if (run_proc_list_[i]->group_ == group)
+            members.push_back(i);
+    lock.unlock();
+
+    if (members.empty())
+        return -1;
+
+    return members[group_robin_index_++ % members.size()];
+}
+
 void Scheduler::AddTaskRunnable(Task* tk, int dispatch)
 {
     DebugPrint(dbg_scheduler, "Add task(%s) to runnable list.", tk->DebugInfo());
@@ -239,14 +272,16 @@ void Scheduler::AddTaskRunnable(Task* tk, int dispatch)
             case egod_random:
                 {
                     std::size_t n = std::max<std::size_t>(run_proc_list_.size(), 1);
-                    GetProcesser(rand() % n)->AddTaskRunnable(tk);
+                    Processer* p = GetProcesser(rand() % n);
+                    (p->group_ ? GetProcesser(0) : p)->AddTaskRunnable(tk);
                 }
                 return ;
 
             case egod_robin:
                 {
                     std::size_t n = std::max<std::size_t>(run_proc_list_.size(), 1);
-                    GetProcesser(dispatch_robin_index_++ % n)->AddTaskRunnable(tk);
+                    Processer* p = GetProcesser(dispatch_robin_index_++ % n);
+                    (p->group_ ? GetProcesser(0) : p)->AddTaskRunnable(tk);
                 }
                 return ;
 
@@ -296,6 +331,19 @@ const char* Scheduler::GetCurrentTaskDebugInfo()
     return tk ? tk->DebugInfo() : "";
 }
 
+void Scheduler::SetCurrentTaskDeadline(std::chrono::steady_clock::time_point deadline)
+{
+    Task* tk = GetCurrentTask();
+    if (!tk) return ;
+    tk->deadline_ = deadline;
+}
+
+std::chrono::steady_clock::time_point Scheduler::GetCurrentTaskDeadline()
+{
+    Task* tk = GetCurrentTask();
+    return tk ? tk->deadline_ : std::chrono::steady_clock::time_point::max();
+}
+
 uint32_t Scheduler::GetCurrentThreadID()
 {
     return GetLocalInfo().thread_id;
@@ -79,6 +79,7 @@ struct ThreadLocalInfo
     int thread_id = -1;     // Run thread index, increment from 1.
     uint8_t sleep_ms = 0;
     Processer *proc = nullptr;
+    int group = 0;          // 线程执行的P所属分组
 };
 
 class ThreadPool;
@@ -132,6 +133,13 @@ class Scheduler
         // 无限循环执行Run
         void RunLoop();
 
+        // 以指定分组无限循环执行Run, 需在此线程首次Run之前调用.
+        // 分组之间不会互相偷取协程, 可将重负载的协程隔离在独立的线程上.
+        void RunLoop(int group);
+
+        // 在分组内轮询选出一个线程索引, 用于go_dispatch. 分组内还没有线程时返回-1
+        int GroupDispatch(int group);
+
         // 当前协程总数量
         uint32_t TaskCount();
 
@@ -147,6 +155,12 @@ class Scheduler
         // 获取当前协程的调试信息, 返回的内容包括用户自定义的信息和协程ID
         const char* GetCurrentTaskDebugInfo();
 
+        // 设置当前协程的截止时间, time_point::max()为不限时. 不在协程中时无效
+        void SetCurrentTaskDeadline(std::chrono::steady_clock::time_point deadline);
+
+        // 当前协程的截止时间, 未设置或不在协程中时返回time_point::max()
+        std::chrono::steady_clock::time_point GetCurrentTaskDeadline();
+
         // 获取当前线程ID.(按执行调度器调度的顺序计)
         uint32_t GetCurrentThreadID();
 
@@ -220,6 +234,7 @@ class Scheduler
         LFLock proc_init_lock_;
         ProcList run_proc_list_;
         std::atomic<uint32_t> dispatch_robin_index_{0};
+        std::atomic<uint32_t> group_robin_index_{0};
 
         // io block waiter.
         IoWait io_wait_;
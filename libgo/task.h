@@ -59,6 +59,9 @@ struct Task
 
     int sleep_ms_ = 0;                  // 睡眠时间
 
+    // 截止时间, 过期后hook的socket IO以ETIMEDOUT失败, channel的阻塞操作抛出ec_deadline_exceeded
+    std::chrono::steady_clock::time_point deadline_ = std::chrono::steady_clock::time_point::max();
+
     explicit Task(TaskF const& fn, std::size_t stack_size,
             const char* file, int lineno);
     ~Task();
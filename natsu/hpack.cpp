@@ -0,0 +1,549 @@
+#include "hpack.h"
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+
+namespace natsu {
+namespace http {
+
+struct StaticEntry
+{
+    const char* name;
+    const char* value;
+};
+
+// RFC 7541 appendix A, index 1 is the first entry
+static const StaticEntry kStaticTable[] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+static const size_t kStaticEntries = sizeof(kStaticTable) / sizeof(kStaticTable[0]);
+
+struct HuffmanCode
+{
+    uint32_t code;
+    int bits;
+};
+
+// RFC 7541 appendix B, symbol 256 is EOS
+static const HuffmanCode kHuffmanCodes[] = {
+    { 0x1ff8, 13 }, { 0x7fffd8, 23 }, { 0xfffffe2, 28 }, { 0xfffffe3, 28 },
+    { 0xfffffe4, 28 }, { 0xfffffe5, 28 }, { 0xfffffe6, 28 }, { 0xfffffe7, 28 },
+    { 0xfffffe8, 28 }, { 0xffffea, 24 }, { 0x3ffffffc, 30 }, { 0xfffffe9, 28 },
+    { 0xfffffea, 28 }, { 0x3ffffffd, 30 }, { 0xfffffeb, 28 }, { 0xfffffec, 28 },
+    { 0xfffffed, 28 }, { 0xfffffee, 28 }, { 0xfffffef, 28 }, { 0xffffff0, 28 },
+    { 0xffffff1, 28 }, { 0xffffff2, 28 }, { 0x3ffffffe, 30 }, { 0xffffff3, 28 },
+    { 0xffffff4, 28 }, { 0xffffff5, 28 }, { 0xffffff6, 28 }, { 0xffffff7, 28 },
+    { 0xffffff8, 28 }, { 0xffffff9, 28 }, { 0xffffffa, 28 }, { 0xffffffb, 28 },
+    { 0x14, 6 }, { 0x3f8, 10 }, { 0x3f9, 10 }, { 0xffa, 12 },
+    { 0x1ff9, 13 }, { 0x15, 6 }, { 0xf8, 8 }, { 0x7fa, 11 },
+    { 0x3fa, 10 }, { 0x3fb, 10 }, { 0xf9, 8 }, { 0x7fb, 11 },
+    { 0xfa, 8 }, { 0x16, 6 }, { 0x17, 6 }, { 0x18, 6 },
+    { 0x0, 5 }, { 0x1, 5 }, { 0x2, 5 }, { 0x19, 6 },
+    { 0x1a, 6 }, { 0x1b, 6 }, { 0x1c, 6 }, { 0x1d, 6 },
+    { 0x1e, 6 }, { 0x1f, 6 }, { 0x5c, 7 }, { 0xfb, 8 },
+    { 0x7ffc, 15 }, { 0x20, 6 }, { 0xffb, 12 }, { 0x3fc, 10 },
+    { 0x1ffa, 13 }, { 0x21, 6 }, { 0x5d, 7 }, { 0x5e, 7 },
+    { 0x5f, 7 }, { 0x60, 7 }, { 0x61, 7 }, { 0x62, 7 },
+    { 0x63, 7 }, { 0x64, 7 }, { 0x65, 7 }, { 0x66, 7 },
+    { 0x67, 7 }, { 0x68, 7 }, { 0x69, 7 }, { 0x6a, 7 },
+    { 0x6b, 7 }, { 0x6c, 7 }, { 0x6d, 7 }, { 0x6e, 7 },
+    { 0x6f, 7 }, { 0x70, 7 }, { 0x71, 7 }, { 0x72, 7 },
+    { 0xfc, 8 }, { 0x73, 7 }, { 0xfd, 8 }, { 0x1ffb, 13 },
+    { 0x7fff0, 19 }, { 0x1ffc, 13 }, { 0x3ffc, 14 }, { 0x22, 6 },
+    { 0x7ffd, 15 }, { 0x3, 5 }, { 0x23, 6 }, { 0x4, 5 },
+    { 0x24, 6 }, { 0x5, 5 }, { 0x25, 6 }, { 0x26, 6 },
+    { 0x27, 6 }, { 0x6, 5 }, { 0x74, 7 }, { 0x75, 7 },
+    { 0x28, 6 }, { 0x29, 6 }, { 0x2a, 6 }, { 0x7, 5 },
+    { 0x2b, 6 }, { 0x76, 7 }, { 0x2c, 6 }, { 0x8, 5 },
+    { 0x9, 5 }, { 0x2d, 6 }, { 0x77, 7 }, { 0x78, 7 },
+    { 0x79, 7 }, { 0x7a, 7 }, { 0x7b, 7 }, { 0x7ffe, 15 },
+    { 0x7fc, 11 }, { 0x3ffd, 14 }, { 0x1ffd, 13 }, { 0xffffffc, 28 },
+    { 0xfffe6, 20 }, { 0x3fffd2, 22 }, { 0xfffe7, 20 }, { 0xfffe8, 20 },
+    { 0x3fffd3, 22 }, { 0x3fffd4, 22 }, { 0x3fffd5, 22 }, { 0x7fffd9, 23 },
+    { 0x3fffd6, 22 }, { 0x7fffda, 23 }, { 0x7fffdb, 23 }, { 0x7fffdc, 23 },
+    { 0x7fffdd, 23 }, { 0x7fffde, 23 }, { 0xffffeb, 24 }, { 0x7fffdf, 23 },
+    { 0xffffec, 24 }, { 0xffffed, 24 }, { 0x3fffd7, 22 }, { 0x7fffe0, 23 },
+    { 0xffffee, 24 }, { 0x7fffe1, 23 }, { 0x7fffe2, 23 }, { 0x7fffe3, 23 },
+    { 0x7fffe4, 23 }, { 0x1fffdc, 21 }, { 0x3fffd8, 22 }, { 0x7fffe5, 23 },
+    { 0x3fffd9, 22 }, { 0x7fffe6, 23 }, { 0x7fffe7, 23 }, { 0xffffef, 24 },
+    { 0x3fffda, 22 }, { 0x1fffdd, 21 }, { 0xfffe9, 20 }, { 0x3fffdb, 22 },
+    { 0x3fffdc, 22 }, { 0x7fffe8, 23 }, { 0x7fffe9, 23 }, { 0x1fffde, 21 },
+    { 0x7fffea, 23 }, { 0x3fffdd, 22 }, { 0x3fffde, 22 }, { 0xfffff0, 24 },
+    { 0x1fffdf, 21 }, { 0x3fffdf, 22 }, { 0x7fffeb, 23 }, { 0x7fffec, 23 },
+    { 0x1fffe0, 21 }, { 0x1fffe1, 21 }, { 0x3fffe0, 22 }, { 0x1fffe2, 21 },
+    { 0x7fffed, 23 }, { 0x3fffe1, 22 }, { 0x7fffee, 23 }, { 0x7fffef, 23 },
+    { 0xfffea, 20 }, { 0x3fffe2, 22 }, { 0x3fffe3, 22 }, { 0x3fffe4, 22 },
+    { 0x7ffff0, 23 }, { 0x3fffe5, 22 }, { 0x3fffe6, 22 }, { 0x7ffff1, 23 },
+    { 0x3ffffe0, 26 }, { 0x3ffffe1, 26 }, { 0xfffeb, 20 }, { 0x7fff1, 19 },
+    { 0x3fffe7, 22 }, { 0x7ffff2, 23 }, { 0x3fffe8, 22 }, { 0x1ffffec, 25 },
+    { 0x3ffffe2, 26 }, { 0x3ffffe3, 26 }, { 0x3ffffe4, 26 }, { 0x7ffffde, 27 },
+    { 0x7ffffdf, 27 }, { 0x3ffffe5, 26 }, { 0xfffff1, 24 }, { 0x1ffffed, 25 },
+    { 0x7fff2, 19 }, { 0x1fffe3, 21 }, { 0x3ffffe6, 26 }, { 0x7ffffe0, 27 },
+    { 0x7ffffe1, 27 }, { 0x3ffffe7, 26 }, { 0x7ffffe2, 27 }, { 0xfffff2, 24 },
+    { 0x1fffe4, 21 }, { 0x1fffe5, 21 }, { 0x3ffffe8, 26 }, { 0x3ffffe9, 26 },
+    { 0xffffffd, 28 }, { 0x7ffffe3, 27 }, { 0x7ffffe4, 27 }, { 0x7ffffe5, 27 },
+    { 0xfffec, 20 }, { 0xfffff3, 24 }, { 0xfffed, 20 }, { 0x1fffe6, 21 },
+    { 0x3fffe9, 22 }, { 0x1fffe7, 21 }, { 0x1fffe8, 21 }, { 0x7ffff3, 23 },
+    { 0x3fffea, 22 }, { 0x3fffeb, 22 }, { 0x1ffffee, 25 }, { 0x1ffffef, 25 },
+    { 0xfffff4, 24 }, { 0xfffff5, 24 }, { 0x3ffffea, 26 }, { 0x7ffff4, 23 },
+    { 0x3ffffeb, 26 }, { 0x7ffffe6, 27 }, { 0x3ffffec, 26 }, { 0x3ffffed, 26 },
+    { 0x7ffffe7, 27 }, { 0x7ffffe8, 27 }, { 0x7ffffe9, 27 }, { 0x7ffffea, 27 },
+    { 0x7ffffeb, 27 }, { 0xffffffe, 28 }, { 0x7ffffec, 27 }, { 0x7ffffed, 27 },
+    { 0x7ffffee, 27 }, { 0x7ffffef, 27 }, { 0x7fffff0, 27 }, { 0x3ffffee, 26 },
+    { 0x3fffffff, 30 },
+};
+
+// 32 bytes of overhead per entry, RFC 7541 4.1
+static size_t entry_size(const std::string& name, const std::string& value)
+{
+    return name.size() + value.size() + 32;
+}
+
+HpackTable::HpackTable(size_t max_size)
+: size_(0), max_size_(max_size)
+{
+}
+
+void HpackTable::resize(size_t max_size)
+{
+    max_size_ = max_size;
+    evict(0);
+}
+
+void HpackTable::add(const std::string& name, const std::string& value)
+{
+    size_t n = entry_size(name, value);
+    evict(n);
+
+    //an entry larger than the table empties it and is not added
+    if(n > max_size_)
+        return;
+
+    entries_.push_front(std::make_pair(name, value));
+    size_ += n;
+}
+
+void HpackTable::evict(size_t needed)
+{
+    while(entries_.size() && size_ + needed > max_size_)
+    {
+        size_ -= entry_size(entries_.back().first, entries_.back().second);
+        entries_.pop_back();
+    }
+}
+
+// decoding walks a binary tree built once from the code table
+class HuffmanTree
+{
+public:
+    HuffmanTree()
+    {
+        nodes_.push_back(Node());
+        for(int sym = 0; sym < 257; ++sym)
+        {
+            int n = 0;
+            for(int b = kHuffmanCodes[sym].bits - 1; b >= 0; --b)
+            {
+                int bit = (kHuffmanCodes[sym].code >> b) & 1;
+                if(nodes_[n].next[bit] == 0)
+                {
+                    nodes_[n].next[bit] = static_cast<int>(nodes_.size());
+                    nodes_.push_back(Node());
+                }
+                n = nodes_[n].next[bit];
+            }
+            nodes_[n].symbol = sym;
+        }
+    }
+
+    bool decode(const unsigned char* p, size_t n, std::string& out)
+    {
+        int node = 0;
+        int depth = 0;      // bits since the last symbol
+        bool ones = true;   // those bits were all 1, a valid padding
+        for(size_t i = 0; i < n; ++i)
+        {
+            for(int b = 7; b >= 0; --b)
+            {
+                int bit = (p[i] >> b) & 1;
+                node = nodes_[node].next[bit];
+                if(node == 0)
+                    return false;
+
+                ++depth;
+                ones = ones && bit;
+                int sym = nodes_[node].symbol;
+                if(sym >= 0)
+                {
+                    if(sym == 256)
+                        return false;
+                    out.push_back(static_cast<char>(sym));
+                    node = 0;
+                    depth = 0;
+                    ones = true;
+                }
+            }
+        }
+
+        //the padding is a prefix of EOS shorter than a byte
+        return depth < 8 && ones;
+    }
+
+private:
+    struct Node
+    {
+        Node() : symbol(-1) { next[0] = next[1] = 0; }
+
+        int next[2];
+        int symbol;
+    };
+
+    std::vector<Node> nodes_;
+};
+
+static HuffmanTree& huffman_tree()
+{
+    static HuffmanTree tree;
+    return tree;
+}
+
+static bool decode_int(const unsigned char*& p, const unsigned char* end, int prefix, size_t& value)
+{
+    if(p >= end)
+        return false;
+
+    size_t max = (1u << prefix) - 1;
+    value = *p++ & max;
+    if(value < max)
+        return true;
+
+    int shift = 0;
+    while(p < end)
+    {
+        unsigned char c = *p++;
+        if(shift > 28)
+            return false;
+
+        value += static_cast<size_t>(c & 0x7F) << shift;
+        shift += 7;
+        if((c & 0x80) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static bool decode_string(const unsigned char*& p, const unsigned char* end, std::string& out)
+{
+    if(p >= end)
+        return false;
+
+    bool huffman = (*p & 0x80) != 0;
+    size_t len = 0;
+    if(!decode_int(p, end, 7, len) || len > static_cast<size_t>(end - p))
+        return false;
+
+    out.clear();
+    if(huffman)
+    {
+        if(!huffman_tree().decode(p, len, out))
+            return false;
+    }
+    else
+    {
+        out.assign(reinterpret_cast<const char*>(p), len);
+    }
+
+    p += len;
+    return true;
+}
+
+static void encode_int(std::string& out, unsigned char flags, int prefix, size_t value)
+{
+    size_t max = (1u << prefix) - 1;
+    if(value < max)
+    {
+        out.push_back(static_cast<char>(flags | value));
+        return;
+    }
+
+    out.push_back(static_cast<char>(flags | max));
+    value -= max;
+    while(value >= 128)
+    {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static void encode_string(std::string& out, const std::string& s)
+{
+    encode_int(out, 0, 7, s.size());
+    out.append(s);
+}
+
+HpackDecoder::HpackDecoder(size_t limit, size_t max_list)
+: table_(limit), limit_(limit), max_list_(max_list)
+{
+}
+
+bool HpackDecoder::lookup(size_t index, std::pair<std::string, std::string>& field)
+{
+    if(index == 0)
+        return false;
+
+    if(index <= kStaticEntries)
+    {
+        field.first = kStaticTable[index - 1].name;
+        field.second = kStaticTable[index - 1].value;
+        return true;
+    }
+
+    index -= kStaticEntries + 1;
+    if(index >= table_.entries())
+        return false;
+
+    field = table_.at(index);
+    return true;
+}
+
+bool HpackDecoder::decode(const char* data, size_t n, HeaderList& headers)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char* end = p + n;
+    bool fields = false;    // size updates are only allowed before the first field
+    size_t list = 0;        // name, value and 32 bytes for every field so far
+
+    while(p < end)
+    {
+        unsigned char c = *p;
+        std::pair<std::string, std::string> field;
+        size_t index = 0;
+
+        if(c & 0x80)
+        {
+            //indexed field
+            if(!decode_int(p, end, 7, index) || !lookup(index, field))
+                return false;
+            list += field.first.size() + field.second.size() + 32;
+            if(list > max_list_)
+                return false;
+            headers.push_back(field);
+            fields = true;
+            continue;
+        }
+
+        if((c & 0xE0) == 0x20)
+        {
+            //dynamic table size update
+            if(fields || !decode_int(p, end, 5, index) || index > limit_)
+                return false;
+            table_.resize(index);
+            continue;
+        }
+
+        //literal, with incremental indexing (01), without (0000) or never indexed (0001)
+        bool indexing = (c & 0xC0) == 0x40;
+        if(!decode_int(p, end, indexing ? 6 : 4, index))
+            return false;
+
+        if(index)
+        {
+            if(!lookup(index, field))
+                return false;
+        }
+        else if(!decode_string(p, end, field.first))
+        {
+            return false;
+        }
+
+        if(!decode_string(p, end, field.second))
+            return false;
+
+        if(indexing)
+            table_.add(field.first, field.second);
+
+        list += field.first.size() + field.second.size() + 32;
+        if(list > max_list_)
+            return false;
+        headers.push_back(field);
+        fields = true;
+    }
+
+    return true;
+}
+
+// static table positions by name, the entries of one name are adjacent
+static std::unordered_map<std::string, size_t> build_static_names()
+{
+    std::unordered_map<std::string, size_t> names;
+    for(size_t i = kStaticEntries; i > 0; --i)
+        names[kStaticTable[i - 1].name] = i;
+
+    return names;
+}
+
+static const std::unordered_map<std::string, size_t>& static_names()
+{
+    static std::unordered_map<std::string, size_t> names = build_static_names();
+    return names;
+}
+
+// values that change with every response only churn the table
+static bool cacheable(const std::string& name)
+{
+    static const char* kVolatile[] = { "content-length", "date", "etag", "last-modified",
+                                       "content-range", "set-cookie", "location", "age" };
+    for(size_t i = 0; i < sizeof(kVolatile) / sizeof(kVolatile[0]); ++i)
+    {
+        if(name == kVolatile[i])
+            return false;
+    }
+
+    return true;
+}
+
+HpackEncoder::HpackEncoder()
+: pending_size_(4096), pending_update_(false)
+{
+}
+
+void HpackEncoder::table_size(size_t n)
+{
+    //our table never grows past the default, a smaller one must be announced
+    n = std::min<size_t>(n, 4096);
+    if(n == table_.max_size())
+        return;
+
+    pending_size_ = pending_update_ ? std::min(pending_size_, n) : n;
+    pending_update_ = true;
+    table_.resize(n);
+}
+
+void HpackEncoder::encode(const HeaderList& headers, std::string& out)
+{
+    if(pending_update_)
+    {
+        if(pending_size_ != table_.max_size())
+            encode_int(out, 0x20, 5, pending_size_);
+        encode_int(out, 0x20, 5, table_.max_size());
+        pending_update_ = false;
+    }
+
+    const std::unordered_map<std::string, size_t>& names = static_names();
+    for(size_t i = 0; i < headers.size(); ++i)
+    {
+        const std::string& name = headers[i].first;
+        const std::string& value = headers[i].second;
+
+        size_t name_index = 0;
+        size_t full_index = 0;
+        auto it = names.find(name);
+        if(it != names.end())
+        {
+            name_index = it->second;
+            for(size_t k = name_index; k <= kStaticEntries && name == kStaticTable[k - 1].name; ++k)
+            {
+                if(value == kStaticTable[k - 1].value)
+                {
+                    full_index = k;
+                    break;
+                }
+            }
+        }
+
+        for(size_t k = 0; full_index == 0 && k < table_.entries(); ++k)
+        {
+            if(table_.at(k).first == name)
+            {
+                if(name_index == 0)
+                    name_index = kStaticEntries + 1 + k;
+                if(table_.at(k).second == value)
+                    full_index = kStaticEntries + 1 + k;
+            }
+        }
+
+        if(full_index)
+        {
+            encode_int(out, 0x80, 7, full_index);
+            continue;
+        }
+
+        bool indexing = cacheable(name);
+        if(indexing)
+            encode_int(out, 0x40, 6, name_index);
+        else
+            encode_int(out, 0x00, 4, name_index);
+
+        if(name_index == 0)
+            encode_string(out, name);
+        encode_string(out, value);
+
+        if(indexing)
+            table_.add(name, value);
+    }
+}
+
+}}
@@ -0,0 +1,81 @@
+#ifndef HPACK_H_
+#define HPACK_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <utility>
+
+namespace natsu {
+namespace http {
+
+typedef std::vector<std::pair<std::string, std::string>> HeaderList;
+
+// the dynamic part of the HPACK index, newest entry first
+class HpackTable
+{
+public:
+    HpackTable(size_t max_size = 4096);
+
+    void resize(size_t max_size);
+    void add(const std::string& name, const std::string& value);
+
+    size_t entries() const { return entries_.size(); }
+    size_t max_size() const { return max_size_; }
+    const std::pair<std::string, std::string>& at(size_t i) const { return entries_[i]; }
+
+private:
+    void evict(size_t needed);
+
+private:
+    std::deque<std::pair<std::string, std::string>> entries_;
+    size_t size_;
+    size_t max_size_;
+};
+
+class HpackDecoder
+{
+public:
+    // @param limit : SETTINGS_HEADER_TABLE_SIZE we announced
+    // @param max_list : SETTINGS_MAX_HEADER_LIST_SIZE we announced
+    HpackDecoder(size_t limit = 4096, size_t max_list = 64 * 1024);
+
+    /* *
+     * decode
+     * a block of one-byte references to a large table entry decodes to far
+     * more than it takes on the wire, so decoding stops once the fields add
+     * up to more than max_list, counted as RFC 7540 6.5.2 does.
+     * @return false on a compression error or a list too large, the connection
+     * can't go on after that
+    */
+    bool decode(const char* p, size_t n, HeaderList& headers);
+
+private:
+    bool lookup(size_t index, std::pair<std::string, std::string>& field);
+
+private:
+    HpackTable table_;
+    size_t limit_;
+    size_t max_list_;
+};
+
+class HpackEncoder
+{
+public:
+    HpackEncoder();
+
+    // the peer's SETTINGS_HEADER_TABLE_SIZE
+    void table_size(size_t n);
+
+    void encode(const HeaderList& headers, std::string& out);
+
+private:
+    HpackTable table_;
+    size_t pending_size_;   // smallest size since the last block, announced in the next one
+    bool pending_update_;
+};
+
+}}
+
+#endif
@@ -0,0 +1,993 @@
+#include "http2.h"
+#include "hpack.h"
+#include "natsu_log.h"
+#include "coroutine.h"
+#include <sys/socket.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+
+namespace natsu {
+namespace http {
+
+static const char kPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const size_t kPrefaceLen = sizeof(kPreface) - 1;
+static const size_t kFrameHead = 9;
+
+static const size_t kMaxFrame = 16384;              // SETTINGS_MAX_FRAME_SIZE we accept, the default
+static const uint32_t kMaxStreams = 128;
+static const int64_t kStreamWindow = 1 << 20;       // our SETTINGS_INITIAL_WINDOW_SIZE
+static const int64_t kConnWindow = 1 << 24;
+static const int64_t kDefaultWindow = 65535;
+static const int64_t kMaxWindow = 0x7FFFFFFF;
+//flow control invariant: the bodies of streams still being received hold at
+//most kMaxPending of the connection window and at most kConnWindow / 4 waits
+//unacknowledged in credit(), so with no handler running the peer always has
+//a quarter of the window left to finish a stream. a stream that would take the
+//pending bodies past kMaxPending is refused (REFUSED_STREAM, safe to retry),
+//the cost is that a client pushing several large uploads at once on one
+//connection gets some of them refused instead of stalled
+static const int64_t kMaxPending = kConnWindow / 2;
+static const size_t kMaxBody = kMaxPending;
+static const size_t kMaxHeaderBlock = 64 * 1024;
+static const size_t kMaxHeaderList = 64 * 1024;    // our SETTINGS_MAX_HEADER_LIST_SIZE, decoded
+static const size_t kRelayChunk = 16384;
+
+static const char* kMethodName[] = { "PUT", "GET", "POST", "DELETE" };
+
+enum FrameType
+{
+    FRAME_DATA = 0x0,
+    FRAME_HEADERS = 0x1,
+    FRAME_PRIORITY = 0x2,
+    FRAME_RST_STREAM = 0x3,
+    FRAME_SETTINGS = 0x4,
+    FRAME_PUSH_PROMISE = 0x5,
+    FRAME_PING = 0x6,
+    FRAME_GOAWAY = 0x7,
+    FRAME_WINDOW_UPDATE = 0x8,
+    FRAME_CONTINUATION = 0x9,
+};
+
+enum FrameFlag
+{
+    FLAG_ACK = 0x1,
+    FLAG_END_STREAM = 0x1,
+    FLAG_END_HEADERS = 0x4,
+    FLAG_PADDED = 0x8,
+    FLAG_PRIORITY = 0x20,
+};
+
+enum ErrorCode
+{
+    NO_ERROR = 0x0,
+    PROTOCOL_ERROR = 0x1,
+    FLOW_CONTROL_ERROR = 0x3,
+    STREAM_CLOSED = 0x5,
+    FRAME_SIZE_ERROR = 0x6,
+    REFUSED_STREAM = 0x7,
+    CANCEL = 0x8,
+    COMPRESSION_ERROR = 0x9,
+};
+
+enum SettingId
+{
+    SETTINGS_HEADER_TABLE_SIZE = 0x1,
+    SETTINGS_ENABLE_PUSH = 0x2,
+    SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+    SETTINGS_MAX_FRAME_SIZE = 0x5,
+    SETTINGS_MAX_HEADER_LIST_SIZE = 0x6,
+};
+
+int http2_preface(const char* p, size_t n)
+{
+    size_t len = std::min(n, kPrefaceLen);
+    if(memcmp(p, kPreface, len) != 0)
+        return -1;
+
+    return n >= kPrefaceLen ? 1 : 0;
+}
+
+static uint32_t read32(const char* p)
+{
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return (static_cast<uint32_t>(u[0]) << 24) | (u[1] << 16) | (u[2] << 8) | u[3];
+}
+
+static void put32(char* p, uint32_t v)
+{
+    p[0] = static_cast<char>(v >> 24);
+    p[1] = static_cast<char>(v >> 16);
+    p[2] = static_cast<char>(v >> 8);
+    p[3] = static_cast<char>(v);
+}
+
+// strips chunked framing in place, for streamed bodies relayed onto DATA frames
+class ChunkDecoder
+{
+public:
+    ChunkDecoder() : state_(SIZE), size_(0) {}
+
+    // @return body bytes now at the front of p, -1 on malformed input
+    ssize_t feed(char* p, size_t n)
+    {
+        size_t out = 0;
+        for(size_t i = 0; i < n; )
+        {
+            char c = p[i];
+            switch(state_)
+            {
+            case SIZE:
+                if(isxdigit(static_cast<unsigned char>(c)))
+                {
+                    if(size_ >> 56) return -1;
+                    size_ = size_ * 16 + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+                }
+                else if(c == '\n')
+                    state_ = size_ ? DATA : TRAILER;
+                else if(c == ';')
+                    state_ = EXTENSION;
+                else if(c != '\r' && c != ' ' && c != '\t')
+                    return -1;
+                ++i;
+                break;
+
+            case EXTENSION:
+                if(c == '\n') state_ = size_ ? DATA : TRAILER;
+                ++i;
+                break;
+
+            case DATA:
+            {
+                size_t take = std::min<size_t>(size_, n - i);
+                memmove(p + out, p + i, take);
+                out += take;
+                i += take;
+                size_ -= take;
+                if(size_ == 0) state_ = DATA_END;
+            }
+            break;
+
+            case DATA_END:
+                if(c == '\n') state_ = SIZE;
+                else if(c != '\r') return -1;
+                ++i;
+                break;
+
+            case TRAILER:
+                //trailers are dropped, HEADERS after DATA aren't sent
+                i = n;
+                break;
+            }
+        }
+
+        return out;
+    }
+
+private:
+    enum State { SIZE, EXTENSION, DATA, DATA_END, TRAILER };
+    State state_;
+    uint64_t size_;
+};
+
+struct Http2Stream
+{
+    Http2Stream(uint32_t i, int64_t window)
+    : id(i), send_window(window), recv_unacked(0), recv_held(0), started(false), reset(false), window_ready(1) {}
+
+    uint32_t id;
+    std::shared_ptr<HttpRequest> req;   // NULL for a method natsu doesn't route
+    int64_t send_window;                // guarded by the connection mutex
+    int64_t recv_unacked;               // reader only
+    int64_t recv_held;                  // body bytes not yet given back to the connection window
+    bool started;                       // reader only, the request is complete
+    std::atomic<bool> reset;
+    co_chan<void> window_ready;         // signalled on WINDOW_UPDATE, RST_STREAM and close
+};
+
+class Http2Connection : public std::enable_shared_from_this<Http2Connection>
+{
+public:
+    Http2Connection(int sockfd, const std::string& remote, Dispatcher dispatch)
+    : fd_(sockfd), remote_(remote), dispatch_(dispatch), closed_(false), going_away_(false),
+      last_stream_(0), header_stream_(0), header_end_stream_(false), decoder_(4096, kMaxHeaderList), pending_(0), conn_recv_unacked_(0),
+      conn_window_(kDefaultWindow), peer_initial_window_(kDefaultWindow), peer_max_frame_(kMaxFrame)
+    {
+    }
+
+    ~Http2Connection()
+    {
+        ::close(fd_);
+    }
+
+    // the reader, on the connection coroutine
+    void run(ReadBuffer& input)
+    {
+        input.consume(kPrefaceLen);
+
+        char settings[18];
+        settings[0] = 0;
+        settings[1] = SETTINGS_MAX_CONCURRENT_STREAMS;
+        put32(settings + 2, kMaxStreams);
+        settings[6] = 0;
+        settings[7] = SETTINGS_INITIAL_WINDOW_SIZE;
+        put32(settings + 8, kStreamWindow);
+        settings[12] = 0;
+        settings[13] = SETTINGS_MAX_HEADER_LIST_SIZE;
+        put32(settings + 14, kMaxHeaderList);
+        write_frame(FRAME_SETTINGS, 0, 0, settings, sizeof(settings));
+        window_update(0, kConnWindow - kDefaultWindow);
+
+        while(!closed_)
+        {
+            if(input.size() >= kFrameHead)
+            {
+                const unsigned char* h = reinterpret_cast<const unsigned char*>(input.data());
+                size_t len = (h[0] << 16) | (h[1] << 8) | h[2];
+                if(len > kMaxFrame)
+                {
+                    goaway(FRAME_SIZE_ERROR);
+                    break;
+                }
+
+                if(input.size() >= kFrameHead + len)
+                {
+                    uint32_t id = read32(input.data() + 5) & 0x7FFFFFFF;
+                    bool ok = frame(h[3], h[4], id, input.data() + kFrameHead, len);
+                    input.consume(kFrameHead + len);
+                    if(!ok)
+                        break;
+                    continue;
+                }
+
+                input.reserve(kFrameHead + len);
+            }
+
+            ssize_t n = input.read(fd_);
+            if(n == -1 && (errno == EINTR || errno == EAGAIN))
+                continue;
+            if(n <= 0)
+                break;
+        }
+
+        //the peer is gone, running streams fail their next write and the socket
+        //closes with the last of them
+        closed_ = true;
+        wake_all();
+    }
+
+private:
+    // @return false once the connection can't go on
+    bool frame(uint8_t type, uint8_t flags, uint32_t id, const char* p, size_t n)
+    {
+        //a header block is never interleaved with other frames
+        if(header_stream_ && (type != FRAME_CONTINUATION || id != header_stream_))
+            return goaway(PROTOCOL_ERROR);
+
+        switch(type)
+        {
+        case FRAME_DATA:
+            return on_data(flags, id, p, n);
+
+        case FRAME_HEADERS:
+            return on_headers(flags, id, p, n);
+
+        case FRAME_CONTINUATION:
+            if(header_stream_ == 0)
+                return goaway(PROTOCOL_ERROR);
+            if(header_block_.size() + n > kMaxHeaderBlock)
+                return goaway(PROTOCOL_ERROR);
+            header_block_.append(p, n);
+            return (flags & FLAG_END_HEADERS) ? headers_done() : true;
+
+        case FRAME_PRIORITY:
+            return n == 5 ? true : goaway(FRAME_SIZE_ERROR);
+
+        case FRAME_RST_STREAM:
+            if(id == 0)
+                return goaway(PROTOCOL_ERROR);
+            if(n != 4)
+                return goaway(FRAME_SIZE_ERROR);
+            discard(find(id));
+            close_stream(id);
+            return true;
+
+        case FRAME_SETTINGS:
+            return on_settings(flags, id, p, n);
+
+        case FRAME_PUSH_PROMISE:
+            return goaway(PROTOCOL_ERROR);
+
+        case FRAME_PING:
+            if(id != 0)
+                return goaway(PROTOCOL_ERROR);
+            if(n != 8)
+                return goaway(FRAME_SIZE_ERROR);
+            if(!(flags & FLAG_ACK))
+                write_frame(FRAME_PING, FLAG_ACK, 0, p, n);
+            return true;
+
+        case FRAME_GOAWAY:
+            //streams already open are still answered, new ones are ignored
+            going_away_ = true;
+            return true;
+
+        case FRAME_WINDOW_UPDATE:
+            return on_window_update(id, p, n);
+
+        default:
+            //unknown frame types are ignored
+            return true;
+        }
+    }
+
+    // padding is counted by flow control but carries nothing
+    bool strip_padding(uint8_t flags, const char*& p, size_t& n)
+    {
+        if(!(flags & FLAG_PADDED))
+            return true;
+
+        if(n < 1)
+            return false;
+
+        size_t pad = static_cast<unsigned char>(p[0]);
+        ++p;
+        --n;
+        if(pad > n)
+            return false;
+
+        n -= pad;
+        return true;
+    }
+
+    bool on_data(uint8_t flags, uint32_t id, const char* p, size_t n)
+    {
+        if(id == 0)
+            return goaway(PROTOCOL_ERROR);
+
+        int64_t flow = n;
+        if(!strip_padding(flags, p, n))
+            return goaway(PROTOCOL_ERROR);
+
+        std::shared_ptr<Http2Stream> s = find(id);
+        if(!s || s->started)
+        {
+            credit(flow);
+            rst(id, STREAM_CLOSED);
+            return true;
+        }
+
+        if(s->req && s->req->body().size() + n > kMaxBody)
+        {
+            credit(flow);
+            rst(id, CANCEL);
+            return true;
+        }
+
+        //the connection window comes back when the request is done with its body.
+        //padding and the bodies of unrouted methods are dropped here and now
+        int64_t held = s->req ? n : 0;
+        if(pending_ + held > kMaxPending)
+        {
+            credit(flow);
+            rst(id, REFUSED_STREAM);
+            return true;
+        }
+
+        credit(flow - held);
+        s->recv_held += held;
+        pending_ += held;
+        if(s->req)
+            s->req->body().append(p, n);
+
+        if(flags & FLAG_END_STREAM)
+        {
+            start(s);
+            return true;
+        }
+
+        s->recv_unacked += flow;
+        if(s->recv_unacked >= kStreamWindow / 2)
+        {
+            window_update(id, s->recv_unacked);
+            s->recv_unacked = 0;
+        }
+
+        return true;
+    }
+
+    bool on_headers(uint8_t flags, uint32_t id, const char* p, size_t n)
+    {
+        if(id == 0)
+            return goaway(PROTOCOL_ERROR);
+
+        if(!strip_padding(flags, p, n))
+            return goaway(PROTOCOL_ERROR);
+
+        if(flags & FLAG_PRIORITY)
+        {
+            if(n < 5)
+                return goaway(PROTOCOL_ERROR);
+            p += 5;
+            n -= 5;
+        }
+
+        header_stream_ = id;
+        header_end_stream_ = (flags & FLAG_END_STREAM) != 0;
+        header_block_.assign(p, n);
+        return (flags & FLAG_END_HEADERS) ? headers_done() : true;
+    }
+
+    bool headers_done()
+    {
+        uint32_t id = header_stream_;
+        header_stream_ = 0;
+
+        //every block is decoded, even of refused streams, or the tables drift apart
+        HeaderList fields;
+        bool ok = decoder_.decode(header_block_.data(), header_block_.size(), fields);
+        header_block_.clear();
+        if(!ok)
+            return goaway(COMPRESSION_ERROR);
+
+        std::shared_ptr<Http2Stream> s = find(id);
+        if(s)
+        {
+            //trailers, they end the request and are dropped
+            if(s->started)
+                rst(id, STREAM_CLOSED);
+            else if(!header_end_stream_)
+                rst(id, PROTOCOL_ERROR);
+            else
+                start(s);
+            return true;
+        }
+
+        if((id & 1) == 0 || id <= last_stream_)
+            return goaway(PROTOCOL_ERROR);
+
+        last_stream_ = id;
+        if(going_away_)
+            return true;
+
+        if(active() >= kMaxStreams)
+        {
+            rst(id, REFUSED_STREAM);
+            return true;
+        }
+
+        std::string method;
+        std::string path;
+        std::map<std::string, std::string> headers;
+        for(size_t i = 0; i < fields.size(); ++i)
+        {
+            const std::string& name = fields[i].first;
+            const std::string& value = fields[i].second;
+            if(name.size() && name[0] == ':')
+            {
+                if(name == ":method") method = value;
+                else if(name == ":path") path = value;
+                else if(name == ":authority") headers["host"] = value;
+                continue;
+            }
+
+            std::string& v = headers[name];
+            if(v.size())
+                v.append(name == "cookie" ? "; " : ", ");
+            v.append(value);
+        }
+
+        if(method.empty() || path.empty())
+        {
+            rst(id, PROTOCOL_ERROR);
+            return true;
+        }
+
+        s = std::make_shared<Http2Stream>(id, peer_window());
+        for(int m = 0; m < static_cast<int>(sizeof(kMethodName) / sizeof(kMethodName[0])); ++m)
+        {
+            if(method == kMethodName[m])
+            {
+                s->req = std::make_shared<HttpRequest>(path);
+                s->req->method() = static_cast<Method>(m);
+                s->req->remote() = remote_;
+                for(auto it = headers.begin(); it != headers.end(); ++it)
+                    s->req->header(it->first, it->second);
+                break;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            streams_[id] = s;
+        }
+
+        if(header_end_stream_)
+            start(s);
+        return true;
+    }
+
+    bool on_settings(uint8_t flags, uint32_t id, const char* p, size_t n)
+    {
+        if(id != 0)
+            return goaway(PROTOCOL_ERROR);
+
+        if(flags & FLAG_ACK)
+            return n == 0 ? true : goaway(FRAME_SIZE_ERROR);
+
+        if(n % 6)
+            return goaway(FRAME_SIZE_ERROR);
+
+        for(size_t i = 0; i < n; i += 6)
+        {
+            int setting = (static_cast<unsigned char>(p[i]) << 8) | static_cast<unsigned char>(p[i + 1]);
+            uint32_t value = read32(p + i + 2);
+            switch(setting)
+            {
+            case SETTINGS_HEADER_TABLE_SIZE:
+            {
+                std::lock_guard<co_mutex> lock(write_lock_);
+                encoder_.table_size(value);
+            }
+            break;
+
+            case SETTINGS_ENABLE_PUSH:
+                if(value > 1)
+                    return goaway(PROTOCOL_ERROR);
+                break;
+
+            case SETTINGS_INITIAL_WINDOW_SIZE:
+            {
+                if(value > kMaxWindow)
+                    return goaway(FLOW_CONTROL_ERROR);
+
+                //the change applies to every open stream as well
+                std::lock_guard<std::mutex> lock(mutex_);
+                int64_t delta = static_cast<int64_t>(value) - peer_initial_window_;
+                peer_initial_window_ = value;
+                for(auto it = streams_.begin(); it != streams_.end(); ++it)
+                {
+                    it->second->send_window += delta;
+                    it->second->window_ready.TryPush(nullptr);
+                }
+            }
+            break;
+
+            case SETTINGS_MAX_FRAME_SIZE:
+                if(value < kMaxFrame || value > 0xFFFFFF)
+                    return goaway(PROTOCOL_ERROR);
+                peer_max_frame_ = value;
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        write_frame(FRAME_SETTINGS, FLAG_ACK, 0, NULL, 0);
+        return true;
+    }
+
+    bool on_window_update(uint32_t id, const char* p, size_t n)
+    {
+        if(n != 4)
+            return goaway(FRAME_SIZE_ERROR);
+
+        int64_t increment = read32(p) & 0x7FFFFFFF;
+        if(increment == 0)
+        {
+            if(id == 0)
+                return goaway(PROTOCOL_ERROR);
+            rst(id, PROTOCOL_ERROR);
+            return true;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if(id == 0)
+        {
+            conn_window_ += increment;
+            if(conn_window_ > kMaxWindow)
+            {
+                lock.unlock();
+                return goaway(FLOW_CONTROL_ERROR);
+            }
+
+            for(auto it = streams_.begin(); it != streams_.end(); ++it)
+                it->second->window_ready.TryPush(nullptr);
+            return true;
+        }
+
+        auto it = streams_.find(id);
+        if(it == streams_.end())
+            return true;
+
+        std::shared_ptr<Http2Stream> s = it->second;
+        s->send_window += increment;
+        if(s->send_window > kMaxWindow)
+        {
+            lock.unlock();
+            rst(id, FLOW_CONTROL_ERROR);
+            return true;
+        }
+
+        s->window_ready.TryPush(nullptr);
+        return true;
+    }
+
+    void start(std::shared_ptr<Http2Stream>& s)
+    {
+        s->started = true;
+        pending_ -= s->recv_held;
+        std::shared_ptr<Http2Connection> self = shared_from_this();
+        go [self, s]
+        {
+            self->process(s);
+        };
+    }
+
+    // a stream coroutine, one request and its response
+    void process(std::shared_ptr<Http2Stream> s)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<HttpResponse> resp = std::make_shared<HttpResponse>();
+        if(s->req)
+            dispatch_(s->req, resp);
+        else
+            resp->response(501);
+
+        size_t bytes = respond(s, resp);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            streams_.erase(s->id);
+        }
+
+        if(s->req)
+            std::string().swap(s->req->body());
+        credit(s->recv_held);
+
+        if(s->req && natsu::log_enabled(natsu::LOG_ACCESS))
+        {
+            long long us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            NATSU_LOG_ACCESS("%s %s %d %zu %lldus h2", kMethodName[s->req->method()],
+                s->req->path().c_str(), resp->code(), bytes, us);
+        }
+    }
+
+    // @return body bytes sent
+    size_t respond(std::shared_ptr<Http2Stream>& s, std::shared_ptr<HttpResponse>& resp)
+    {
+        int code = resp->code();
+        bool body_allowed = code >= 200 && code != 204 && code != 304;
+        bool streaming = resp->streaming();
+
+        //HTTP/1.1 framing is replaced by frames, names are lower case in HTTP/2
+        bool chunked = false;
+        const std::map<std::string, std::string>& fields = resp->headers();
+        for(auto it = fields.begin(); it != fields.end(); ++it)
+        {
+            if(strcasecmp(it->first.c_str(), "transfer-encoding") == 0)
+                chunked = true;
+        }
+
+        HeaderList headers;
+        headers.push_back(std::make_pair(std::string(":status"), std::to_string(code)));
+        for(auto it = fields.begin(); it != fields.end(); ++it)
+        {
+            std::string name = it->first;
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            if(name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+               name == "transfer-encoding" || name == "upgrade")
+                continue;
+            if(name == "content-length" && (!streaming || chunked))
+                continue;
+            headers.push_back(std::make_pair(name, it->second));
+        }
+
+        if(!streaming)
+        {
+            const std::string& body = resp->body();
+            if(body_allowed)
+                headers.push_back(std::make_pair(std::string("content-length"), std::to_string(body.size())));
+
+            bool end = body.empty() || !body_allowed;
+            if(!send_headers(s, headers, end) || end)
+                return 0;
+
+            return send_data(s, body.data(), body.size(), true) ? body.size() : 0;
+        }
+
+        if(!send_headers(s, headers, false))
+            return 0;
+        return relay(s, resp->writer(), chunked);
+    }
+
+    // a streamed body is produced on one end of a socket pair and framed from the other
+    size_t relay(std::shared_ptr<Http2Stream>& s, HttpResponse::StreamWriter writer, bool chunked)
+    {
+        int sv[2];
+        if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1)
+        {
+            NATSU_LOG_ERROR("h2: socketpair error: %s", strerror(errno));
+            rst(s->id, CANCEL);
+            return 0;
+        }
+
+        int producer = sv[0];
+        go [writer, producer]
+        {
+            writer(producer);
+            ::close(producer);
+        };
+
+        ChunkDecoder dechunk;
+        char buf[kRelayChunk];
+        size_t bytes = 0;
+        while(true)
+        {
+            ssize_t n = read(sv[1], buf, sizeof(buf));
+            if(n == -1 && errno == EINTR)
+                continue;
+            if(n <= 0)
+                break;
+
+            if(chunked && (n = dechunk.feed(buf, n)) < 0)
+                break;
+
+            if(n && !send_data(s, buf, n, false))
+                break;
+            bytes += n;
+        }
+
+        //closing our end stops a producer still writing for a reset stream
+        ::close(sv[1]);
+        send_data(s, NULL, 0, true);
+        return bytes;
+    }
+
+    bool send_headers(std::shared_ptr<Http2Stream>& s, const HeaderList& headers, bool end)
+    {
+        std::string block;
+        std::lock_guard<co_mutex> lock(write_lock_);
+        if(s->reset || closed_write_)
+            return false;
+
+        //encoding and sending happen in one go, the peer decodes in frame order
+        encoder_.encode(headers, block);
+        size_t pos = std::min(block.size(), peer_max_frame_);
+        uint8_t flags = (end ? FLAG_END_STREAM : 0) | (pos == block.size() ? FLAG_END_HEADERS : 0);
+        if(!write_frame_locked(FRAME_HEADERS, flags, s->id, block.data(), pos))
+            return false;
+
+        while(pos < block.size())
+        {
+            size_t len = std::min(block.size() - pos, peer_max_frame_);
+            flags = pos + len == block.size() ? FLAG_END_HEADERS : 0;
+            if(!write_frame_locked(FRAME_CONTINUATION, flags, s->id, block.data() + pos, len))
+                return false;
+            pos += len;
+        }
+
+        return true;
+    }
+
+    // parks the stream coroutine while the peer's windows are exhausted
+    bool send_data(std::shared_ptr<Http2Stream>& s, const char* p, size_t n, bool end)
+    {
+        do
+        {
+            size_t take = 0;
+            while(true)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if(s->reset || closed_)
+                        return false;
+
+                    int64_t allowed = std::min(std::min(conn_window_, s->send_window),
+                                               static_cast<int64_t>(peer_max_frame_));
+                    if(n == 0 || allowed > 0)
+                    {
+                        take = std::min<size_t>(n, std::max<int64_t>(allowed, 0));
+                        conn_window_ -= take;
+                        s->send_window -= take;
+                        break;
+                    }
+                }
+
+                s->window_ready >> nullptr;
+            }
+
+            bool last = end && take == n;
+            {
+                std::lock_guard<co_mutex> lock(write_lock_);
+                if(!write_frame_locked(FRAME_DATA, last ? FLAG_END_STREAM : 0, s->id, p, take))
+                    return false;
+            }
+
+            p += take;
+            n -= take;
+        } while(n);
+
+        return true;
+    }
+
+    bool write_frame(uint8_t type, uint8_t flags, uint32_t id, const char* p, size_t n)
+    {
+        std::lock_guard<co_mutex> lock(write_lock_);
+        return write_frame_locked(type, flags, id, p, n);
+    }
+
+    bool write_frame_locked(uint8_t type, uint8_t flags, uint32_t id, const char* p, size_t n)
+    {
+        if(closed_write_)
+            return false;
+
+        char head[kFrameHead];
+        head[0] = static_cast<char>(n >> 16);
+        head[1] = static_cast<char>(n >> 8);
+        head[2] = static_cast<char>(n);
+        head[3] = static_cast<char>(type);
+        head[4] = static_cast<char>(flags);
+        put32(head + 5, id);
+
+        iovec iov[2];
+        iov[0].iov_base = head;
+        iov[0].iov_len = sizeof(head);
+        iov[1].iov_base = const_cast<char*>(p);
+        iov[1].iov_len = n;
+        if(!writev_all(fd_, iov, n ? 2 : 1))
+        {
+            closed_write_ = true;
+            closed_ = true;
+            return false;
+        }
+
+        return true;
+    }
+
+    void window_update(uint32_t id, int64_t increment)
+    {
+        char p[4];
+        put32(p, static_cast<uint32_t>(increment));
+        write_frame(FRAME_WINDOW_UPDATE, 0, id, p, sizeof(p));
+    }
+
+    // body bytes left the buffers, the peer may send that much more
+    void credit(int64_t flow)
+    {
+        if(flow <= 0)
+            return;
+
+        if(conn_recv_unacked_.fetch_add(flow) + flow >= kConnWindow / 4)
+        {
+            int64_t n = conn_recv_unacked_.exchange(0);
+            if(n > 0)
+                window_update(0, n);
+        }
+    }
+
+    // a stream closed before it started hands back the body it held, only the
+    // reader touches a stream that hasn't started
+    void discard(std::shared_ptr<Http2Stream> s)
+    {
+        if(!s || s->started)
+            return;
+
+        credit(s->recv_held);
+        pending_ -= s->recv_held;
+        s->recv_held = 0;
+        if(s->req)
+            std::string().swap(s->req->body());
+    }
+
+    void rst(uint32_t id, uint32_t code)
+    {
+        char p[4];
+        put32(p, code);
+        write_frame(FRAME_RST_STREAM, 0, id, p, sizeof(p));
+        discard(find(id));
+        close_stream(id);
+    }
+
+    void close_stream(uint32_t id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = streams_.find(id);
+        if(it == streams_.end())
+            return;
+
+        it->second->reset = true;
+        it->second->window_ready.TryPush(nullptr);
+        streams_.erase(it);
+    }
+
+    // @return false, the connection ends
+    bool goaway(uint32_t code)
+    {
+        char p[8];
+        put32(p, last_stream_);
+        put32(p + 4, code);
+        write_frame(FRAME_GOAWAY, 0, 0, p, sizeof(p));
+        going_away_ = true;
+
+        //a broken peer gets nothing more, running streams fail their next write
+        shutdown(fd_, SHUT_RDWR);
+        closed_ = true;
+        wake_all();
+        return false;
+    }
+
+    void wake_all()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(auto it = streams_.begin(); it != streams_.end(); ++it)
+            it->second->window_ready.TryPush(nullptr);
+    }
+
+    std::shared_ptr<Http2Stream> find(uint32_t id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = streams_.find(id);
+        return it == streams_.end() ? std::shared_ptr<Http2Stream>() : it->second;
+    }
+
+    size_t active()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return streams_.size();
+    }
+
+    int64_t peer_window()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return peer_initial_window_;
+    }
+
+private:
+    int fd_;
+    std::string remote_;
+    Dispatcher dispatch_;
+    std::atomic<bool> closed_;
+    std::atomic<bool> closed_write_{false};
+    bool going_away_;
+
+    // reader only
+    uint32_t last_stream_;
+    uint32_t header_stream_;        // stream of a header block waiting for CONTINUATION
+    bool header_end_stream_;
+    std::string header_block_;
+    HpackDecoder decoder_;
+    int64_t pending_;                   // recv_held of the streams not started yet
+
+    // reader and stream coroutines
+    std::atomic<int64_t> conn_recv_unacked_;
+
+    // guarded by mutex_
+    std::mutex mutex_;
+    std::unordered_map<uint32_t, std::shared_ptr<Http2Stream>> streams_;
+    int64_t conn_window_;
+    int64_t peer_initial_window_;
+    size_t peer_max_frame_;
+
+    // guarded by write_lock_, frames go out whole and header blocks in encoding order
+    co_mutex write_lock_;
+    HpackEncoder encoder_;
+};
+
+void serve_http2(int sockfd, const std::string& remote, ReadBuffer& input, Dispatcher dispatch)
+{
+    std::shared_ptr<Http2Connection> conn = std::make_shared<Http2Connection>(sockfd, remote, dispatch);
+    conn->run(input);
+}
+
+}}
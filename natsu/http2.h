@@ -0,0 +1,33 @@
+#ifndef HTTP2_H_
+#define HTTP2_H_
+
+#include <string>
+#include <memory>
+#include <functional>
+#include "http_request.h"
+#include "http_response.h"
+#include "natsu_buffer.h"
+
+namespace natsu {
+namespace http {
+
+// runs injects and routes for one request
+typedef std::function<void(std::shared_ptr<HttpRequest>&, std::shared_ptr<HttpResponse>&)> Dispatcher;
+
+/* *
+ * http2_preface
+ * @return 1 when p starts with the HTTP/2 connection preface, 0 while too
+ * few bytes arrived to tell, -1 for anything else
+*/
+int http2_preface(const char* p, size_t n);
+
+/* *
+ * serve_http2
+ * serve a prior knowledge h2c connection until it ends. every stream
+ * runs on a coroutine of its own, input holds what was read so far.
+*/
+void serve_http2(int sockfd, const std::string& remote, ReadBuffer& input, Dispatcher dispatch);
+
+}}
+
+#endif
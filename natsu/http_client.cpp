@@ -0,0 +1,261 @@
+#include "http_client.h"
+#include "http_parser.h"
+#include "http_connection_pool.h"
+#include "natsu_buffer.h"
+#include <errno.h>
+#include <unistd.h>
+
+namespace natsu {
+namespace http {
+
+static const char* kClientMethod[] = { "PUT", "GET", "POST", "DELETE" };
+
+std::string HttpClientResponse::header(const std::string& k)
+{
+    auto it = header_.find(k);
+    if(it != header_.end())
+    {
+        return it->second;
+    }
+
+    return "";
+}
+
+void HttpClientResponse::header(const std::string& k, const std::string& v)
+{
+    header_[k] = v;
+}
+
+// http://host[:port][/target]
+static bool parse_url(const std::string& url, std::string& host, unsigned short& port, std::string& target)
+{
+    static const std::string kScheme = "http://";
+    if(url.compare(0, kScheme.size(), kScheme) != 0)
+        return false;
+
+    size_t begin = kScheme.size();
+    size_t slash = url.find('/', begin);
+    std::string authority = url.substr(begin, slash == std::string::npos ? std::string::npos : slash - begin);
+    target = slash == std::string::npos ? "/" : url.substr(slash);
+
+    port = 80;
+    size_t colon = authority.rfind(':');
+    size_t bracket = authority.rfind(']');
+    if(colon != std::string::npos && (bracket == std::string::npos || colon > bracket))
+    {
+        port = static_cast<unsigned short>(atoi(authority.c_str() + colon + 1));
+        authority.erase(colon);
+    }
+
+    if(authority.size() > 2 && authority[0] == '[' && authority[authority.size() - 1] == ']')
+        authority = authority.substr(1, authority.size() - 2);
+
+    host = authority;
+    return !host.empty() && port != 0;
+}
+
+static void build_request(const HttpClientRequest& req, const std::string& host, unsigned short port,
+                          const std::string& target, std::string& out)
+{
+    out.append(kClientMethod[req.method]);
+    out.append(" ");
+    out.append(target);
+    out.append(" HTTP/1.1\r\nHost: ");
+    out.append(host);
+    if(port != 80)
+    {
+        out.append(":");
+        out.append(std::to_string(port));
+    }
+    out.append("\r\n");
+
+    for(auto it = req.headers.begin(); it != req.headers.end(); ++it)
+    {
+        out.append(it->first);
+        out.append(": ");
+        out.append(it->second);
+        out.append("\r\n");
+    }
+
+    if(req.body.size() || req.method == POST || req.method == PUT)
+    {
+        out.append("Content-Length: ");
+        out.append(std::to_string(req.body.size()));
+        out.append("\r\n");
+    }
+
+    out.append("\r\n");
+    out.append(req.body);
+}
+
+// interim 1xx heads (100 Continue, 103 Early Hints) are dropped, the caller gets the final one
+static tribool skip_interim(HttpParser& parser, tribool ret)
+{
+    while(ret == success && parser.response()->code() < 200)
+        ret = parser.parse();
+    return ret;
+}
+
+// parse one response, bytes left from a previous pipelined response come first
+// @param received : set when any byte of this response arrived
+static tribool read_response(int fd, HttpParser& parser, bool& received)
+{
+    received = !parser.cache().empty();
+    tribool ret = skip_interim(parser, parser.parse());
+    if(ret != indeterminate)
+        return ret;
+
+    char buf[4096];
+    while(true)
+    {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if(n == -1)
+        {
+            if(EINTR == errno)
+                continue;
+
+            //EAGAIN here means SO_RCVTIMEO expired
+            return failure;
+        }
+        else if(n == 0)
+        {
+            return parser.finish();
+        }
+
+        received = true;
+        ret = skip_interim(parser, parser.parse(buf, n));
+        if(ret != indeterminate)
+            return ret;
+    }
+}
+
+HttpClient& HttpClient::instance()
+{
+    static HttpClient instance;
+    return instance;
+}
+
+void HttpClient::options(const HttpClientOptions& opts)
+{
+    options_ = opts;
+    HttpConnectionPool::instance().options(opts);
+}
+
+HttpClientOptions& HttpClient::options()
+{
+    return options_;
+}
+
+std::shared_ptr<HttpClientResponse> HttpClient::request(const HttpClientRequest& req, NatsuError& err)
+{
+    std::vector<HttpClientRequest> reqs(1, req);
+    std::vector<std::shared_ptr<HttpClientResponse>> rsps = pipeline(reqs, err);
+    return rsps.empty() ? std::shared_ptr<HttpClientResponse>() : rsps[0];
+}
+
+std::shared_ptr<HttpClientResponse> HttpClient::get(const std::string& url, NatsuError& err)
+{
+    return request(HttpClientRequest(GET, url), err);
+}
+
+std::shared_ptr<HttpClientResponse> HttpClient::post(const std::string& url, const std::string& body,
+                                                     const std::string& content_type, NatsuError& err)
+{
+    HttpClientRequest req(POST, url, body);
+    if(content_type.size()) req.headers["Content-Type"] = content_type;
+    return request(req, err);
+}
+
+std::shared_ptr<HttpClientResponse> HttpClient::put(const std::string& url, const std::string& body,
+                                                    const std::string& content_type, NatsuError& err)
+{
+    HttpClientRequest req(PUT, url, body);
+    if(content_type.size()) req.headers["Content-Type"] = content_type;
+    return request(req, err);
+}
+
+std::vector<std::shared_ptr<HttpClientResponse>> HttpClient::pipeline(const std::vector<HttpClientRequest>& reqs,
+                                                                      NatsuError& err)
+{
+    std::vector<std::shared_ptr<HttpClientResponse>> rsps;
+    if(reqs.empty()) return rsps;
+
+    std::string host, target, wire;
+    unsigned short port = 0;
+    bool idempotent = true;
+    for(size_t i = 0; i < reqs.size(); ++i)
+    {
+        if(reqs[i].method == POST)
+            idempotent = false;
+
+        std::string h;
+        unsigned short p = 0;
+        if(!parse_url(reqs[i].url, h, p, target))
+        {
+            err = NatsuError(-1, "invalid url " + reqs[i].url);
+            return rsps;
+        }
+
+        if(i && (h != host || p != port))
+        {
+            err = NatsuError(-1, "pipelined requests must share one host");
+            return rsps;
+        }
+
+        host = h;
+        port = p;
+        build_request(reqs[i], host, port, target, wire);
+    }
+
+    HttpConnectionPool& pool = HttpConnectionPool::instance();
+    //a pooled socket may have been closed by peer just now, retry once on a fresh one.
+    //the peer may have acted on part of the batch already, so only when all of it can be sent twice
+    for(int attempt = 0; attempt < 2; ++attempt)
+    {
+        bool reused = false;
+        int fd = pool.acquire(host, port, reused, err);
+        if(fd == -1)
+            return rsps;
+
+        iovec iov;
+        iov.iov_base = const_cast<char*>(wire.data());
+        iov.iov_len = wire.size();
+        if(!writev_all(fd, &iov, 1))
+        {
+            pool.release(host, port, fd, false);
+            if(reused && idempotent) continue;
+            err = NatsuError(errno, "write to " + host + " failed");
+            return rsps;
+        }
+
+        HttpParser parser(true);
+        bool keep_alive = true;
+        for(size_t i = 0; i < reqs.size(); ++i)
+        {
+            bool received = false;
+            if(success != read_response(fd, parser, received))
+            {
+                pool.release(host, port, fd, false);
+                if(reused && idempotent && rsps.empty() && !received) break;
+                err = NatsuError(-1, "read response from " + host + " failed");
+                rsps.clear();
+                return rsps;
+            }
+
+            rsps.push_back(parser.response());
+            keep_alive = parser.keep_alive();
+        }
+
+        if(rsps.size() != reqs.size())
+            continue;
+
+        pool.release(host, port, fd, keep_alive && parser.cache().empty());
+        err.clear();
+        return rsps;
+    }
+
+    err = NatsuError(-1, "connection to " + host + " lost");
+    return rsps;
+}
+
+}}
@@ -0,0 +1,223 @@
+#include "http_connection_pool.h"
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <mutex>
+#include <thread>
+#include "coroutine.h"
+#include "linux_glibc_hook.h"
+
+namespace natsu {
+namespace http {
+
+static const int kResolveTtl = 60;
+
+// getaddrinfo is not hooked and would block the whole scheduler thread, so the
+// lookup runs on a thread of its own and the coroutine waits on a channel
+static int blocking_getaddrinfo(const std::string& host, unsigned short port, sockaddr_storage& addr, socklen_t& len)
+{
+    struct Lookup
+    {
+        Lookup() : done(1), ret(0), len(0) {}
+        co_chan<void> done;
+        int ret;
+        sockaddr_storage addr;
+        socklen_t len;
+    };
+
+    std::shared_ptr<Lookup> lookup = std::make_shared<Lookup>();
+    std::string service = std::to_string(port);
+    std::thread([lookup, host, service]
+    {
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* result = NULL;
+        lookup->ret = getaddrinfo(host.c_str(), service.c_str(), &hints, &result);
+        if(lookup->ret == 0 && result == NULL)
+            lookup->ret = EAI_NONAME;
+
+        if(lookup->ret == 0)
+        {
+            memcpy(&lookup->addr, result->ai_addr, result->ai_addrlen);
+            lookup->len = result->ai_addrlen;
+        }
+
+        if(result)
+            freeaddrinfo(result);
+
+        lookup->done << nullptr;
+    }).detach();
+
+    lookup->done >> nullptr;
+    if(lookup->ret == 0)
+    {
+        memcpy(&addr, &lookup->addr, lookup->len);
+        len = lookup->len;
+    }
+
+    return lookup->ret;
+}
+
+void HttpConnectionPool::options(const HttpClientOptions& opts)
+{
+    std::unique_lock<co::LFLock> lock(lock_);
+    options_ = opts;
+}
+
+std::string HttpConnectionPool::key(const std::string& host, unsigned short port)
+{
+    return host + ":" + std::to_string(port);
+}
+
+int HttpConnectionPool::acquire(const std::string& host, unsigned short port, bool& reused, NatsuError& err)
+{
+    std::string k = key(host, port);
+    int fd = pop_idle(k);
+    if(fd != -1)
+    {
+        reused = true;
+        return fd;
+    }
+
+    reused = false;
+    Address addr;
+    if(!resolve(host, port, addr, err))
+        return -1;
+
+    return connect_to(addr, err);
+}
+
+void HttpConnectionPool::release(const std::string& host, unsigned short port, int fd, bool reusable)
+{
+    if(reusable)
+    {
+        IdleConnection conn;
+        conn.fd = fd;
+        conn.since = time(NULL);
+
+        std::unique_lock<co::LFLock> lock(lock_);
+        std::list<IdleConnection>& idle = idle_[key(host, port)];
+        if(idle.size() < options_.max_idle)
+        {
+            idle.push_back(conn);
+            return;
+        }
+    }
+
+    close(fd);
+}
+
+int HttpConnectionPool::pop_idle(const std::string& k)
+{
+    time_t now = time(NULL);
+    while(true)
+    {
+        IdleConnection conn;
+        {
+            std::unique_lock<co::LFLock> lock(lock_);
+            auto it = idle_.find(k);
+            if(it == idle_.end() || it->second.empty())
+                return -1;
+
+            //most recently used first, it is the least likely to be timed out by peer
+            conn = it->second.back();
+            it->second.pop_back();
+        }
+
+        //an idle keep-alive socket must not be readable, else peer closed it
+        pollfd pfd;
+        pfd.fd = conn.fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if(now - conn.since < options_.idle_timeout && poll(&pfd, 1, 0) == 0)
+            return conn.fd;
+
+        close(conn.fd);
+    }
+}
+
+bool HttpConnectionPool::resolve(const std::string& host, unsigned short port, Address& addr, NatsuError& err)
+{
+    std::string k = key(host, port);
+    time_t now = time(NULL);
+    {
+        std::unique_lock<co::LFLock> lock(lock_);
+        auto it = address_.find(k);
+        if(it != address_.end() && now - it->second.resolved < kResolveTtl)
+        {
+            addr = it->second;
+            return true;
+        }
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    sockaddr_in* v4 = reinterpret_cast<sockaddr_in*>(&addr.addr);
+    sockaddr_in6* v6 = reinterpret_cast<sockaddr_in6*>(&addr.addr);
+    if(inet_pton(AF_INET, host.c_str(), &v4->sin_addr) == 1)
+    {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(port);
+        addr.len = sizeof(sockaddr_in);
+    }
+    else if(inet_pton(AF_INET6, host.c_str(), &v6->sin6_addr) == 1)
+    {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(port);
+        addr.len = sizeof(sockaddr_in6);
+    }
+    else
+    {
+        //results are cached, a name costs a thread once per kResolveTtl
+        int ret = blocking_getaddrinfo(host, port, addr.addr, addr.len);
+        if(ret != 0)
+        {
+            err = NatsuError(-1, "resolve " + host + " failed: " + gai_strerror(ret));
+            return false;
+        }
+    }
+
+    addr.resolved = now;
+    std::unique_lock<co::LFLock> lock(lock_);
+    address_[k] = addr;
+    return true;
+}
+
+int HttpConnectionPool::connect_to(const Address& addr, NatsuError& err)
+{
+    int fd = socket(addr.addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd == -1)
+    {
+        err = NatsuError(errno, std::string("socket: ") + strerror(errno));
+        return -1;
+    }
+
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    timeval tv;
+    tv.tv_sec = options_.timeout / 1000;
+    tv.tv_usec = (options_.timeout % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    co::set_connect_timeout(options_.connect_timeout);
+    int ret = connect(fd, reinterpret_cast<const sockaddr*>(&addr.addr), addr.len);
+    co::set_connect_timeout(-1);
+    if(ret == -1)
+    {
+        err = NatsuError(errno, std::string("connect: ") + strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+}}
@@ -0,0 +1,66 @@
+#ifndef HTTP_CONNECTION_POOL_H_
+#define HTTP_CONNECTION_POOL_H_
+
+#include <sys/socket.h>
+#include <time.h>
+#include <string>
+#include <map>
+#include <list>
+
+#include "spinlock.h"
+#include "singleton.h"
+#include "http_client.h"
+#include "natsu_error.h"
+
+namespace natsu {
+namespace http {
+
+/* *
+ * HttpConnectionPool
+ * keep-alive sockets per host:port, shared by HttpClient and the proxy.
+ * sockets are blocking from the caller's view, libgo hooks turn waits into
+ * coroutine switches and honour the SO_RCVTIMEO/SO_SNDTIMEO set here.
+*/
+class HttpConnectionPool : public singleton<HttpConnectionPool>
+{
+public:
+    void options(const HttpClientOptions& opts);
+    HttpClientOptions& options() { return options_; }
+
+    // @param reused : set when the socket came from the idle list
+    int acquire(const std::string& host, unsigned short port, bool& reused, NatsuError& err);
+
+    // @param reusable : false closes the socket
+    void release(const std::string& host, unsigned short port, int fd, bool reusable);
+
+private:
+    struct IdleConnection
+    {
+        int fd;
+        time_t since;
+    };
+
+    struct Address
+    {
+        sockaddr_storage addr;
+        socklen_t len;
+        time_t resolved;
+    };
+
+    int pop_idle(const std::string& key);
+    bool resolve(const std::string& host, unsigned short port, Address& addr, NatsuError& err);
+    int connect_to(const Address& addr, NatsuError& err);
+
+    static std::string key(const std::string& host, unsigned short port);
+
+private:
+    HttpClientOptions options_;
+
+    co::LFLock lock_;
+    std::map<std::string, std::list<IdleConnection>> idle_;
+    std::map<std::string, Address> address_;
+};
+
+}}
+
+#endif
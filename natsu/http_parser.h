@@ -1,7 +1,6 @@
 #ifndef HTTPPARSER_HPP
 #define HTTPPARSER_HPP
 
-#include <iostream>
 #include <string>
 #include <map>
 #include <string.h>
@@ -10,6 +9,8 @@
 
 #include "tribool.h"
 #include "http_request.h"
+#include "http_client.h"
+#include "natsu_log.h"
 
 #ifdef WIN32
 #define strcasecmp _stricmp
@@ -21,18 +22,47 @@ namespace http {
 class HttpParser
 {
 public:
-    HttpParser()
+    enum BodyKind
+    {
+        BODY_NONE,
+        BODY_LENGTH,
+        BODY_CHUNKED,
+        BODY_UNTIL_CLOSE,
+    };
+
+    // response mode parses status lines into HttpClientResponse
+    HttpParser(bool response = false)
+    : response_mode_(response), head_only_(false)
     {
         reset();
     }
 
+    // stop at the end of the head, body bytes already read stay in cache()
+    void head_only(bool on)
+    {
+        head_only_ = on;
+    }
+
+    BodyKind body_kind()
+    {
+        return body_kind_;
+    }
+
+    size_t content_length()
+    {
+        return content_length_;
+    }
+
     void reset()
     {
         parse_func_ = &HttpParser::parse_first_line;
         req_.reset();
+        rsp_.reset();
+        minor_version_ = 1;
 
         cache_.clear();
         content_length_ = 0;
+        body_kind_ = BODY_NONE;
     }
 
     tribool parse()
@@ -56,19 +86,57 @@ public:
         return failure;
     }
 
+    // peer closed the connection, a response without length ends here
+    tribool finish()
+    {
+        if(parse_func_ == &HttpParser::parse_body_until_close)
+        {
+            rsp_->body().swap(cache_);
+            cache_.clear();
+            return success;
+        }
+
+        return failure;
+    }
+
     std::shared_ptr<HttpRequest>& request()
     {
         return req_;
     }
 
+    std::shared_ptr<HttpClientResponse>& response()
+    {
+        return rsp_;
+    }
+
+    // bytes received after the current message, eg. pipelined responses
+    std::string& cache()
+    {
+        return cache_;
+    }
+
+    bool keep_alive()
+    {
+        std::string conn = header("connection");
+        if(minor_version_ == 0)
+            return strcasecmp(conn.c_str(), "keep-alive") == 0;
+        return strcasecmp(conn.c_str(), "close") != 0;
+    }
+
 
 private:
     tribool parse_body_with_length()
     {
-        if(cache_.size() >= content_length_)
+        if(cache_.size() == content_length_)
+        {
+            body().swap(cache_);
+            cache_.clear();
+            return success;
+        }
+        else if(cache_.size() >= content_length_)
         {
-            req_->body().clear();
-            req_->body() = cache_.substr(0,content_length_);
+            body().clear();
+            body() = cache_.substr(0,content_length_);
             cache_.erase(0,content_length_);
 
             return success;
@@ -99,6 +167,12 @@ private:
             size_t len = stringtoint(line.c_str());
             if(len == 0)
             {
+                //last chunk, consume optional trailers and the final CRLF
+                size_t end = cache_.find("\r\n\r\n", pos);
+                if(end == std::string::npos)
+                    return indeterminate;
+
+                cache_.erase(0, end + 4);
                 return success;
             }
             else if((cache_.size() - pos) < (len + 4))
@@ -108,7 +182,7 @@ private:
             else
             {
                 cache_.erase(0, pos + 2);
-                req_->body().append(cache_.c_str(), len);
+                body().append(cache_.c_str(), len);
                 cache_.erase(0, len + 2);
             }
         }
@@ -128,30 +202,57 @@ private:
             {
                 ///HEAD END
                 parse_func_ = &HttpParser::parse_body_with_length;
+                body_kind_ = BODY_LENGTH;
+
+                ///1xx 204 304 never carry a body
+                if(rsp_ && (rsp_->code() < 200 || rsp_->code() == 204 || rsp_->code() == 304))
+                {
+                    body_kind_ = BODY_NONE;
+                    return success;
+                }
 
                 ///Transfer-Encoding
-                if(req_->header("transfer-encoding").size())
+                if(header("transfer-encoding").size())
                 {
-                    std::string encode = req_->header("transfer-encoding");
+                    std::string encode = header("transfer-encoding");
                     if(strcasecmp("CHUNKED",encode.c_str()) == 0)
+                    {
                         parse_func_ = &HttpParser::parse_body_with_chunk;
+                        body_kind_ = BODY_CHUNKED;
+                    }
                 }
                 else
                 {
-                    if(req_->header("content-length").size())
+                    if(header("content-length").size())
                     {
-                        std::string len = req_->header("content-length");
+                        std::string len = header("content-length");
                         content_length_ = atoi(len.c_str());                        
+
+                        ///grow once for the common small body, a larger one grows
+                        ///with the bytes that really arrive, not with what the peer claims
+                        if(!head_only_)
+                            cache_.reserve(cache_.size() + std::min<size_t>(content_length_, kMaxReserve));
+                    }
+                    else if(rsp_)
+                    {
+                        ///response without length lasts until close
+                        parse_func_ = &HttpParser::parse_body_until_close;
+                        body_kind_ = BODY_UNTIL_CLOSE;
+                        return head_only_ ? success : indeterminate;
                     }
                     else
                         content_length_ = 0;
 
                     if( content_length_ == 0)
                     {
+                        body_kind_ = BODY_NONE;
                         return success;
                     }
                 }                
 
+                if(head_only_)
+                    return success;
+
                 return (this->*parse_func_) ();
             }
 
@@ -171,7 +272,7 @@ private:
             key.erase(trimright(key) + 1);
             value.erase(0,trimleft(value));
             std::transform(key.begin(), key.end(), key.begin(), ::tolower);
-            req_->header(key, value);
+            header(key, value);
 
             return parse_headers();
         }
@@ -197,9 +298,9 @@ private:
             std::string sLine = cache_.substr(0, pos);
             cache_.erase(0, pos + 2);
             ///MIN FIRST LINE
-            if(MinLine > pos)
+            if(!response_mode_ && MinLine > pos)
             {
-                std::cout << "POS " << pos << std::endl;
+                NATSU_LOG_DEBUG("http first line too short: %zu", pos);
                 return failure;
             }
 
@@ -208,7 +309,22 @@ private:
             if(strcasecmp("HTTP/1.", sLine.substr(0,7).c_str()) == 0)
             {
                 ///RSP
-                std::cout << "RESPONSE: " << sLine << std::endl;
+                if(!response_mode_ || sLine.size() < 12)
+                {
+                    NATSU_LOG_DEBUG("http parser got response line: %s", sLine.c_str());
+                    return failure;
+                }
+
+                rsp_.reset(new HttpClientResponse());
+                minor_version_ = sLine[7] - '0';
+                rsp_->code() = atoi(sLine.c_str() + 9);
+                if(rsp_->code() < 100 || rsp_->code() > 999)
+                {
+                    return failure;
+                }
+            }
+            else if(response_mode_)
+            {
                 return failure;
             }
             else
@@ -254,6 +370,27 @@ private:
         return indeterminate;
     }
 
+    tribool parse_body_until_close()
+    {
+        return indeterminate;
+    }
+
+    std::string header(const std::string& k)
+    {
+        return rsp_ ? rsp_->header(k) : req_->header(k);
+    }
+
+    void header(const std::string& k, const std::string& v)
+    {
+        if(rsp_) rsp_->header(k, v);
+        else req_->header(k, v);
+    }
+
+    std::string& body()
+    {
+        return rsp_ ? rsp_->body() : req_->body();
+    }
+
     static size_t trimleft(const std::string& s)
     {
         size_t i = 0;
@@ -287,11 +424,18 @@ private:
     }
 
 private:
+    static const size_t kMaxReserve = 64 * 1024;
+
     typedef tribool (HttpParser::*ParseFunction)();
     ParseFunction   parse_func_;
     size_t          content_length_;
+    bool            response_mode_;
+    bool            head_only_;
+    BodyKind        body_kind_;
+    int             minor_version_;
 
     std::shared_ptr<HttpRequest>      req_;
+    std::shared_ptr<HttpClientResponse> rsp_;
     std::string     cache_;
 };
 
@@ -0,0 +1,570 @@
+#include "http_proxy.h"
+#include "http_parser.h"
+#include "http_connection_pool.h"
+#include "natsu_buffer.h"
+#include "natsu_log.h"
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <strings.h>
+#include <atomic>
+
+namespace natsu {
+namespace http {
+
+static const char* kProxyMethod[] = { "PUT", "GET", "POST", "DELETE" };
+
+// hop-by-hop headers are never forwarded, framing of the request body is rebuilt
+static const char* kHopHeaders[] = { "connection", "keep-alive", "proxy-connection", "te",
+                                     "trailer", "upgrade", "expect", "content-length",
+                                     "transfer-encoding" };
+
+static bool hop_by_hop(const std::string& k, bool request)
+{
+    //the response keeps its own length and chunked framing, it is relayed as is
+    size_t n = sizeof(kHopHeaders) / sizeof(kHopHeaders[0]) - (request ? 0 : 2);
+    for(size_t i = 0; i < n; ++i)
+    {
+        if(strcasecmp(k.c_str(), kHopHeaders[i]) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+struct Upstream
+{
+    Upstream() : port(0), outstanding(0) {}
+
+    std::string host;
+    unsigned short port;
+    std::atomic<int> outstanding;
+};
+
+// holds one upstream connection until the response is fully relayed or dropped
+struct UpstreamLease
+{
+    UpstreamLease(const std::shared_ptr<Upstream>& u, int f)
+    : up(u), fd(f), reusable(false) {}
+
+    ~UpstreamLease()
+    {
+        HttpConnectionPool::instance().release(up->host, up->port, fd, reusable);
+        --up->outstanding;
+    }
+
+    std::shared_ptr<Upstream> up;
+    int fd;
+    bool reusable;
+};
+
+// follows chunked framing over raw bytes, so the end of a relayed body is known
+class ChunkTracker
+{
+public:
+    ChunkTracker() : state_(SIZE), size_(0), digits_(0) {}
+
+    bool done() { return state_ == DONE; }
+
+    // @return bytes belonging to the body, -1 on malformed input
+    ssize_t feed(const char* p, size_t n)
+    {
+        size_t i = 0;
+        while(i < n && state_ != DONE)
+        {
+            char c = p[i];
+            switch(state_)
+            {
+            case SIZE:
+                if(isxdigit(static_cast<unsigned char>(c)))
+                {
+                    if(++digits_ > 15) return -1;
+                    size_ = size_ * 16 + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+                }
+                else if(c == ';' || c == ' ' || c == '\t')
+                    state_ = EXTENSION;
+                else if(c == '\n')
+                {
+                    if(!chunk_start()) return -1;
+                }
+                else if(c != '\r')
+                    return -1;
+                ++i;
+                break;
+
+            case EXTENSION:
+                if(c == '\n' && !chunk_start()) return -1;
+                ++i;
+                break;
+
+            case DATA:
+            {
+                size_t take = std::min(size_, n - i);
+                size_ -= take;
+                i += take;
+                if(size_ == 0) state_ = DATA_END;
+            }
+            break;
+
+            case DATA_END:
+                if(c == '\n')
+                {
+                    state_ = SIZE;
+                    digits_ = 0;
+                }
+                else if(c != '\r')
+                    return -1;
+                ++i;
+                break;
+
+            case TRAILER_START:
+                if(c == '\n') state_ = DONE;
+                else if(c != '\r') state_ = TRAILER;
+                ++i;
+                break;
+
+            case TRAILER:
+                if(c == '\n') state_ = TRAILER_START;
+                ++i;
+                break;
+
+            case DONE:
+                break;
+            }
+        }
+
+        return i;
+    }
+
+private:
+    // the size line ended, a zero size is the last chunk
+    bool chunk_start()
+    {
+        if(digits_ == 0)
+            return false;
+
+        state_ = size_ ? DATA : TRAILER_START;
+        return true;
+    }
+
+private:
+    enum State { SIZE, EXTENSION, DATA, DATA_END, TRAILER_START, TRAILER, DONE };
+    State state_;
+    size_t size_;
+    int digits_;
+};
+
+static bool wait_fd(int fd, short events, int timeout)
+{
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+    return poll(&pfd, 1, timeout) > 0;
+}
+
+/* *
+ * BodyRelay
+ * the StreamWriter of a proxied response, moves the upstream body to the
+ * client socket. bytes read together with the upstream head go first
+*/
+class BodyRelay
+{
+public:
+    BodyRelay(const std::shared_ptr<UpstreamLease>& lease, HttpParser& parser, bool keep_alive,
+              size_t splice_threshold, int timeout)
+    : lease_(lease), kind_(parser.body_kind()), length_(parser.content_length()),
+      keep_alive_(keep_alive), splice_threshold_(splice_threshold), timeout_(timeout)
+    {
+        leftover_.swap(parser.cache());
+    }
+
+    bool operator()(int client)
+    {
+        bool complete = false;
+        switch(kind_)
+        {
+        case HttpParser::BODY_NONE:
+            complete = leftover_.empty();
+            break;
+
+        case HttpParser::BODY_LENGTH:
+            complete = relay_length(client);
+            break;
+
+        case HttpParser::BODY_CHUNKED:
+            complete = relay_chunked(client);
+            break;
+
+        case HttpParser::BODY_UNTIL_CLOSE:
+            relay_until_close(client);
+            break;
+        }
+
+        lease_->reusable = complete && keep_alive_;
+        leftover_.clear();
+        return complete || kind_ == HttpParser::BODY_UNTIL_CLOSE;
+    }
+
+private:
+    bool relay_length(int client)
+    {
+        size_t first = std::min(leftover_.size(), length_);
+        if(!write_all(client, leftover_.data(), first))
+            return false;
+
+        //anything past the body means the upstream is out of sync
+        if(leftover_.size() > length_)
+            return false;
+
+        size_t remaining = length_ - first;
+        if(remaining >= splice_threshold_)
+            return relay_splice(client, remaining);
+
+        char buf[8192];
+        int up = lease_->fd;
+        while(remaining)
+        {
+            ssize_t n = read(up, buf, std::min(remaining, sizeof(buf)));
+            if(n == -1 && EINTR == errno)
+                continue;
+            if(n <= 0)
+                return false;
+
+            if(!write_all(client, buf, n))
+                return false;
+            remaining -= n;
+        }
+
+        return true;
+    }
+
+    // upstream socket -> pipe -> client socket, payload never enters user space
+    bool relay_splice(int client, size_t remaining)
+    {
+        int pipefd[2];
+        if(pipe2(pipefd, O_NONBLOCK | O_CLOEXEC) == -1)
+            return false;
+
+        static const size_t kPipeChunk = 64 * 1024;
+        int up = lease_->fd;
+        bool ok = true;
+        while(ok && remaining)
+        {
+            ssize_t n = splice(up, NULL, pipefd[1], NULL, std::min(remaining, kPipeChunk),
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if(n == -1)
+            {
+                if(EAGAIN == errno)
+                    ok = wait_fd(up, POLLIN, timeout_);
+                else
+                    ok = EINTR == errno;
+                continue;
+            }
+            else if(n == 0)
+            {
+                ok = false;
+                break;
+            }
+
+            remaining -= n;
+            //the pipe is drained every round, so it never fills up
+            while(ok && n)
+            {
+                ssize_t m = splice(pipefd[0], NULL, client, NULL, n, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if(m == -1)
+                {
+                    if(EAGAIN == errno)
+                        ok = wait_fd(client, POLLOUT, timeout_);
+                    else
+                        ok = EINTR == errno;
+                    continue;
+                }
+
+                n -= m;
+            }
+        }
+
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return ok;
+    }
+
+    bool relay_chunked(int client)
+    {
+        ChunkTracker tracker;
+        char buf[8192];
+        const char* p = leftover_.data();
+        size_t n = leftover_.size();
+        int up = lease_->fd;
+        while(true)
+        {
+            ssize_t used = tracker.feed(p, n);
+            if(used == -1 || !write_all(client, p, used))
+                return false;
+
+            if(tracker.done())
+                return static_cast<size_t>(used) == n;
+
+            ssize_t ret = read(up, buf, sizeof(buf));
+            if(ret == -1 && EINTR == errno)
+            {
+                n = 0;
+                continue;
+            }
+            if(ret <= 0)
+                return false;
+
+            p = buf;
+            n = ret;
+        }
+    }
+
+    void relay_until_close(int client)
+    {
+        if(!write_all(client, leftover_.data(), leftover_.size()))
+            return;
+
+        char buf[8192];
+        while(true)
+        {
+            ssize_t n = read(lease_->fd, buf, sizeof(buf));
+            if(n == -1 && EINTR == errno)
+                continue;
+            if(n <= 0 || !write_all(client, buf, n))
+                return;
+        }
+    }
+
+private:
+    std::shared_ptr<UpstreamLease> lease_;
+    HttpParser::BodyKind kind_;
+    size_t length_;
+    bool keep_alive_;
+    size_t splice_threshold_;
+    int timeout_;
+    std::string leftover_;
+};
+
+class HttpProxy::HttpProxyImpl
+{
+public:
+    HttpProxyImpl(const std::vector<std::string>& upstreams, const HttpProxyOptions& opts)
+    : options_(opts), next_(0)
+    {
+        for(size_t i = 0; i < upstreams.size(); ++i)
+        {
+            std::shared_ptr<Upstream> up = std::make_shared<Upstream>();
+            if(!parse_upstream(upstreams[i], up->host, up->port))
+            {
+                NATSU_LOG_ERROR("proxy: invalid upstream %s", upstreams[i].c_str());
+                continue;
+            }
+
+            upstreams_.push_back(up);
+        }
+    }
+
+    void forward(std::shared_ptr<HttpRequest>& req, std::shared_ptr<HttpResponse>& rsp)
+    {
+        if(upstreams_.empty())
+        {
+            rsp->response(502);
+            return;
+        }
+
+        std::shared_ptr<Upstream> up = pick();
+        ++up->outstanding;
+
+        std::string head = build_head(req);
+        HttpConnectionPool& pool = HttpConnectionPool::instance();
+        int timeout = pool.options().timeout;
+        int code = 502;
+        //a pooled socket may have been closed by peer just now, retry once on a fresh one
+        for(int attempt = 0; attempt < 2; ++attempt)
+        {
+            NatsuError err;
+            bool reused = false;
+            int fd = pool.acquire(up->host, up->port, reused, err);
+            if(fd == -1)
+            {
+                NATSU_LOG_WARN("proxy: %s:%d %s", up->host.c_str(), up->port, err.reason().c_str());
+                break;
+            }
+
+            iovec iov[2];
+            iov[0].iov_base = const_cast<char*>(head.data());
+            iov[0].iov_len = head.size();
+            iov[1].iov_base = const_cast<char*>(req->body().data());
+            iov[1].iov_len = req->body().size();
+            if(!writev_all(fd, iov, 2))
+            {
+                pool.release(up->host, up->port, fd, false);
+                if(reused) continue;
+                break;
+            }
+
+            HttpParser parser(true);
+            parser.head_only(true);
+            bool received = false;
+            tribool ret = read_head(fd, parser, received);
+            if(ret != success)
+            {
+                code = (ret == indeterminate) ? 504 : 502;
+                pool.release(up->host, up->port, fd, false);
+                if(reused && !received) continue;
+                break;
+            }
+
+            std::shared_ptr<HttpClientResponse>& upstream = parser.response();
+            rsp->response(upstream->code());
+            for(auto it = upstream->headers().begin(); it != upstream->headers().end(); ++it)
+            {
+                if(!hop_by_hop(it->first, false))
+                    rsp->header(it->first, it->second);
+            }
+
+            //the lease now owns the outstanding count and the socket
+            std::shared_ptr<UpstreamLease> lease = std::make_shared<UpstreamLease>(up, fd);
+            rsp->stream(BodyRelay(lease, parser, parser.keep_alive(), options_.splice_threshold, timeout));
+            return;
+        }
+
+        --up->outstanding;
+        rsp->response(code);
+    }
+
+private:
+    // least outstanding requests, ties go round robin
+    std::shared_ptr<Upstream> pick()
+    {
+        size_t n = upstreams_.size();
+        size_t start = next_++ % n;
+        size_t best = start;
+        for(size_t i = 1; i < n; ++i)
+        {
+            size_t idx = (start + i) % n;
+            if(upstreams_[idx]->outstanding.load(std::memory_order_relaxed) <
+               upstreams_[best]->outstanding.load(std::memory_order_relaxed))
+                best = idx;
+        }
+
+        return upstreams_[best];
+    }
+
+    std::string build_head(std::shared_ptr<HttpRequest>& req)
+    {
+        std::string path = req->path();
+        const std::string& prefix = options_.strip_prefix;
+        if(prefix.size() && path.compare(0, prefix.size(), prefix) == 0)
+        {
+            path.erase(0, prefix.size());
+            if(path.empty() || path[0] != '/')
+                path.insert(0, "/");
+        }
+
+        std::string head;
+        head.reserve(512);
+        head.append(kProxyMethod[req->method()]);
+        head.append(" ");
+        head.append(path);
+        head.append(" HTTP/1.1\r\n");
+
+        const std::map<std::string,std::string>& headers = req->headers();
+        for(auto it = headers.begin(); it != headers.end(); ++it)
+        {
+            if(hop_by_hop(it->first, true))
+                continue;
+
+            head.append(it->first);
+            head.append(": ");
+            head.append(it->second);
+            head.append("\r\n");
+        }
+
+        if(req->body().size() || req->method() == POST || req->method() == PUT)
+        {
+            head.append("content-length: ");
+            head.append(std::to_string(req->body().size()));
+            head.append("\r\n");
+        }
+
+        head.append("\r\n");
+        return head;
+    }
+
+    // @return indeterminate when the upstream timed out
+    static tribool read_head(int fd, HttpParser& parser, bool& received)
+    {
+        char buf[4096];
+        while(true)
+        {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if(n == -1)
+            {
+                if(EINTR == errno)
+                    continue;
+
+                //EAGAIN here means SO_RCVTIMEO expired
+                return EAGAIN == errno ? indeterminate : failure;
+            }
+            else if(n == 0)
+            {
+                return failure;
+            }
+
+            received = true;
+            //interim 1xx responses are skipped, the request body was sent in full
+            tribool ret = parser.parse(buf, n);
+            while(ret == success && parser.response()->code() < 200)
+                ret = parser.parse();
+
+            if(ret != indeterminate)
+                return ret;
+        }
+    }
+
+    // host:port, [v6]:port
+    static bool parse_upstream(const std::string& s, std::string& host, unsigned short& port)
+    {
+        std::string addr = s;
+        if(addr.compare(0, 7, "http://") == 0)
+            addr.erase(0, 7);
+        if(addr.size() && addr[addr.size() - 1] == '/')
+            addr.erase(addr.size() - 1);
+
+        port = 80;
+        size_t colon = addr.rfind(':');
+        size_t bracket = addr.rfind(']');
+        if(colon != std::string::npos && (bracket == std::string::npos || colon > bracket))
+        {
+            port = static_cast<unsigned short>(atoi(addr.c_str() + colon + 1));
+            addr.erase(colon);
+        }
+
+        if(addr.size() > 2 && addr[0] == '[' && addr[addr.size() - 1] == ']')
+            addr = addr.substr(1, addr.size() - 2);
+
+        host = addr;
+        return !host.empty() && port != 0;
+    }
+
+private:
+    HttpProxyOptions options_;
+    std::vector<std::shared_ptr<Upstream>> upstreams_;
+    std::atomic<size_t> next_;
+};
+
+HttpProxy::HttpProxy(const std::vector<std::string>& upstreams, const HttpProxyOptions& opts)
+: proxy_(std::make_shared<HttpProxyImpl>(upstreams, opts))
+{
+}
+
+void HttpProxy::operator()(std::shared_ptr<HttpRequest> req, std::shared_ptr<HttpResponse> rsp)
+{
+    proxy_->forward(req, rsp);
+}
+
+}}
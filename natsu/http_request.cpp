@@ -1,6 +1,5 @@
 #include "http_request.h"
 #include "natsu_string.h"
-#include <curl/curl.h>
 
 namespace natsu {
 namespace http {
@@ -24,78 +23,61 @@ void HttpRequest::header(const std::string& k, const std::string& v)
 	header_[k] = v;
 }
 
-std::string HttpRequest::query()
+// after the first sep up to the next of the other separators, empty without sep
+static StringView component(const std::string& path, char sep)
 {
-	size_t pos_p = path_.find(';');
-    size_t pos_f = path_.find('#');
-    size_t pos_q = path_.find('?');
-    if(pos_q == std::string::npos)
-        return "";
-
-    size_t pos = std::min(pos_f,pos_p);
+    size_t pos = path.find(sep);
     if(pos == std::string::npos)
-        return path_.substr(pos_q + 1);
+        return StringView();
 
-    if(pos > pos_q)
-        return path_.substr(pos_q + 1, pos - pos_q - 1);
+    StringView rest = StringView(path).substr(pos + 1);
+    size_t end = rest.size();
+    for(char other : {';', '#', '?'})
+    {
+        size_t p = (other == sep) ? std::string::npos : rest.find(other);
+        if(p < end)
+            end = p;
+    }
+    return rest.substr(0, end);
+}
 
-    return path_.substr(pos_q + 1, std::max(pos_f,pos_p) - pos_q - 1);
+// value of key k among "k=v&..." pairs, url decoded
+static bool find_pair(StringView pairs, StringView k, std::string& v)
+{
+    Tokenizer t(pairs, '&');
+    for(StringView token; t.next(token); )
+    {
+        //a pair without '=' is a key with an empty value
+        size_t pos = token.find('=');
+        if(token.substr(0, pos) != k)
+            continue;
+
+        StringView value = token.substr(pos == std::string::npos ? token.size() : pos + 1);
+        v = natsu::url_decode(value.data(), value.size());
+        return true;
+    }
+    return false;
+}
+
+std::string HttpRequest::query()
+{
+    return component(path_, '?').str();
 }
 
 std::string HttpRequest::data(const std::string& q)
 {
+    std::string v;
 	if(GET == method_)
 	{
-        std::string str = query();
-    	std::vector<std::string> tokens;
-    	natsu::tokenize(str, tokens, "&");
-    	for (size_t i = 0; i < tokens.size(); ++i)
-    	{
-    		std::string k,v;
-    		size_t pos = tokens[i].find("=");
-    		if(pos != std::string::npos)
-    		{
-    			k = tokens[i].substr(0, pos);
-    			v = tokens[i].substr(pos + 1);
-    			v = curl_unescape(v.c_str(), v.size());
-    		}
-    		else
-    		{
-    			k = tokens[i].substr(0, pos - 1);
-    		}
-
-    		if(k == q)
-    		{
-    			return v;
-    		}
-    	}
+        find_pair(component(path_, '?'), q, v);
     }
     else if(POST == method_)
     {
-        if(header("content-type").compare("application/x-www-from-urlencoded") == 0)
+        //parameters such as "; charset=utf-8" may follow the type
+        auto it = header_.find("content-type");
+        if(it != header_.end() && it->second.compare(0, 33, "application/x-www-form-urlencoded") == 0)
         {
-            std::vector<std::string> tokens;
-            natsu::tokenize(body_, tokens, "&");
-            for (size_t i = 0; i < tokens.size(); ++i)
-            {
-                std::string k,v;
-                size_t pos = tokens[i].find("=");
-                if(pos != std::string::npos)
-                {
-                    k = tokens[i].substr(0, pos);
-                    v = tokens[i].substr(pos + 1);
-                    v = curl_unescape(v.c_str(), v.size());
-                }
-                else
-                {
-                    k = tokens[i].substr(0, pos - 1);
-                }
-
-                if(k == q)
-                {
-                    return v;
-                }
-            }
+            find_pair(body_, q, v);
         }
         else
         {
@@ -105,57 +87,23 @@ std::string HttpRequest::data(const std::string& q)
         }
     }
 
-	return "";
+	return v;
 }
 
 std::string HttpRequest::parameters()
 {
-	size_t pos_p = path_.find(';');
-    size_t pos_f = path_.find('#');
-    size_t pos_q = path_.find('?');
-    if(pos_p == std::string::npos)
-        return "";
-
-    size_t pos = std::min(pos_f,pos_q);
-    if(pos == std::string::npos)
-        return path_.substr(pos_p + 1);
-
-    if(pos > pos_p)
-        return path_.substr(pos_p + 1, pos - pos_p - 1);
-
-    return path_.substr(pos_p + 1, std::max(pos_f,pos_q) - pos_p - 1);
+    return component(path_, ';').str();
 }
 
 std::string HttpRequest::fragment()
 {
-	size_t pos_p = path_.find(';');
-    size_t pos_f = path_.find('#');
-    size_t pos_q = path_.find('?');
-    if(pos_f == std::string::npos)
-        return "";
-
-    size_t pos = std::min(pos_p,pos_q);
-    if(pos == std::string::npos)
-        return path_.substr(pos_f + 1);
-
-    if(pos > pos_f)
-        return path_.substr(pos_f + 1, pos - pos_f - 1);
-
-    return path_.substr(pos_f + 1, std::max(pos_p,pos_q) - pos_f - 1);
+    return component(path_, '#').str();
 }
 
 std::string HttpRequest::document()
 {
-	size_t pos_p = path_.find(';');
-    size_t pos_f = path_.find('#');
-    size_t pos_q = path_.find('?');
-    if((pos_p == std::string::npos) && (pos_f == std::string::npos) && (pos_q == std::string::npos))
-        return path_;
-
-    size_t pos = std::min(pos_p, std::min(pos_f,pos_q));
-    return path_.substr(0,pos);
+    size_t pos = path_.find_first_of(";#?");
+    return pos == std::string::npos ? path_ : path_.substr(0, pos);
 }
 
-
-
 }}
@@ -4,6 +4,44 @@
 namespace natsu {
 namespace http {
 
+static const char* reason(int code)
+{
+    switch(code)
+    {
+    case 100: return "Continue";
+    case 101: return "Switching Protocols";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Temporarily Moved";
+    case 303: return "See Other";
+    case 304: return "Not Modified";
+    case 307: return "Temporary Redirect";
+    case 308: return "Permanent Redirect";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 409: return "Conflict";
+    case 411: return "Length Required";
+    case 412: return "Precondition Failed";
+    case 413: return "Payload Too Large";
+    case 416: return "Range Not Satisfiable";
+    case 429: return "Too Many Requests";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    default:  return "Unknown";
+    }
+}
+
 
 class HttpResponse::HttpResponseImpl
 {
@@ -16,41 +54,32 @@ public:
     std::string make()
     {
         std::stringstream stream;
-        switch(code_)
-        {
-        case 200:
-            stream << "HTTP/1.1 " << code_ << " OK\r\n";
-            break;
-
-        case 302:
-            stream << "HTTP/1.1 " << code_ << " Temporarily Moved\r\n";
-            break;
-
-        case 404:
-            stream << "HTTP/1.1 " << code_ << " Not Found\r\n";
-            break;
+        stream << "HTTP/1.1 " << code_ << " " << reason(code_) << "\r\n";
 
-        case 500:
-            stream << "HTTP/1.1 " << code_ << " Internal Server Error\r\n";
-            break;
+        header_["Connection"] = "close";
+        if(!writer_)
+        {
+            auto it = header_.find("Content-Length");
+            if(it != header_.end()) header_.erase(it);
         }
 
-        header_["Connection"] = "close";
-        auto it = header_.find("Content-Length");
-        if(it != header_.end()) header_.erase(it);
         for(auto it = header_.begin(); it != header_.end(); ++it)
         {
             stream << it->first << ": " << it->second << "\r\n";
         }
 
-        stream << "Content-Length: " << body_.size() << "\r\n";
+        //a streamed body is framed by the handler's own headers
+        if(!writer_ && code_ >= 200 && code_ != 204 && code_ != 304)
+            stream << "Content-Length: " << body_.size() << "\r\n";
         stream << "\r\n";
-        stream << body_;
+        if(!writer_)
+            stream << body_;
 
         return stream.str();
     }
 
     int code_;
+    StreamWriter writer_;
     std::map<std::string,std::string> header_;
     std::string body_;
 };
@@ -66,6 +95,17 @@ void HttpResponse::header(const std::string& key, const std::string& value)
     response_->header_[key] = value;
 }
 
+std::string HttpResponse::header(const std::string& key)
+{
+    auto it = response_->header_.find(key);
+    return it != response_->header_.end() ? it->second : std::string();
+}
+
+const std::map<std::string,std::string>& HttpResponse::headers()
+{
+    return response_->header_;
+}
+
 void HttpResponse::response(const std::string& resp, const std::string& ct)
 {
     response_->header_["Content-Type"] = ct;
@@ -107,14 +147,45 @@ void HttpResponse::redirect(const std::string& u)
     response_->body_.clear();
 }
 
+void HttpResponse::assign(const HttpResponse& other)
+{
+    *response_ = *other.response_;
+}
+
+void HttpResponse::stream(StreamWriter w)
+{
+    response_->writer_ = w;
+    response_->body_.clear();
+}
+
+bool HttpResponse::streaming()
+{
+    return static_cast<bool>(response_->writer_);
+}
+
+HttpResponse::StreamWriter& HttpResponse::writer()
+{
+    return response_->writer_;
+}
+
 std::string HttpResponse::str()
 {
     return response_->make();
 }
 
+int HttpResponse::code()
+{
+    return response_->code_;
+}
+
+std::string& HttpResponse::body()
+{
+    return response_->body_;
+}
+
 bool HttpResponse::empty()
 {
-    return response_->code_ == 200 &&
+    return response_->code_ == 200 && !response_->writer_ &&
          response_->header_.size() == 0 &&
          response_->body_.size() == 0 ;
 }
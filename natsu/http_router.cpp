@@ -1,5 +1,4 @@
 #include "http_router.h"
-#include "natsu_string.h"
 
 namespace natsu {
 namespace http {
@@ -14,6 +13,21 @@ HttpRouter& HttpRouter::instance()
     return instance;
 }
 
+// one pass, a wildcard applies to word characters
+static std::string to_regex(const std::string& pattern)
+{
+    std::string r;
+    r.reserve(pattern.size() * 2 + 1);
+    r.push_back('^');
+    for(char c : pattern)
+    {
+        if(c == '*' || c == '+' || c == '{')
+            r.append("\\w");
+        r.push_back(c);
+    }
+    return r;
+}
+
 void HttpRouter::register_handler(const std::string& pattern, Handler h, Method method)
 {
     switch (method)
@@ -21,22 +35,14 @@ void HttpRouter::register_handler(const std::string& pattern, Handler h, Method
         case GET:
             {
                 handle_get_[pattern] = h;
-                std::string regex_str = "^" + pattern;
-                std::string r = natsu::replace_all(regex_str, "*", "\\w*");
-                r = natsu::replace_all(r, "+", "\\w+");
-                r = natsu::replace_all(r, "{", "\\w{");
-                regex_get_.add_rule(pattern, r);
+                regex_get_.add_rule(pattern, to_regex(pattern));
             }
             break;
 
         case POST:
             {
                 handle_post_[pattern] = h;
-                std::string regex_str = "^" + pattern;
-                std::string r = natsu::replace_all(regex_str, "*", "\\w*");
-                r = natsu::replace_all(r, "+", "\\w+");
-                r = natsu::replace_all(r, "{", "\\w{");
-                regex_post_.add_rule(pattern, r);
+                regex_post_.add_rule(pattern, to_regex(pattern));
             }
             break;
 
@@ -45,6 +51,30 @@ void HttpRouter::register_handler(const std::string& pattern, Handler h, Method
     }
 }
 
+void HttpRouter::register_websocket(const std::string& pattern, WebSocketHandler h, const WebSocketOptions& opts)
+{
+    WebSocketRoute& route = handle_ws_[pattern];
+    route.handler = h;
+    route.options = opts;
+    regex_ws_.add_rule(pattern, to_regex(pattern));
+}
+
+WebSocketRoute* HttpRouter::websocket(const std::string& document)
+{
+    if(handle_ws_.empty())
+        return NULL;
+
+    std::vector<natsu::PcreRegex::MatchResult> result = regex_ws_.match(document.c_str());
+    if(result.size() && result[0].name.size())
+    {
+        auto it = handle_ws_.find(result[0].name);
+        if(it != handle_ws_.end())
+            return &it->second;
+    }
+
+    return NULL;
+}
+
 void HttpRouter::handle(std::shared_ptr<HttpRequest> req,std::shared_ptr<HttpResponse> resp)
 {
     switch(req->method())
@@ -7,12 +7,19 @@
 #include "http_request.h"
 #include "http_response.h"
 #include "natsu_regex.h"
+#include "natsu_websocket.h"
 
 namespace natsu {
 namespace http {
  
 typedef	std::function<void(std::shared_ptr<HttpRequest>,std::shared_ptr<HttpResponse>)> Handler; 
 
+struct WebSocketRoute
+{
+    WebSocketHandler handler;
+    WebSocketOptions options;
+};
+
 class HttpRouter
 {
 public:
@@ -21,6 +28,10 @@ public:
     void register_handler(const std::string& pattern, Handler h, Method m);
     void handle(std::shared_ptr<HttpRequest>,std::shared_ptr<HttpResponse>);
 
+    void register_websocket(const std::string& pattern, WebSocketHandler h, const WebSocketOptions& opts);
+    // NULL when no websocket route matches the document
+    WebSocketRoute* websocket(const std::string& document);
+
 private:
 	void handle(std::map<std::string, Handler>&, PcreRegex& regex,
                 std::shared_ptr<HttpRequest>,std::shared_ptr<HttpResponse>);
@@ -30,6 +41,8 @@ private:
     std::map<std::string, Handler> handle_post_;
     natsu::PcreRegex regex_get_;
     natsu::PcreRegex regex_post_;
+    std::map<std::string, WebSocketRoute> handle_ws_;
+    natsu::PcreRegex regex_ws_;
 };
 
 }}
@@ -0,0 +1,731 @@
+#include "http_static.h"
+#include "coroutine.h"
+#include "natsu_log.h"
+#include "natsu_etag.h"
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/inotify.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace natsu {
+namespace http {
+
+static const int kSendTimeout = 30 * 1000;
+static const size_t kSendChunk = 1024 * 1024;
+static const int kWatchInterval = 100;
+static const int kRootCheck = 1000;     // ms between checks whether root still resolves to the same directory
+
+struct MimeType
+{
+    const char* ext;
+    const char* type;
+};
+
+static const MimeType kMimeTypes[] = {
+    { "html",  "text/html; charset=utf-8" },
+    { "htm",   "text/html; charset=utf-8" },
+    { "css",   "text/css; charset=utf-8" },
+    { "js",    "application/javascript; charset=utf-8" },
+    { "mjs",   "application/javascript; charset=utf-8" },
+    { "json",  "application/json; charset=utf-8" },
+    { "map",   "application/json; charset=utf-8" },
+    { "txt",   "text/plain; charset=utf-8" },
+    { "xml",   "application/xml; charset=utf-8" },
+    { "svg",   "image/svg+xml" },
+    { "png",   "image/png" },
+    { "jpg",   "image/jpeg" },
+    { "jpeg",  "image/jpeg" },
+    { "gif",   "image/gif" },
+    { "webp",  "image/webp" },
+    { "ico",   "image/x-icon" },
+    { "woff",  "font/woff" },
+    { "woff2", "font/woff2" },
+    { "ttf",   "font/ttf" },
+    { "wasm",  "application/wasm" },
+    { "pdf",   "application/pdf" },
+    { "mp3",   "audio/mpeg" },
+    { "mp4",   "video/mp4" },
+    { "webm",  "video/webm" },
+};
+
+static const char* mime_type(const std::string& path)
+{
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if(dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    {
+        const char* ext = path.c_str() + dot + 1;
+        for(size_t i = 0; i < sizeof(kMimeTypes) / sizeof(kMimeTypes[0]); ++i)
+        {
+            if(strcasecmp(ext, kMimeTypes[i].ext) == 0)
+                return kMimeTypes[i].type;
+        }
+    }
+
+    return "application/octet-stream";
+}
+
+static std::string http_date(time_t t)
+{
+    tm gmt;
+    gmtime_r(&t, &gmt);
+    char buf[64];
+    size_t n = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    return std::string(buf, n);
+}
+
+static time_t parse_http_date(const std::string& s)
+{
+    tm gmt;
+    memset(&gmt, 0, sizeof(gmt));
+    if(strptime(s.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &gmt) == NULL)
+        return -1;
+
+    return timegm(&gmt);
+}
+
+// percent decoding of a path, '+' stays as is
+static bool decode_path(const std::string& in, std::string& out)
+{
+    out.clear();
+    out.reserve(in.size());
+    for(size_t i = 0; i < in.size(); ++i)
+    {
+        char c = in[i];
+        if(c == '%')
+        {
+            if(i + 2 >= in.size() || !isxdigit(static_cast<unsigned char>(in[i + 1]))
+               || !isxdigit(static_cast<unsigned char>(in[i + 2])))
+                return false;
+
+            c = static_cast<char>(strtol(in.substr(i + 1, 2).c_str(), NULL, 16));
+            i += 2;
+        }
+
+        if(c == '\0')
+            return false;
+        out.push_back(c);
+    }
+
+    return true;
+}
+
+// a path never leaves the root, so ".." segments are refused outright
+static bool safe_path(const std::string& path)
+{
+    size_t begin = 0;
+    while(begin <= path.size())
+    {
+        size_t end = path.find('/', begin);
+        if(end == std::string::npos)
+            end = path.size();
+        if(path.compare(begin, end - begin, "..") == 0)
+            return false;
+        begin = end + 1;
+    }
+
+    return true;
+}
+
+// an open file, shared by every response sending it and closed with the last one
+struct FileEntry
+{
+    FileEntry() : fd(-1), map(NULL), size(0), ino(0), mtime(0), directory(false) {}
+
+    ~FileEntry()
+    {
+        if(map) munmap(map, size);
+        if(fd >= 0) close(fd);
+    }
+
+    int fd;
+    void* map;
+    size_t size;
+    ino_t ino;
+    time_t mtime;
+    bool directory;
+    std::string type;
+    std::string etag;
+    std::string last_modified;
+    std::shared_ptr<FileEntry> gz;   // precompressed variant, null when there is none
+};
+
+static bool send_file(int sock, std::shared_ptr<FileEntry> file, off_t offset, size_t len)
+{
+    while(len)
+    {
+        ssize_t n;
+        if(file->map)
+            n = write(sock, static_cast<char*>(file->map) + offset, len);
+        else
+            n = sendfile(sock, file->fd, &offset, std::min(len, kSendChunk));
+
+        if(n > 0)
+        {
+            if(file->map) offset += n;
+            len -= n;
+            continue;
+        }
+
+        if(n == -1 && errno == EINTR)
+            continue;
+
+        if(n == -1 && errno == EAGAIN)
+        {
+            pollfd pfd;
+            pfd.fd = sock;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            if(poll(&pfd, 1, kSendTimeout) > 0)
+                continue;
+        }
+
+        //the file shrank or the client went away
+        return false;
+    }
+
+    return true;
+}
+
+class StaticFiles::StaticFilesImpl : public std::enable_shared_from_this<StaticFilesImpl>
+{
+    typedef std::list<std::string> LruList;
+
+    struct CacheItem
+    {
+        std::shared_ptr<FileEntry> file;
+        LruList::iterator lru;
+    };
+
+public:
+    StaticFilesImpl(const std::string& root, const StaticFilesOptions& opts)
+    : root_(root), options_(opts), watching_(false)
+    {
+        while(root_.size() > 1 && root_[root_.size() - 1] == '/')
+            root_.erase(root_.size() - 1);
+        resolved_ = resolve(root_);
+
+        //without inotify every hit is checked with stat()
+        inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(inotify_ == -1)
+            NATSU_LOG_ERROR("static: inotify_init1 failed errno %d, revalidating with stat()", errno);
+    }
+
+    ~StaticFilesImpl()
+    {
+        //the watching coroutine finds the handler gone on its next wake and ends
+        if(inotify_ >= 0) close(inotify_);
+    }
+
+    void start()
+    {
+        if(inotify_ >= 0)
+        {
+            watching_ = true;
+            std::weak_ptr<StaticFilesImpl> weak = shared_from_this();
+            int fd = inotify_;
+            go [weak, fd]{ watch(weak, fd); };
+        }
+    }
+
+    void serve(std::shared_ptr<HttpRequest>& req, std::shared_ptr<HttpResponse>& rsp)
+    {
+        std::string doc = req->document();
+        const std::string& prefix = options_.strip_prefix;
+        if(prefix.size() && doc.compare(0, prefix.size(), prefix) == 0)
+            doc.erase(0, prefix.size());
+
+        std::string rel;
+        if(!decode_path(doc, rel) || !safe_path(rel))
+        {
+            rsp->response(400);
+            return;
+        }
+
+        if(rel.empty() || rel[0] != '/')
+            rel.insert(0, "/");
+
+        //cache keys never end with a slash, as inotify reports them
+        std::string path = root_ + rel;
+        while(path.size() > 1 && path[path.size() - 1] == '/')
+            path.erase(path.size() - 1);
+
+        std::shared_ptr<FileEntry> file = lookup(path);
+        if(file && file->directory)
+        {
+            if(rel[rel.size() - 1] != '/')
+            {
+                rsp->response(301);
+                rsp->header("Location", req->document() + "/");
+                return;
+            }
+
+            file.reset();
+            if(options_.index.size())
+                file = lookup(path + "/" + options_.index);
+            if(file && file->directory)
+                file.reset();
+        }
+
+        if(!file)
+        {
+            rsp->response(404);
+            return;
+        }
+
+        std::string range = req->header("range");
+        std::string if_range = req->header("if-range");
+        if(if_range.size() && if_range != file->etag && if_range != file->last_modified)
+            range.clear();
+
+        //the compressed variant is sent whole only, ranges address the plain file
+        std::shared_ptr<FileEntry> body = file;
+        if(file->gz && range.empty() && accepts_gzip(req->header("accept-encoding")))
+            body = file->gz;
+
+        if(file->gz)
+            rsp->header("Vary", "Accept-Encoding");
+        if(options_.max_age >= 0)
+            rsp->header("Cache-Control", "max-age=" + std::to_string(options_.max_age));
+        rsp->header("ETag", body->etag);
+        rsp->header("Last-Modified", body->last_modified);
+
+        if(not_modified(req, body))
+        {
+            rsp->response(304);
+            return;
+        }
+
+        size_t offset = 0;
+        size_t len = body->size;
+        if(range.size())
+        {
+            int ret = parse_range(range, body->size, offset, len);
+            if(ret < 0)
+            {
+                rsp->response(416);
+                rsp->header("Content-Range", "bytes */" + std::to_string(body->size));
+                return;
+            }
+            else if(ret > 0)
+            {
+                rsp->response(206);
+                rsp->header("Content-Range", "bytes " + std::to_string(offset) + "-" +
+                            std::to_string(offset + len - 1) + "/" + std::to_string(body->size));
+            }
+        }
+
+        if(body != file)
+            rsp->header("Content-Encoding", "gzip");
+        rsp->header("Content-Type", file->type);
+        rsp->header("Content-Length", std::to_string(len));
+        rsp->header("Accept-Ranges", "bytes");
+        rsp->stream([body, offset, len](int sock) {
+            return send_file(sock, body, offset, len);
+        });
+    }
+
+private:
+    static bool accepts_gzip(const std::string& accept)
+    {
+        size_t pos = accept.find("gzip");
+        if(pos == std::string::npos)
+            return false;
+
+        //"gzip;q=0" refuses it
+        size_t end = accept.find(',', pos);
+        std::string params = accept.substr(pos + 4, end == std::string::npos ? std::string::npos : end - pos - 4);
+        size_t q = params.find("q=");
+        return q == std::string::npos || strtod(params.c_str() + q + 2, NULL) > 0;
+    }
+
+    static bool not_modified(std::shared_ptr<HttpRequest>& req, std::shared_ptr<FileEntry>& file)
+    {
+        //If-None-Match takes precedence
+        std::string inm = req->header("if-none-match");
+        if(inm.size())
+            return etag_matches(inm, file->etag);
+
+        std::string ims = req->header("if-modified-since");
+        if(ims.size())
+        {
+            time_t since = parse_http_date(ims);
+            return since != -1 && file->mtime <= since;
+        }
+
+        return false;
+    }
+
+    /* *
+     * parse_range
+     * a single "bytes=" range, several ranges are answered with the whole file.
+     * @return 1 for a range, 0 to send everything, -1 when unsatisfiable
+    */
+    static int parse_range(const std::string& range, size_t size, size_t& offset, size_t& len)
+    {
+        if(range.compare(0, 6, "bytes=") != 0 || range.find(',') != std::string::npos)
+            return 0;
+
+        size_t dash = range.find('-', 6);
+        if(dash == std::string::npos)
+            return 0;
+
+        std::string first = range.substr(6, dash - 6);
+        std::string last = range.substr(dash + 1);
+        char* end = NULL;
+        if(first.empty())
+        {
+            //suffix range, the last n bytes
+            unsigned long long n = strtoull(last.c_str(), &end, 10);
+            if(last.empty() || *end)
+                return 0;
+            if(n == 0 || size == 0)
+                return -1;
+
+            n = std::min<unsigned long long>(n, size);
+            offset = size - n;
+            len = n;
+            return 1;
+        }
+
+        unsigned long long from = strtoull(first.c_str(), &end, 10);
+        if(*end)
+            return 0;
+        if(from >= size)
+            return -1;
+
+        unsigned long long to = size - 1;
+        if(last.size())
+        {
+            to = strtoull(last.c_str(), &end, 10);
+            if(*end || to < from)
+                return 0;
+            to = std::min<unsigned long long>(to, size - 1);
+        }
+
+        offset = from;
+        len = to - from + 1;
+        return 1;
+    }
+
+    std::shared_ptr<FileEntry> lookup(const std::string& path)
+    {
+        std::shared_ptr<FileEntry> cached;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = cache_.find(path);
+            if(it != cache_.end())
+            {
+                cached = it->second.file;
+                lru_.splice(lru_.begin(), lru_, it->second.lru);
+                if(watching_)
+                    return cached;
+            }
+        }
+
+        //without inotify a hit is checked with stat(), outside the lock
+        if(cached && fresh(path, cached))
+            return cached;
+
+        std::shared_ptr<FileEntry> file = open_file(path);
+        if(!file)
+            return file;
+
+        if(file->gz == NULL && !file->directory && options_.gzip)
+        {
+            //a .gz older than its source is stale and ignored
+            std::shared_ptr<FileEntry> gz = open_file(path + ".gz");
+            if(gz && !gz->directory && gz->mtime >= file->mtime)
+                file->gz = gz;
+        }
+
+        //inotify watches inodes, the directory's real name tells whether a symlink below root leads to it
+        std::string dir = path.substr(0, path.rfind('/'));
+        if(dir.empty())
+            dir = "/";
+        std::string real = watching_ ? resolve(dir) : std::string();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(watching_ && !watch_dir(dir, real))
+            return file;
+
+        erase(path);
+        lru_.push_front(path);
+        CacheItem& item = cache_[path];
+        item.file = file;
+        item.lru = lru_.begin();
+
+        while(cache_.size() > std::max<size_t>(options_.max_files, 1))
+        {
+            cache_.erase(lru_.back());
+            lru_.pop_back();
+        }
+
+        return file;
+    }
+
+    std::shared_ptr<FileEntry> open_file(const std::string& path)
+    {
+        std::shared_ptr<FileEntry> file;
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd == -1)
+            return file;
+
+        struct stat st;
+        if(fstat(fd, &st) == -1 || !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)))
+        {
+            close(fd);
+            return file;
+        }
+
+        file = std::make_shared<FileEntry>();
+        file->ino = st.st_ino;
+        file->mtime = st.st_mtime;
+        if(S_ISDIR(st.st_mode))
+        {
+            file->directory = true;
+            close(fd);
+            return file;
+        }
+
+        file->size = st.st_size;
+        file->type = mime_type(path);
+        file->last_modified = http_date(st.st_mtime);
+
+        char etag[64];
+        snprintf(etag, sizeof(etag), "\"%lx-%lx-%lx\"", static_cast<unsigned long>(st.st_ino),
+                 static_cast<unsigned long>(st.st_size), static_cast<unsigned long>(st.st_mtim.tv_sec * 1000 + st.st_mtim.tv_nsec / 1000000));
+        file->etag = etag;
+
+        if(file->size && file->size <= options_.mmap_limit)
+        {
+            void* map = mmap(NULL, file->size, PROT_READ, MAP_SHARED, fd, 0);
+            if(map != MAP_FAILED)
+            {
+                file->map = map;
+                close(fd);
+                return file;
+            }
+        }
+
+        file->fd = fd;
+        return file;
+    }
+
+    bool fresh(const std::string& path, std::shared_ptr<FileEntry>& file)
+    {
+        struct stat st;
+        if(stat(path.c_str(), &st) == -1)
+            return false;
+
+        //a symlink swapped to another tree shows up as another inode
+        return file->directory ? S_ISDIR(st.st_mode) :
+            (S_ISREG(st.st_mode) && st.st_ino == file->ino && st.st_mtime == file->mtime &&
+             static_cast<size_t>(st.st_size) == file->size);
+    }
+
+    // the absolute path without symlinks, empty when it doesn't exist
+    static std::string resolve(const std::string& path)
+    {
+        std::string out;
+        char* real = realpath(path.c_str(), NULL);
+        if(real)
+        {
+            out = real;
+            free(real);
+        }
+        return out;
+    }
+
+    /* *
+     * watch_dir
+     * called with mutex_ held. files of a directory that is reached through a
+     * symlink below root aren't cached, a swap of that link reports nothing
+     * to the watch on the directory it used to point at.
+     * @param real : dir resolved
+     * @return false when the directory can't be watched
+    */
+    bool watch_dir(const std::string& dir, const std::string& real)
+    {
+        if(real.empty() || resolved_.empty() || real != resolved_ + dir.substr(std::min(root_.size(), dir.size())))
+            return false;
+        if(watched_.count(dir))
+            return true;
+
+        int wd = inotify_add_watch(inotify_, dir.c_str(), IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE |
+                                   IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+        if(wd == -1)
+        {
+            NATSU_LOG_ERROR("static: inotify_add_watch %s failed errno %d", dir.c_str(), errno);
+            return false;
+        }
+
+        watches_[wd] = dir;
+        watched_[dir] = wd;
+        return true;
+    }
+
+    /* *
+     * watch
+     * invalidates cache entries on inotify events and flushes the cache when
+     * root resolves to another directory, eg. a deploy swapped the symlink
+     * root points at. holds the handler only while it handles a wake.
+    */
+    static void watch(std::weak_ptr<StaticFilesImpl> weak, int fd)
+    {
+        alignas(inotify_event) char buf[4096];
+        while(true)
+        {
+            pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            int ret = poll(&pfd, 1, kRootCheck);
+
+            std::shared_ptr<StaticFilesImpl> self = weak.lock();
+            if(!self)
+                return;
+
+            if(ret == -1 && errno != EINTR)
+            {
+                NATSU_LOG_ERROR("static: poll on inotify failed errno %d, revalidating with stat()", errno);
+                self->watching_ = false;
+                return;
+            }
+
+            //a scheduler that can't wait on the descriptor reports it invalid
+            if(ret > 0 && (pfd.revents & POLLNVAL))
+                co_sleep(kWatchInterval);
+
+            ssize_t n;
+            while((n = read(fd, buf, sizeof(buf))) > 0)
+            {
+                std::lock_guard<std::mutex> lock(self->mutex_);
+                for(char* p = buf; p < buf + n; )
+                {
+                    inotify_event* ev = reinterpret_cast<inotify_event*>(p);
+                    p += sizeof(inotify_event) + ev->len;
+                    self->invalidate(ev);
+                }
+            }
+
+            self->check_root();
+        }
+    }
+
+    void check_root()
+    {
+        std::string real = resolve(root_);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(real == resolved_)
+            return;
+
+        //every watch is on the old tree, the IN_IGNORED events that follow find no wd
+        for(auto it = watches_.begin(); it != watches_.end(); ++it)
+            inotify_rm_watch(inotify_, it->first);
+        watches_.clear();
+        watched_.clear();
+        cache_.clear();
+        lru_.clear();
+        resolved_ = real;
+    }
+
+    // called with mutex_ held
+    void invalidate(inotify_event* ev)
+    {
+        if(ev->mask & IN_Q_OVERFLOW)
+        {
+            cache_.clear();
+            lru_.clear();
+            return;
+        }
+
+        auto it = watches_.find(ev->wd);
+        if(it == watches_.end())
+            return;
+
+        std::string dir = it->second;
+        if(ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+        {
+            //the directory itself is gone, forget everything below it
+            std::string prefix = dir + "/";
+            for(auto c = cache_.begin(); c != cache_.end(); )
+            {
+                if(c->first == dir || c->first.compare(0, prefix.size(), prefix) == 0)
+                {
+                    lru_.erase(c->second.lru);
+                    c = cache_.erase(c);
+                }
+                else
+                    ++c;
+            }
+
+            if(ev->mask & IN_IGNORED)
+            {
+                watched_.erase(dir);
+                watches_.erase(it);
+            }
+            return;
+        }
+
+        if(ev->len == 0)
+            return;
+
+        std::string path = (dir == "/" ? dir : dir + "/") + ev->name;
+        erase(path);
+
+        //the source of a precompressed variant holds it
+        if(path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0)
+            erase(path.substr(0, path.size() - 3));
+    }
+
+    // called with mutex_ held
+    void erase(const std::string& path)
+    {
+        auto it = cache_.find(path);
+        if(it != cache_.end())
+        {
+            lru_.erase(it->second.lru);
+            cache_.erase(it);
+        }
+    }
+
+private:
+    std::string root_;
+    StaticFilesOptions options_;
+    int inotify_;
+    std::atomic<bool> watching_;    // false while hits have to be checked with stat()
+
+    std::mutex mutex_;
+    std::string resolved_;          // root_ without symlinks, when the watches were taken
+    std::unordered_map<std::string, CacheItem> cache_;
+    LruList lru_;
+    std::unordered_map<int, std::string> watches_;
+    std::unordered_map<std::string, int> watched_;
+};
+
+StaticFiles::StaticFiles(const std::string& root, const StaticFilesOptions& opts)
+: files_(std::make_shared<StaticFilesImpl>(root, opts))
+{
+    files_->start();
+}
+
+void StaticFiles::operator()(std::shared_ptr<HttpRequest> req, std::shared_ptr<HttpResponse> rsp)
+{
+    files_->serve(req, rsp);
+}
+
+}}
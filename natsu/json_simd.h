@@ -0,0 +1,160 @@
+#ifndef JSON_SIMD_H_
+#define JSON_SIMD_H_
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace natsu {
+namespace json {
+
+/* *
+ * scan_string
+ * the first quote, backslash or control character at or after p, 16 bytes
+ * per step where SSE2 is there. p points into a parser's padded copy of the
+ * input: the NUL ending it stops the scan and a full vector after that NUL is
+ * readable, so loads need no bounds check. inline, a typical string is done
+ * in one or two loads.
+*/
+inline const char* scan_string(const char* p)
+{
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    while(true)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        //unsigned v <= 0x1F exactly where min(v, 0x1F) == v
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                   _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+        int mask = _mm_movemask_epi8(hit);
+        if(mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#else
+    while(*p != '"' && *p != '\\' && static_cast<unsigned char>(*p) >= 0x20)
+        ++p;
+    return p;
+#endif
+}
+
+// the same for the writer over a string of known length: the first byte in
+// [p, end) that needs escaping, end when there is none
+inline const char* find_escape(const char* p, const char* end)
+{
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    while(end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                   _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+        int mask = _mm_movemask_epi8(hit);
+        if(mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+
+    while(p < end && *p != '"' && *p != '\\' && static_cast<unsigned char>(*p) >= 0x20)
+        ++p;
+    return p;
+}
+
+/* *
+ * skip_container
+ * p at the '{' or '[' opening a value, @return just past the bracket that
+ * closes it or NULL at the end of the text. only depth is tracked, whether
+ * brackets pair up or anything else is well formed goes unchecked. with SSE2
+ * a block of 16 bytes is classified at once: a prefix xor of the quote bits
+ * marks what lies inside strings, brackets outside them are then walked bit
+ * by bit. blocks with a backslash and the tail go byte by byte.
+*/
+inline const char* skip_container(const char* p, const char* end)
+{
+    size_t depth = 0;
+    bool in_string = false;
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    const __m128i fold = _mm_set1_epi8(0x20);
+#endif
+    while(p < end)
+    {
+#ifdef __SSE2__
+        if(end - p >= 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            if(!_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)))
+            {
+                //'[' and ']' differ from '{' and '}' only in bit 0x20
+                __m128i folded = _mm_or_si128(v, fold);
+                unsigned quotes = _mm_movemask_epi8(_mm_cmpeq_epi8(v, quote));
+                unsigned opens = _mm_movemask_epi8(_mm_cmpeq_epi8(folded, open));
+                unsigned closes = _mm_movemask_epi8(_mm_cmpeq_epi8(folded, close));
+
+                //bit i set when byte i is inside a string, counting an opening quote in
+                unsigned strings = quotes;
+                strings ^= strings << 1;
+                strings ^= strings << 2;
+                strings ^= strings << 4;
+                strings ^= strings << 8;
+                if(in_string)
+                    strings = ~strings;
+                strings &= 0xFFFF;
+                in_string = (strings >> 15) & 1;
+
+                unsigned brackets = (opens | closes) & ~strings;
+                while(brackets)
+                {
+                    int i = __builtin_ctz(brackets);
+                    if((opens >> i) & 1)
+                        ++depth;
+                    else if(--depth == 0)
+                        return p + i + 1;
+                    brackets &= brackets - 1;
+                }
+                p += 16;
+                continue;
+            }
+        }
+#endif
+        //one block, or what is left, a byte at a time; an escape may end past it
+        const char* stop = (end - p >= 16) ? p + 16 : end;
+        while(p < stop)
+        {
+            char c = *p++;
+            if(in_string)
+            {
+                if(c == '\\')
+                    ++p;
+                else if(c == '"')
+                    in_string = false;
+            }
+            else if(c == '"')
+            {
+                in_string = true;
+            }
+            else if(c == '{' || c == '[')
+            {
+                ++depth;
+            }
+            else if(c == '}' || c == ']')
+            {
+                if(--depth == 0)
+                    return p;
+            }
+        }
+    }
+    return NULL;
+}
+
+}}
+
+#endif
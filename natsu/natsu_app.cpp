@@ -4,12 +4,30 @@
 #include "http_router.h"
 #include "natsu_config.h"
 #include "natsu_rpc.h"
+#include "natsu_log.h"
+#include "natsu_buffer.h"
+#include "natsu_string.h"
+#include "natsu_worker.h"
+#include "natsu_coalesce.h"
+#include "natsu_deadline.h"
+#include "websocket_frame.h"
+#include "http2.h"
+#include <chrono>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <stddef.h>
+#include <poll.h>
+#include <strings.h>
 
 natsu::NatsuConfig kNatsuConfig;
 
 namespace natsu
 {
 
+static const char* kMethodName[] = { "PUT", "GET", "POST", "DELETE" };
+static const char* kTimeoutHeader = "x-request-timeout";
+
 NatsuApp::NatsuApp(std::shared_ptr<natsu::Inject> inject)
 {
     inject_ = inject;
@@ -25,65 +43,183 @@ void NatsuApp::run()
     co_sched.RunUntilNoTask();
 }
 
-void NatsuApp::listen(const std::string& ip, unsigned short port)
+void NatsuApp::listen(const std::string& ip, unsigned short port, const ListenOptions& opts)
 {
-    NatsuConfig::config("local_ipv4", ip);
-    go std::bind(&natsu::NatsuApp::wait, this, port);
-    co_sched.RunUntilNoTask();
+    if (add_listener(ip, port, opts))
+        co_sched.RunUntilNoTask();
 }
 
-void NatsuApp::wait(unsigned short port)
+bool NatsuApp::add_listener(const std::string& ip, unsigned short port, const ListenOptions& opts)
 {
-    sock_ = socket(AF_INET, SOCK_STREAM, 0);
-    int rep = 1;
-    setsockopt( sock_, SOL_SOCKET, SO_REUSEADDR, &rep, sizeof(rep) );
+    sockaddr_storage addr;
+    memset(&addr, 0, sizeof(addr));
+    sockaddr_in* v4 = reinterpret_cast<sockaddr_in*>(&addr);
+    sockaddr_in6* v6 = reinterpret_cast<sockaddr_in6*>(&addr);
+    socklen_t len = 0;
+    const std::string& host = ip.empty() ? std::string("0.0.0.0") : ip;
+    if (inet_pton(AF_INET, host.c_str(), &v4->sin_addr) == 1)
+    {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(port);
+        len = sizeof(sockaddr_in);
 
-    sockaddr_in addr;
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    addr.sin_addr.s_addr = inet_addr("0.0.0.0");
-    socklen_t len = sizeof(addr);
-    if (-1 == bind(sock_, (sockaddr*)&addr, len))
+        //the address providers register to etcd
+        NatsuConfig::config("local_ipv4", host);
+    }
+    else if (inet_pton(AF_INET6, host.c_str(), &v6->sin6_addr) == 1)
     {
-        fprintf(stderr, "bind error: %s\n", strerror(errno));
-        close(sock_);
-        return ;
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(port);
+        len = sizeof(sockaddr_in6);
     }
+    else
+    {
+        NATSU_LOG_ERROR("listen error: invalid address %s", ip.c_str());
+        return false;
+    }
+
+    return open_listener(reinterpret_cast<sockaddr*>(&addr), len, opts);
+}
 
-    if (-1 == ::listen(sock_, 5))
+bool NatsuApp::add_unix_listener(const std::string& path, const ListenOptions& opts)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
     {
-        fprintf(stderr, "listen error: %s\n", strerror(errno));
-        close(sock_);
-        return ;
+        NATSU_LOG_ERROR("listen error: invalid unix path %s", path.c_str());
+        return false;
     }
 
+    //@name is an abstract socket: leading NUL and no trailing one
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    socklen_t len = offsetof(sockaddr_un, sun_path) + path.size();
+    if (path[0] == '@')
+    {
+        addr.sun_path[0] = '\0';
+    }
+    else
+    {
+        struct stat st;
+        if (0 == stat(path.c_str(), &st) && S_ISSOCK(st.st_mode))
+            unlink(path.c_str());
+        len += 1;
+    }
+
+    return open_listener(reinterpret_cast<sockaddr*>(&addr), len, opts);
+}
+
+bool NatsuApp::open_listener(const sockaddr* addr, socklen_t len, const ListenOptions& opts)
+{
+    int family = addr->sa_family;
+    int sock = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1)
+    {
+        NATSU_LOG_ERROR("socket error: %s", strerror(errno));
+        return false;
+    }
+
+    //accepted sockets inherit these, so they cost nothing per connection
+    int on = 1;
+    if (opts.rcvbuf > 0)
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &opts.rcvbuf, sizeof(opts.rcvbuf));
+    if (opts.sndbuf > 0)
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &opts.sndbuf, sizeof(opts.sndbuf));
+
+    if (family != AF_UNIX)
+    {
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (opts.nodelay)
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        if (opts.defer_accept > 0)
+            setsockopt(sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, &opts.defer_accept, sizeof(opts.defer_accept));
+        if (opts.fastopen > 0 &&
+            -1 == setsockopt(sock, IPPROTO_TCP, TCP_FASTOPEN, &opts.fastopen, sizeof(opts.fastopen)))
+            NATSU_LOG_WARN("TCP_FASTOPEN unavailable: %s", strerror(errno));
+    }
+
+    if (-1 == bind(sock, addr, len))
+    {
+        NATSU_LOG_ERROR("bind error: %s", strerror(errno));
+        close(sock);
+        return false;
+    }
+
+    if (-1 == ::listen(sock, opts.backlog))
+    {
+        NATSU_LOG_ERROR("listen error: %s", strerror(errno));
+        close(sock);
+        return false;
+    }
+
+    go std::bind(&natsu::NatsuApp::wait, this, sock, opts.h2c);
+    return true;
+}
+
+// client address without port, unix peers are unnamed
+static std::string peer_address(const sockaddr_storage& addr)
+{
+    char ip[INET6_ADDRSTRLEN] = {0};
+    if (addr.ss_family == AF_INET)
+        inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(&addr)->sin_addr, ip, sizeof(ip));
+    else if (addr.ss_family == AF_INET6)
+        inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6*>(&addr)->sin6_addr, ip, sizeof(ip));
+    else
+        return "unix";
+
+    return ip;
+}
+
+void NatsuApp::wait(int sock, bool h2c)
+{
+    //the listener is nonblocking for us, every wakeup drains the whole backlog
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
     while(true)
     {
-        sockaddr_in addr;
+        sockaddr_storage addr;
         socklen_t len = sizeof(addr);
-        int sockfd = accept(sock_, (sockaddr*)&addr, &len);
+        int sockfd = accept4(sock, (sockaddr*)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (sockfd == -1)
         {
-            if (EAGAIN == errno || EINTR == errno)
+            if (EAGAIN == errno || EWOULDBLOCK == errno)
+            {
+                pfd.revents = 0;
+                poll(&pfd, 1, -1);
+                continue;
+            }
+
+            if (EINTR == errno || ECONNABORTED == errno || EPROTO == errno)
+                continue;
+
+            if (EMFILE == errno || ENFILE == errno || ENOBUFS == errno || ENOMEM == errno)
+            {
+                //out of descriptors or memory, back off instead of spinning
+                NATSU_LOG_ERROR("accept error: %s", strerror(errno));
+                usleep(100 * 1000);
                 continue;
+            }
 
-            fprintf(stderr, "accept error: %s\n", strerror(errno));
+            NATSU_LOG_ERROR("accept error: %s", strerror(errno));
             break ;
         }
 
-        go std::bind(&natsu::NatsuApp::handle, this, sockfd);
+        go std::bind(&natsu::NatsuApp::handle, this, sockfd, peer_address(addr), h2c);
     }
 
-    close(sock_);
+    close(sock);
 }
 
-void NatsuApp::handle(int sockfd)
+void NatsuApp::handle(int sockfd, const std::string& remote, bool h2c)
 {
-    char buf[1024];
+    natsu::ReadBuffer input;
     natsu::http::HttpParser parser;
     while(true)
     {
-        int n = read(sockfd, buf, sizeof(buf));
+        ssize_t n = input.read(sockfd);
         if (n == -1)
         {
             if (EAGAIN == errno || EINTR == errno)
@@ -99,35 +235,44 @@ void NatsuApp::handle(int sockfd)
         }
         else
         {
-            natsu::tribool ret = parser.parse(buf, n);
+            if (h2c)
+            {
+                int preface = natsu::http::http2_preface(input.data(), input.size());
+                if (preface == 0)
+                    continue;
+
+                if (preface == 1)
+                {
+                    //streams are dispatched like HTTP/1 requests, without a socket of their own
+                    natsu::http::serve_http2(sockfd, remote, input,
+                        [this](std::shared_ptr<natsu::http::HttpRequest>& req, std::shared_ptr<natsu::http::HttpResponse>& resp)
+                        {
+                            process(-1, req, resp);
+                        });
+                    return;
+                }
+
+                h2c = false;
+            }
+
+            natsu::tribool ret = parser.parse(input.data(), input.size());
+            input.consume(input.size());
             switch(ret)
             {
             case natsu::failure:
             {
                 close(sockfd);
             }
-            break;
+            return;
 
             case natsu::success:
             {
+                auto start = std::chrono::steady_clock::now();
                 std::shared_ptr<natsu::http::HttpResponse> resp(new natsu::http::HttpResponse());
-                try
-                {
-                    std::shared_ptr<natsu::http::HttpRequest> req = parser.request();
-                    if(inject_) inject_->before(req, resp);
-                    if(resp->empty())
-                    {
-                        natsu::http::HttpRouter::instance().handle(req, resp);
-                        if(inject_) inject_->after(req, resp);
-                    }
-                }
-                catch(...)
-                {
-                    if(inject_)
-                        inject_->fail(parser.request(), resp);
-                    else
-                        resp->response(500);
-                }
+                std::shared_ptr<natsu::http::HttpRequest> req = parser.request();
+                req->remote() = remote;
+                if(!process(sockfd, req, resp))
+                    return;
 
                 std::string buf = resp->str();
                 size_t pos = 0;
@@ -142,10 +287,22 @@ void NatsuApp::handle(int sockfd)
 
                     pos += n;
                 }
-                
+
+                //a streamed body follows the head directly on this socket
+                if(pos == len && resp->streaming())
+                    resp->writer()(sockfd);
+
+                if(natsu::log_enabled(natsu::LOG_ACCESS))
+                {
+                    long long us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+                    NATSU_LOG_ACCESS("%s %s %d %zu %lldus", kMethodName[req->method()],
+                        req->path().c_str(), resp->code(), pos, us);
+                }
+
                 close(sockfd);
             }
-            break;
+            return;
 
             default:
                 break;
@@ -155,10 +312,164 @@ void NatsuApp::handle(int sockfd)
     }
 }
 
+bool NatsuApp::process(int sockfd, std::shared_ptr<natsu::http::HttpRequest>& req, std::shared_ptr<natsu::http::HttpResponse>& resp)
+{
+    try
+    {
+        if(inject_) inject_->before(req, resp);
+        if(resp->empty())
+        {
+            //an upgraded connection belongs to its websocket from here on, HTTP/2 streams never upgrade
+            if(sockfd >= 0 && upgrade(sockfd, req, req->remote()))
+                return false;
+
+            natsu::http::HttpRouter::instance().handle(req, resp);
+            if(inject_) inject_->after(req, resp);
+        }
+    }
+    catch(...)
+    {
+        if(inject_)
+            inject_->fail(req, resp);
+        else
+            resp->response(500);
+    }
+
+    return true;
+}
+
+// runs h under the deadline of the route or the client, whichever comes first.
+// it has to run where h runs, a deadline is kept per coroutine
+static natsu::http::Handler bounded(natsu::http::Handler h, int timeout)
+{
+    return [h, timeout](std::shared_ptr<natsu::http::HttpRequest> req, std::shared_ptr<natsu::http::HttpResponse> resp)
+    {
+        long long ms = timeout > 0 ? timeout : -1;
+        std::string value = req->header(kTimeoutHeader);
+        if(!value.empty())
+        {
+            char* end = NULL;
+            long long client = strtoll(value.c_str(), &end, 10);
+            if(*end == '\0' && client >= 0 && (ms < 0 || client < ms))
+                ms = client;
+        }
+
+        if(ms < 0)
+        {
+            h(req, resp);
+            return;
+        }
+
+        natsu::DeadlineScope scope{std::chrono::milliseconds(ms)};
+        if(natsu::deadline_remaining() == 0)
+        {
+            resp->response(504);
+            return;
+        }
+
+        try
+        {
+            h(req, resp);
+        }
+        catch(const std::exception& e)
+        {
+            if(!natsu::deadline_exceeded(e))
+                throw;
+
+            resp->response(504);
+        }
+    };
+}
+
 void NatsuApp::register_handler(const std::string& pattern, 
-		std::function<void(std::shared_ptr<natsu::http::HttpRequest>,std::shared_ptr<natsu::http::HttpResponse>)> h, natsu::http::Method m)
+		std::function<void(std::shared_ptr<natsu::http::HttpRequest>,std::shared_ptr<natsu::http::HttpResponse>)> h, natsu::http::Method m,
+		const RouteOptions& opts)
+{
+	natsu::http::Handler handler = Workers::instance().offload(bounded(h, opts.timeout), opts.execution);
+	if(opts.coalesce && m == natsu::http::GET)
+		handler = natsu::coalesce(handler);
+
+	natsu::http::HttpRouter::instance().register_handler(pattern, handler, m);
+}
+
+void NatsuApp::register_websocket(const std::string& pattern, natsu::http::WebSocketHandler h,
+    const natsu::http::WebSocketOptions& opts)
+{
+    natsu::http::HttpRouter::instance().register_websocket(pattern, h, opts);
+}
+
+// a comma separated header like Connection holds token, in any case
+static bool has_token(const std::string& list, const char* token)
+{
+    natsu::Tokenizer t(list, ", \t");
+    size_t n = strlen(token);
+    for(natsu::StringView tok; t.next(tok); )
+    {
+        if(tok.size() == n && strncasecmp(tok.data(), token, n) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool NatsuApp::upgrade(int sockfd, std::shared_ptr<natsu::http::HttpRequest>& req, const std::string& remote)
+{
+    if(strcasecmp(req->header("upgrade").c_str(), "websocket") != 0)
+        return false;
+
+    natsu::http::WebSocketRoute* route = natsu::http::HttpRouter::instance().websocket(req->document());
+    if(route == NULL)
+        return false;
+
+    std::string key = req->header("sec-websocket-key");
+    std::string head;
+    bool accepted = false;
+    //RFC 6455 4.2.1, the handshake names the upgrade in Connection too
+    if(req->method() != natsu::http::GET || key.empty() || !has_token(req->header("connection"), "upgrade"))
+    {
+        head = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    }
+    else if(req->header("sec-websocket-version") != "13")
+    {
+        head = "HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\n"
+               "Connection: close\r\nContent-Length: 0\r\n\r\n";
+    }
+    else
+    {
+        head = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+               "Sec-WebSocket-Accept: " + natsu::http::websocket_accept(key) + "\r\n\r\n";
+        accepted = true;
+    }
+
+    bool written = natsu::write_all(sockfd, head.data(), head.size());
+    if(!accepted || !written)
+    {
+        close(sockfd);
+        return true;
+    }
+
+    //a small stack of its own keeps idle websockets cheap
+    std::shared_ptr<natsu::http::WebSocket> ws = std::make_shared<natsu::http::WebSocket>(sockfd, remote, route->options);
+    natsu::http::WebSocketHandler h = route->handler;
+    go_stack(route->options.stack_size) [h, req, ws]
+    {
+        try
+        {
+            h(req, ws);
+        }
+        catch(...)
+        {
+            NATSU_LOG_ERROR("websocket handler of %s failed", req->path().c_str());
+        }
+
+        ws->close();
+    };
+
+    return true;
+}
+
+void NatsuApp::worker_threads(unsigned processors, unsigned pool)
 {
-	natsu::http::HttpRouter::instance().register_handler(pattern, h, m);
+    Workers::instance().threads(processors, pool);
 }
 
 void NatsuApp::provide_service(const std::string& servicename, const std::string& etcdaddr)
@@ -0,0 +1,244 @@
+#include "natsu_buffer.h"
+#include <sys/uio.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <new>
+
+namespace natsu {
+
+static const size_t kMinBlock = 4 * 1024;
+static const int kBlockClasses = 7;
+static const size_t kMaxBlock = kMinBlock << (kBlockClasses - 1);
+static const size_t kCachedBytes = 1024 * 1024;
+static const size_t kSpill = 16 * 1024;
+
+// blocks freed on a thread are handed to the next buffer filled on it.
+// a coroutine may move between threads, a block simply joins the cache of
+// the thread it is released on
+class SlabCache
+{
+public:
+    ~SlabCache()
+    {
+        for(int c = 0; c < kBlockClasses; ++c)
+        {
+            for(size_t i = 0; i < blocks_[c].size(); ++i)
+                ::free(blocks_[c][i]);
+        }
+    }
+
+    // @param size : rounded up to the block size
+    char* alloc(size_t& size)
+    {
+        int c = block_class(size);
+        if(c < 0)
+            return static_cast<char*>(::malloc(size));
+
+        size = kMinBlock << c;
+        if(blocks_[c].empty())
+            return static_cast<char*>(::malloc(size));
+
+        char* p = blocks_[c].back();
+        blocks_[c].pop_back();
+        return p;
+    }
+
+    void free(char* p, size_t size)
+    {
+        int c = block_class(size);
+        if(c < 0 || (blocks_[c].size() + 1) * size > kCachedBytes)
+        {
+            ::free(p);
+            return;
+        }
+
+        blocks_[c].push_back(p);
+    }
+
+private:
+    static int block_class(size_t size)
+    {
+        if(size > kMaxBlock)
+            return -1;
+
+        int c = 0;
+        while((kMinBlock << c) < size)
+            ++c;
+        return c;
+    }
+
+private:
+    std::vector<char*> blocks_[kBlockClasses];
+};
+
+static SlabCache& slab_cache()
+{
+    static thread_local SlabCache cache;
+    return cache;
+}
+
+ReadBuffer::ReadBuffer()
+: buf_(NULL), cap_(0), begin_(0), end_(0), peak_(0), hint_(kMinBlock)
+{
+}
+
+ReadBuffer::~ReadBuffer()
+{
+    if(buf_) slab_cache().free(buf_, cap_);
+}
+
+ssize_t ReadBuffer::read(int fd, int timeout)
+{
+    if(buf_ == NULL)
+    {
+        //hooked poll parks the coroutine, nothing is allocated while idle
+        pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ret = poll(&pfd, 1, timeout);
+        if(ret == 0)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        else if(ret == -1)
+        {
+            return -1;
+        }
+
+        reserve(hint_);
+    }
+    else if(begin_ && end_ == cap_)
+    {
+        memmove(buf_, buf_ + begin_, size());
+        end_ -= begin_;
+        begin_ = 0;
+    }
+
+    char spill[kSpill];
+    size_t tail = cap_ - end_;
+    iovec iov[2];
+    iov[0].iov_base = buf_ + end_;
+    iov[0].iov_len = tail;
+    iov[1].iov_base = spill;
+    iov[1].iov_len = sizeof(spill);
+
+    ssize_t n = readv(fd, iov, 2);
+    if(n <= 0)
+    {
+        if(size() == 0) release();
+        return n;
+    }
+
+    if(static_cast<size_t>(n) <= tail)
+    {
+        end_ += n;
+    }
+    else
+    {
+        //the storage was too small for this burst, the next one gets twice as much
+        end_ = cap_;
+        size_t extra = n - tail;
+        hint_ = std::min(std::max(hint_, cap_) * 2, kMaxBlock);
+        reserve(size() + extra);
+        memcpy(buf_ + end_, spill, extra);
+        end_ += extra;
+    }
+
+    peak_ = std::max(peak_, size());
+    return n;
+}
+
+void ReadBuffer::consume(size_t n)
+{
+    begin_ += std::min(n, size());
+    if(begin_ == end_)
+        release();
+}
+
+void ReadBuffer::reserve(size_t n)
+{
+    if(buf_ && cap_ - begin_ >= n)
+        return;
+
+    if(buf_ && cap_ >= n)
+    {
+        memmove(buf_, buf_ + begin_, size());
+        end_ -= begin_;
+        begin_ = 0;
+        return;
+    }
+
+    size_t cap = std::max(n, hint_);
+    char* buf = slab_cache().alloc(cap);
+    if(buf == NULL)
+        throw std::bad_alloc();
+
+    size_t len = size();
+    if(buf_)
+    {
+        memcpy(buf, buf_ + begin_, len);
+        slab_cache().free(buf_, cap_);
+    }
+
+    buf_ = buf;
+    cap_ = cap;
+    begin_ = 0;
+    end_ = len;
+}
+
+void ReadBuffer::release()
+{
+    if(buf_ == NULL)
+        return;
+
+    //shrink once a whole cycle used little of the storage
+    if(peak_ <= cap_ / 4)
+        hint_ = std::max(cap_ / 2, kMinBlock);
+
+    slab_cache().free(buf_, cap_);
+    buf_ = NULL;
+    cap_ = begin_ = end_ = peak_ = 0;
+}
+
+bool writev_all(int fd, iovec* iov, int count)
+{
+    while(true)
+    {
+        //writev() of empty entries alone returns 0, which would read as an error
+        while(count && iov->iov_len == 0)
+        {
+            ++iov;
+            --count;
+        }
+
+        if(!count)
+            return true;
+
+        ssize_t n = writev(fd, iov, count);
+        if(n == -1 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+
+        while(count && static_cast<size_t>(n) >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+
+        if(count)
+        {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+}
@@ -0,0 +1,71 @@
+#ifndef NATSU_BUFFER_H_
+#define NATSU_BUFFER_H_
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stddef.h>
+
+namespace natsu {
+
+/* *
+ * ReadBuffer
+ * per connection input buffer. storage comes from per-thread slab pools
+ * and goes back as soon as everything read has been consumed, so a
+ * connection waiting for input holds no storage at all.
+ * the next storage size follows the traffic: doubled when a read overflows
+ * it, halved when a whole cycle used less than a quarter of it.
+*/
+class ReadBuffer
+{
+public:
+    ReadBuffer();
+    ~ReadBuffer();
+
+    /* *
+     * read
+     * wait for input without storage, then one readv() into the free tail
+     * plus a stack spill area, so a burst larger than the tail needs no
+     * second call.
+     * @param timeout : milliseconds, -1 waits forever
+     * @return like read(2), -1 with EAGAIN when the timeout expired
+    */
+    ssize_t read(int fd, int timeout = -1);
+
+    const char* data() const { return buf_ + begin_; }
+    size_t size() const { return end_ - begin_; }
+
+    // drop n bytes from the front
+    void consume(size_t n);
+
+    // make room for at least n bytes in total, eg. a packet of known length
+    void reserve(size_t n);
+
+private:
+    ReadBuffer(const ReadBuffer&);
+    ReadBuffer& operator=(const ReadBuffer&);
+
+    void release();
+
+private:
+    char* buf_;
+    size_t cap_;
+    size_t begin_;
+    size_t end_;
+    size_t peak_;   // most bytes held since storage was taken
+    size_t hint_;   // size of the next storage
+};
+
+// writev() until all of iov is out, iov is consumed on the way. false on error
+bool writev_all(int fd, iovec* iov, int count);
+
+inline bool write_all(int fd, const void* p, size_t n)
+{
+    iovec iov;
+    iov.iov_base = const_cast<void*>(p);
+    iov.iov_len = n;
+    return writev_all(fd, &iov, 1);
+}
+
+}
+
+#endif
@@ -0,0 +1,419 @@
+#include "natsu_cache.h"
+#include "natsu_hash.h"
+#include "coroutine.h"
+#include "spinlock.h"
+#include <sched.h>
+#include <time.h>
+#include <exception>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace natsu {
+
+static const size_t kEntryOverhead = 128;   // list and hash nodes, the shared value's control block
+static const size_t kTypicalEntry = 256;    // what the sketch is sized for
+static const size_t kSampleFactor = 10;     // accesses per counter before the sketch halves
+static const int kSpins = 64;               // tries at a shard lock before the thread yields
+
+static int64_t now_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* *
+ * FrequencySketch
+ * count-min sketch of 4 bit counters, 16 to a word, 4 counters per key in
+ * 4 words of one cache line so an access touches a single line. when the
+ * counted accesses reach kSampleFactor per counter every counter is halved,
+ * old popularity fades and the counters never saturate for long.
+*/
+class FrequencySketch
+{
+public:
+    FrequencySketch() : mask_(0), additions_(0), sample_(0) {}
+
+    void resize(size_t entries)
+    {
+        size_t words = 8;
+        while(words * 4 < entries)
+            words <<= 1;
+
+        table_.assign(words, 0);
+        mask_ = words / 8 - 1;
+        additions_ = 0;
+        sample_ = words * 16 * kSampleFactor / 4;
+    }
+
+    unsigned estimate(uint64_t hash) const
+    {
+        uint64_t h = mix(hash);
+        const uint64_t* line = &table_[((h >> 32) & mask_) * 8];
+        unsigned min = 15;
+        for(int i = 0; i < 4; ++i)
+        {
+            unsigned c = (line[word(h, i)] >> shift(h, i)) & 15;
+            if(c < min)
+                min = c;
+        }
+        return min;
+    }
+
+    void add(uint64_t hash)
+    {
+        uint64_t h = mix(hash);
+        uint64_t* line = &table_[((h >> 32) & mask_) * 8];
+        bool added = false;
+        for(int i = 0; i < 4; ++i)
+        {
+            uint64_t& w = line[word(h, i)];
+            unsigned s = shift(h, i);
+            if(((w >> s) & 15) != 15)
+            {
+                w += 1ULL << s;
+                added = true;
+            }
+        }
+
+        if(added && ++additions_ >= sample_)
+        {
+            for(auto& w : table_)
+                w = (w >> 1) & 0x7777777777777777ULL;
+            additions_ /= 2;
+        }
+    }
+
+private:
+    //the shard was picked by the low bits, the sketch mixes the whole hash again
+    static uint64_t mix(uint64_t hash)
+    {
+        uint64_t x = hash * 0x9E3779B97F4A7C15ULL;
+        return x ^ (x >> 29);
+    }
+
+    // counter i lives in word 2i or 2i + 1 of the line, at one of 16 nibbles
+    static size_t word(uint64_t h, int i) { return i * 2 + ((h >> (16 + i)) & 1); }
+    static unsigned shift(uint64_t h, int i) { return ((h >> (i * 4)) & 15) * 4; }
+
+private:
+    std::vector<uint64_t> table_;
+    uint64_t mask_;
+    size_t additions_;
+    size_t sample_;
+};
+
+// LFLock alone spins without end, a holder preempted while other threads
+// spin on its shard would cost them a whole time slice. a few tries, then
+// the thread gives way; sections are short and no coroutine ever parks here.
+class ShardLock
+{
+public:
+    void lock()
+    {
+        for(int i = 0; !lock_.try_lock(); ++i)
+        {
+            if(i >= kSpins)
+                sched_yield();
+        }
+    }
+
+    void unlock() { lock_.unlock(); }
+
+private:
+    co::LFLock lock_;
+};
+
+struct CacheEntry
+{
+    std::string key;
+    std::shared_ptr<const std::string> value;
+    uint64_t hash;
+    int64_t expire;     // now_ms() deadline, 0 never
+    size_t charge;
+};
+
+// one running loader and the callers waiting for it
+struct CacheFlight
+{
+    std::vector<co_chan<void>> waiters;
+    std::shared_ptr<const std::string> value;
+    std::exception_ptr error;
+};
+
+struct Cache::Shard
+{
+    typedef std::list<CacheEntry>::iterator Iterator;
+
+    Shard()
+    : used(0), budget(0), admission(true), hits(0), misses(0), evictions(0), rejections(0) {}
+
+    // called with lock held
+    std::shared_ptr<const std::string> lookup(const std::string& key, uint64_t hash, int64_t now)
+    {
+        if(admission)
+            sketch.add(hash);
+
+        auto it = index.find(key);
+        if(it == index.end())
+        {
+            ++misses;
+            return NULL;
+        }
+
+        if(it->second->expire && it->second->expire <= now)
+        {
+            remove(it->second);
+            ++misses;
+            return NULL;
+        }
+
+        lru.splice(lru.begin(), lru, it->second);
+        ++hits;
+        return it->second->value;
+    }
+
+    // called with lock held
+    bool insert(const std::string& key, uint64_t hash, std::shared_ptr<const std::string> value,
+                int64_t ttl, int64_t now)
+    {
+        size_t charge = key.size() * 2 + value->size() + kEntryOverhead;
+        auto it = index.find(key);
+        if(charge > budget)
+        {
+            //the old value would be stale now
+            if(it != index.end())
+                remove(it->second);
+            ++rejections;
+            return false;
+        }
+
+        int64_t expire = ttl > 0 ? now + ttl : 0;
+        if(it != index.end())
+        {
+            CacheEntry& e = *it->second;
+            used = used - e.charge + charge;
+            e.value = value;
+            e.expire = expire;
+            e.charge = charge;
+            lru.splice(lru.begin(), lru, it->second);
+            while(used > budget)
+                evict();
+            return true;
+        }
+
+        //admission is decided once against the first victim, as Caffeine does,
+        //then as many entries go as the new one needs. an expired victim is no contest
+        if(used + charge > budget && admission)
+        {
+            CacheEntry& victim = lru.back();
+            bool expired = victim.expire && victim.expire <= now;
+            if(!expired && sketch.estimate(hash) <= sketch.estimate(victim.hash))
+            {
+                ++rejections;
+                return false;
+            }
+        }
+
+        while(used + charge > budget)
+            evict();
+
+        CacheEntry e;
+        e.key = key;
+        e.value = value;
+        e.hash = hash;
+        e.expire = expire;
+        e.charge = charge;
+        lru.push_front(std::move(e));
+        index[key] = lru.begin();
+        used += charge;
+        return true;
+    }
+
+    void evict()
+    {
+        remove(--lru.end());
+        ++evictions;
+    }
+
+    void remove(Iterator it)
+    {
+        used -= it->charge;
+        index.erase(it->key);
+        lru.erase(it);
+    }
+
+    ShardLock lock;
+    std::list<CacheEntry> lru;  // most recently used first
+    std::unordered_map<std::string, Iterator> index;
+    std::unordered_map<std::string, std::shared_ptr<CacheFlight>> flights;
+    FrequencySketch sketch;
+    size_t used;
+    size_t budget;
+    bool admission;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t rejections;
+};
+
+Cache::Cache(const CacheOptions& opts)
+: ttl_(opts.ttl)
+{
+    size_t n = 1;
+    while(n < opts.shards)
+        n <<= 1;
+
+    shards_ = new Shard[n];
+    mask_ = n - 1;
+    for(size_t i = 0; i < n; ++i)
+    {
+        shards_[i].budget = opts.capacity / n;
+        shards_[i].admission = opts.admission;
+        if(opts.admission)
+            shards_[i].sketch.resize(shards_[i].budget / kTypicalEntry);
+    }
+}
+
+Cache::~Cache()
+{
+    delete[] shards_;
+}
+
+Cache::Shard& Cache::shard(uint64_t hash)
+{
+    return shards_[hash & mask_];
+}
+
+std::shared_ptr<const std::string> Cache::get(const std::string& key)
+{
+    uint64_t hash = xxhash64(key.data(), key.size());
+    int64_t now = now_ms();
+    Shard& s = shard(hash);
+    std::lock_guard<ShardLock> lock(s.lock);
+    return s.lookup(key, hash, now);
+}
+
+bool Cache::get(const std::string& key, std::string& value)
+{
+    std::shared_ptr<const std::string> v = get(key);
+    if(!v)
+        return false;
+
+    value = *v;
+    return true;
+}
+
+bool Cache::set(const std::string& key, const std::string& value, int64_t ttl)
+{
+    uint64_t hash = xxhash64(key.data(), key.size());
+    int64_t now = now_ms();
+    std::shared_ptr<const std::string> v = std::make_shared<const std::string>(value);
+    Shard& s = shard(hash);
+    std::lock_guard<ShardLock> lock(s.lock);
+    if(s.admission)
+        s.sketch.add(hash);
+    return s.insert(key, hash, v, effective_ttl(ttl), now);
+}
+
+void Cache::erase(const std::string& key)
+{
+    uint64_t hash = xxhash64(key.data(), key.size());
+    Shard& s = shard(hash);
+    std::lock_guard<ShardLock> lock(s.lock);
+    auto it = s.index.find(key);
+    if(it != s.index.end())
+        s.remove(it->second);
+}
+
+void Cache::clear()
+{
+    for(size_t i = 0; i <= mask_; ++i)
+    {
+        //values go out of scope after the lock, freeing them may take a while
+        std::list<CacheEntry> lru;
+        {
+            std::lock_guard<ShardLock> lock(shards_[i].lock);
+            lru.swap(shards_[i].lru);
+            shards_[i].index.clear();
+            shards_[i].used = 0;
+        }
+    }
+}
+
+std::shared_ptr<const std::string> Cache::get_or_load(const std::string& key, const Loader& loader, int64_t ttl)
+{
+    uint64_t hash = xxhash64(key.data(), key.size());
+    Shard& s = shard(hash);
+    std::shared_ptr<CacheFlight> flight;
+    {
+        std::unique_lock<ShardLock> lock(s.lock);
+        std::shared_ptr<const std::string> value = s.lookup(key, hash, now_ms());
+        if(value)
+            return value;
+
+        auto it = s.flights.find(key);
+        if(it != s.flights.end())
+        {
+            flight = it->second;
+            co_chan<void> done(1);
+            flight->waiters.push_back(done);
+            lock.unlock();
+
+            done >> nullptr;
+            if(flight->error)
+                std::rethrow_exception(flight->error);
+            return flight->value;
+        }
+
+        flight = std::make_shared<CacheFlight>();
+        s.flights[key] = flight;
+    }
+
+    try
+    {
+        std::string value;
+        if(loader(key, value))
+            flight->value = std::make_shared<const std::string>(std::move(value));
+    }
+    catch(...)
+    {
+        flight->error = std::current_exception();
+    }
+
+    {
+        //callers arriving from now on find the value or start a new load
+        std::lock_guard<ShardLock> lock(s.lock);
+        if(flight->value)
+            s.insert(key, hash, flight->value, effective_ttl(ttl), now_ms());
+        s.flights.erase(key);
+    }
+
+    for(size_t i = 0; i < flight->waiters.size(); ++i)
+        flight->waiters[i] << nullptr;
+
+    if(flight->error)
+        std::rethrow_exception(flight->error);
+    return flight->value;
+}
+
+CacheStats Cache::stats()
+{
+    CacheStats st = CacheStats();
+    for(size_t i = 0; i <= mask_; ++i)
+    {
+        Shard& s = shards_[i];
+        std::lock_guard<ShardLock> lock(s.lock);
+        st.hits += s.hits;
+        st.misses += s.misses;
+        st.evictions += s.evictions;
+        st.rejections += s.rejections;
+        st.entries += s.index.size();
+        st.bytes += s.used;
+    }
+    return st;
+}
+
+}
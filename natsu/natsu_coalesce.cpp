@@ -0,0 +1,112 @@
+#include "natsu_coalesce.h"
+#include "coroutine.h"
+#include <mutex>
+#include <vector>
+#include <exception>
+#include <unordered_map>
+
+namespace natsu {
+
+// one running handler call and the requests waiting for it
+struct Flight
+{
+    Flight() : shared(false) {}
+
+    std::vector<co_chan<void>> waiters;
+    http::HttpResponse response;
+    std::exception_ptr error;
+    bool shared;
+};
+
+// requests share a run only when they also agree on who asks and what
+// encoding they take, a reply for one user must never reach another
+static const char* const kKeyHeaders[] = { "authorization", "cookie", "accept-encoding" };
+
+static std::string flight_key(http::HttpRequest& req)
+{
+    std::string key = req.path();
+    for(size_t i = 0; i < sizeof(kKeyHeaders) / sizeof(kKeyHeaders[0]); ++i)
+    {
+        key.push_back('\0');
+        key.append(req.header(kKeyHeaders[i]));
+    }
+
+    return key;
+}
+
+class FlightGroup
+{
+public:
+    FlightGroup(http::Handler h) : handler_(h) {}
+
+    void call(std::shared_ptr<http::HttpRequest>& req, std::shared_ptr<http::HttpResponse>& rsp)
+    {
+        std::string key = flight_key(*req);
+        std::shared_ptr<Flight> flight;
+        co_chan<void> done(1);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = flights_.find(key);
+        if(it != flights_.end())
+        {
+            flight = it->second;
+            flight->waiters.push_back(done);
+            lock.unlock();
+
+            done >> nullptr;
+            if(flight->error)
+                std::rethrow_exception(flight->error);
+            if(flight->shared)
+                rsp->assign(flight->response);
+            else
+                handler_(req, rsp);
+            return;
+        }
+
+        flight = std::make_shared<Flight>();
+        flights_[key] = flight;
+        lock.unlock();
+
+        try
+        {
+            handler_(req, rsp);
+        }
+        catch(...)
+        {
+            flight->error = std::current_exception();
+        }
+
+        if(!flight->error && !rsp->streaming())
+        {
+            flight->response.assign(*rsp);
+            flight->shared = true;
+        }
+
+        //requests arriving from now on start a new flight
+        lock.lock();
+        flights_.erase(key);
+        lock.unlock();
+
+        for(size_t i = 0; i < flight->waiters.size(); ++i)
+            flight->waiters[i] << nullptr;
+
+        if(flight->error)
+            std::rethrow_exception(flight->error);
+    }
+
+private:
+    http::Handler handler_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+};
+
+http::Handler coalesce(http::Handler h)
+{
+    std::shared_ptr<FlightGroup> group = std::make_shared<FlightGroup>(h);
+    return [group](std::shared_ptr<http::HttpRequest> req, std::shared_ptr<http::HttpResponse> rsp)
+    {
+        group->call(req, rsp);
+    };
+}
+
+}
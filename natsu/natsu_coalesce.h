@@ -0,0 +1,19 @@
+#ifndef NATSU_COALESCE_H_
+#define NATSU_COALESCE_H_
+
+#include "http_router.h"
+
+namespace natsu {
+
+/* *
+ * coalesce
+ * wrap h so that concurrent requests for the same path and query run it
+ * once. the first one calls h, the others park until it returned and get
+ * a copy of its response, or its exception.
+ * streamed responses can't be replayed, waiters then call h themselves.
+*/
+http::Handler coalesce(http::Handler h);
+
+}
+
+#endif
@@ -1,21 +1,279 @@
 #include "natsu_config.h"
-#include <string>
-#include <map>
+#include "coroutine.h"
+#include "natsu_log.h"
+#include <sys/inotify.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <unistd.h>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <vector>
 
 namespace natsu{
 
-static std::map<std::string,std::string> kNatsuConfig;
+static const int kWatchInterval = 1000;  // ms between polls when the scheduler can't wait on inotify
+
+struct ConfigState
+{
+    ConfigState()
+    : version(1), current(std::make_shared<ConfigSnapshot>(std::map<std::string, std::string>(), 1)) {}
+
+    //readers use only these two, current through std::atomic_load
+    std::atomic<uint64_t> version;
+    std::shared_ptr<const ConfigSnapshot> current;
+
+    //everything below is guarded by mutex, writers only
+    std::mutex mutex;
+    std::map<std::string, std::string> loaded;
+    std::map<std::string, std::string> overrides;
+    std::vector<std::function<void(const ConfigSnapshot&)>> listeners;
+};
+
+static ConfigState& state()
+{
+    static ConfigState* s = new ConfigState;  // never destroyed, threads may read during exit
+    return *s;
+}
+
+struct LocalSnapshot
+{
+    uint64_t version = 0;
+    std::shared_ptr<const ConfigSnapshot> snapshot;
+};
+
+static thread_local LocalSnapshot kLocal;
+
+static std::string trim(const std::string& s)
+{
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if(b == std::string::npos)
+        return std::string();
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+// called with mutex held, @return the new snapshot
+static std::shared_ptr<const ConfigSnapshot> publish(ConfigState& s)
+{
+    std::map<std::string, std::string> values = s.loaded;
+    for(auto& kv : s.overrides)
+        values[kv.first] = kv.second;
+
+    uint64_t version = s.version.load(std::memory_order_relaxed) + 1;
+    std::shared_ptr<const ConfigSnapshot> snap = std::make_shared<ConfigSnapshot>(values, version);
+
+    //the snapshot is in place before any reader can see the version move
+    std::atomic_store(&s.current, snap);
+    s.version.store(version, std::memory_order_release);
+    return snap;
+}
+
+ConfigSnapshot::ConfigSnapshot(const std::map<std::string, std::string>& values, uint64_t version)
+: version_(version)
+{
+    for(auto& kv : values)
+    {
+        Entry e;
+        e.value = kv.second;
+        const char* v = e.value.c_str();
+        char* end;
+
+        errno = 0;
+        e.int_ = strtoll(v, &end, 10);
+        e.is_int = (*v && !*end && errno == 0);
+
+        errno = 0;
+        e.double_ = strtod(v, &end);
+        e.is_double = (*v && !*end && errno == 0);
+
+        e.is_bool = true;
+        if(!strcasecmp(v, "true") || !strcasecmp(v, "yes") || !strcasecmp(v, "on") || !strcmp(v, "1"))
+            e.bool_ = true;
+        else if(!strcasecmp(v, "false") || !strcasecmp(v, "no") || !strcasecmp(v, "off") || !strcmp(v, "0"))
+            e.bool_ = false;
+        else
+            e.is_bool = false;
+
+        entries_.emplace(kv.first, std::move(e));
+    }
+}
+
+const std::string* ConfigSnapshot::find(const char* k) const
+{
+    auto it = entries_.find(k);
+    return it != entries_.end() ? &it->second.value : NULL;
+}
+
+std::string ConfigSnapshot::get(const char* k, const std::string& def) const
+{
+    auto it = entries_.find(k);
+    return it != entries_.end() ? it->second.value : def;
+}
+
+int64_t ConfigSnapshot::get_int(const char* k, int64_t def) const
+{
+    auto it = entries_.find(k);
+    return it != entries_.end() && it->second.is_int ? it->second.int_ : def;
+}
+
+double ConfigSnapshot::get_double(const char* k, double def) const
+{
+    auto it = entries_.find(k);
+    return it != entries_.end() && it->second.is_double ? it->second.double_ : def;
+}
+
+bool ConfigSnapshot::get_bool(const char* k, bool def) const
+{
+    auto it = entries_.find(k);
+    return it != entries_.end() && it->second.is_bool ? it->second.bool_ : def;
+}
+
+std::shared_ptr<const ConfigSnapshot> NatsuConfig::snapshot()
+{
+    //nothing here yields, the coroutine can't change threads between the check and the copy
+    ConfigState& s = state();
+    LocalSnapshot& local = kLocal;
+    if(local.version != s.version.load(std::memory_order_acquire))
+    {
+        local.snapshot = std::atomic_load(&s.current);
+        local.version = local.snapshot->version();
+    }
+    return local.snapshot;
+}
 
 void NatsuConfig::config(const std::string& k, const std::string& v)
 {
-	kNatsuConfig[k] = v;
+    ConfigState& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.overrides[k] = v;
+    publish(s);
 }
 
 std::string NatsuConfig::config(const std::string& k)
 {
-	if(kNatsuConfig.find(k) != kNatsuConfig.end())
-		return kNatsuConfig[k];
-	return "";
+    return snapshot()->get(k.c_str());
+}
+
+bool NatsuConfig::load(const std::string& path)
+{
+    std::ifstream in(path.c_str());
+    if(!in)
+    {
+        NATSU_LOG_ERROR("config: can't read %s", path.c_str());
+        return false;
+    }
+
+    std::map<std::string, std::string> values;
+    std::string line;
+    int lineno = 0;
+    while(std::getline(in, line))
+    {
+        ++lineno;
+        line = trim(line);
+        if(line.empty() || line[0] == '#')
+            continue;
+
+        size_t eq = line.find('=');
+        if(eq == std::string::npos)
+        {
+            NATSU_LOG_ERROR("config: %s:%d has no '=', skipped", path.c_str(), lineno);
+            continue;
+        }
+        values[trim(line.substr(0, eq))] = trim(line.substr(eq + 1));
+    }
+
+    ConfigState& s = state();
+    std::shared_ptr<const ConfigSnapshot> snap;
+    std::vector<std::function<void(const ConfigSnapshot&)>> listeners;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.loaded.swap(values);
+        snap = publish(s);
+        listeners = s.listeners;
+    }
+
+    NATSU_LOG_INFO("config: loaded %s, version %llu", path.c_str(), static_cast<unsigned long long>(snap->version()));
+    for(auto& fn : listeners)
+        fn(*snap);
+    return true;
+}
+
+bool NatsuConfig::watch(const std::string& path)
+{
+    if(!load(path))
+        return false;
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(fd == -1)
+    {
+        NATSU_LOG_ERROR("config: inotify_init1 failed errno %d, %s won't reload", errno, path.c_str());
+        return false;
+    }
+
+    //editors and deploy tools replace the file, so the directory is watched
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    if(inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) == -1)
+    {
+        NATSU_LOG_ERROR("config: inotify_add_watch %s failed errno %d", dir.c_str(), errno);
+        close(fd);
+        return false;
+    }
+
+    go [fd, path, name]{
+        alignas(inotify_event) char buf[4096];
+        while(true)
+        {
+            pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            int ret = poll(&pfd, 1, -1);
+            if(ret == -1)
+            {
+                if(errno == EINTR)
+                    continue;
+
+                NATSU_LOG_ERROR("config: poll on inotify failed errno %d, %s won't reload", errno, path.c_str());
+                close(fd);
+                return;
+            }
+            if(ret == 0)
+                continue;
+
+            //a scheduler that can't wait on the descriptor reports it invalid
+            if(pfd.revents & POLLNVAL)
+                co_sleep(kWatchInterval);
+
+            bool changed = false;
+            ssize_t n;
+            while((n = read(fd, buf, sizeof(buf))) > 0)
+            {
+                for(char* p = buf; p < buf + n; )
+                {
+                    inotify_event* ev = reinterpret_cast<inotify_event*>(p);
+                    p += sizeof(inotify_event) + ev->len;
+                    if(ev->len && name == ev->name)
+                        changed = true;
+                }
+            }
+
+            if(changed)
+                load(path);
+        }
+    };
+    return true;
+}
+
+void NatsuConfig::on_reload(std::function<void(const ConfigSnapshot&)> fn)
+{
+    ConfigState& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.listeners.push_back(fn);
 }
 
 }
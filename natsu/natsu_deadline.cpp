@@ -0,0 +1,64 @@
+#include "natsu_deadline.h"
+#include "coroutine.h"
+#include <system_error>
+#include <algorithm>
+
+namespace natsu {
+
+// plain threads of the pool have no task to carry it
+static thread_local Deadline kThreadDeadline = Deadline::max();
+
+static void set_deadline(Deadline d)
+{
+    if(co_sched.IsCoroutine())
+        co_sched.SetCurrentTaskDeadline(d);
+    else
+        kThreadDeadline = d;
+}
+
+Deadline deadline()
+{
+    if(co_sched.IsCoroutine())
+        return co_sched.GetCurrentTaskDeadline();
+
+    return kThreadDeadline;
+}
+
+int deadline_remaining()
+{
+    Deadline d = deadline();
+    if(d == Deadline::max())
+        return -1;
+
+    auto now = std::chrono::steady_clock::now();
+    if(d <= now)
+        return 0;
+
+    //rounded up, a wait of 0 would not wait at all
+    return std::chrono::duration_cast<std::chrono::milliseconds>(d - now + std::chrono::microseconds(999)).count();
+}
+
+bool deadline_exceeded(const std::exception& e)
+{
+    const std::system_error* error = dynamic_cast<const std::system_error*>(&e);
+    return error && error->code() == co::MakeCoErrorCode(co::eCoErrorCode::ec_deadline_exceeded);
+}
+
+DeadlineScope::DeadlineScope(Deadline d)
+: saved_(deadline())
+{
+    set_deadline(std::min(saved_, d));
+}
+
+DeadlineScope::DeadlineScope(std::chrono::milliseconds timeout)
+: saved_(deadline())
+{
+    set_deadline(std::min(saved_, std::chrono::steady_clock::now() + timeout));
+}
+
+DeadlineScope::~DeadlineScope()
+{
+    set_deadline(saved_);
+}
+
+}
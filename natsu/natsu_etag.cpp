@@ -0,0 +1,77 @@
+#include "natsu_etag.h"
+#include "natsu_hash.h"
+#include <stdio.h>
+
+namespace natsu {
+
+std::string make_etag(const std::string& body)
+{
+    char buf[24];
+    snprintf(buf, sizeof(buf), "\"%016llx\"", static_cast<unsigned long long>(xxhash64(body.data(), body.size())));
+    return buf;
+}
+
+bool etag_matches(const std::string& if_none_match, const std::string& etag)
+{
+    size_t begin = 0;
+    while(begin < if_none_match.size())
+    {
+        size_t end = if_none_match.find(',', begin);
+        if(end == std::string::npos)
+            end = if_none_match.size();
+
+        size_t first = if_none_match.find_first_not_of(" \t", begin);
+        size_t last = if_none_match.find_last_not_of(" \t", end - 1);
+        if(first < end && last >= first)
+        {
+            if(if_none_match.compare(first, 2, "W/") == 0)
+                first += 2;
+            if(if_none_match.compare(first, last - first + 1, "*") == 0 ||
+               if_none_match.compare(first, last - first + 1, etag) == 0)
+                return true;
+        }
+
+        begin = end + 1;
+    }
+
+    return false;
+}
+
+ETagInject::ETagInject(std::shared_ptr<Inject> next)
+: next_(next)
+{
+}
+
+void ETagInject::before(std::shared_ptr<natsu::http::HttpRequest>& req,
+                        std::shared_ptr<natsu::http::HttpResponse>& rsp)
+{
+    if(next_) next_->before(req, rsp);
+}
+
+void ETagInject::after(std::shared_ptr<natsu::http::HttpRequest>& req,
+                       std::shared_ptr<natsu::http::HttpResponse>& rsp)
+{
+    if(next_) next_->after(req, rsp);
+
+    if(req->method() != natsu::http::GET || rsp->code() != 200 || rsp->streaming() ||
+       rsp->header("ETag").size())
+        return;
+
+    std::string etag = make_etag(rsp->body());
+    rsp->header("ETag", etag);
+
+    std::string inm = req->header("if-none-match");
+    if(inm.size() && etag_matches(inm, etag))
+        rsp->response(304);
+}
+
+void ETagInject::fail(std::shared_ptr<natsu::http::HttpRequest>& req,
+                      std::shared_ptr<natsu::http::HttpResponse>& rsp)
+{
+    if(next_)
+        next_->fail(req, rsp);
+    else
+        rsp->response(500);
+}
+
+}
@@ -0,0 +1,213 @@
+#ifndef NATSU_FORMAT_H_
+#define NATSU_FORMAT_H_
+
+#include "natsu_number.h"
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+/* *
+ * typed formatting
+ * "{}" stands for the next argument, "{{" and "}}" for literal braces:
+ *
+ *     NATSU_FORMAT_TO(out, "*{}\r\n${}\r\n{}\r\n", n, cmd.size(), cmd);
+ *     std::string url = NATSU_FORMAT("http://{}/v2/keys/{}", addr, key);
+ *     char id[24];
+ *     NATSU_FORMAT_BUF(id, sizeof(id), "{}", generate());
+ *
+ * the macros count the placeholders of a literal format at compile time and
+ * refuse to build when they don't match the arguments. arguments are
+ * integers, bool, char, float, double, const char* and std::string; any
+ * other type doesn't compile. integers go through format_int, doubles print
+ * like the JSON writer's. the _TO form appends to a string the caller keeps,
+ * the _BUF form writes a stack buffer, neither allocates on its own.
+*/
+#define NATSU_FORMAT(fmt, ...) \
+    ::natsu::format_checked< ::natsu::format_arity(fmt)>(fmt, ##__VA_ARGS__)
+#define NATSU_FORMAT_TO(out, fmt, ...) \
+    ::natsu::format_to_checked< ::natsu::format_arity(fmt)>(out, fmt, ##__VA_ARGS__)
+#define NATSU_FORMAT_BUF(buf, size, fmt, ...) \
+    ::natsu::format_buf_checked< ::natsu::format_arity(fmt)>(buf, size, fmt, ##__VA_ARGS__)
+
+namespace natsu {
+
+// placeholders in fmt, -1 for a lone brace
+constexpr int format_arity(const char* fmt)
+{
+    int n = 0;
+    for(; *fmt; ++fmt)
+    {
+        if(*fmt == '{')
+        {
+            if(fmt[1] == '}')
+                ++n;
+            else if(fmt[1] != '{')
+                return -1;
+            ++fmt;
+        }
+        else if(*fmt == '}')
+        {
+            if(fmt[1] != '}')
+                return -1;
+            ++fmt;
+        }
+    }
+    return n;
+}
+
+namespace format_detail {
+
+struct StringSink
+{
+    explicit StringSink(std::string& s) : out(s) {}
+    void put(const char* p, size_t n) { out.append(p, n); }
+
+    std::string& out;
+};
+
+// keeps what fits, counts all of it like snprintf
+struct ArraySink
+{
+    ArraySink(char* b, size_t cap) : p(b), left(cap), need(0) {}
+    void put(const char* s, size_t n)
+    {
+        size_t k = n < left ? n : left;
+        memcpy(p, s, k);
+        p += k;
+        left -= k;
+        need += n;
+    }
+
+    char* p;
+    size_t left;
+    size_t need;
+};
+
+template<class Sink> void arg(Sink& s, const char* v) { s.put(v, strlen(v)); }
+template<class Sink> void arg(Sink& s, const std::string& v) { s.put(v.data(), v.size()); }
+template<class Sink> void arg(Sink& s, char v) { s.put(&v, 1); }
+template<class Sink> void arg(Sink& s, bool v) { v ? s.put("true", 4) : s.put("false", 5); }
+
+template<class Sink> void signed_arg(Sink& s, int64_t v) { char b[24]; s.put(b, format_int(v, b)); }
+template<class Sink> void unsigned_arg(Sink& s, uint64_t v) { char b[24]; s.put(b, format_uint(v, b)); }
+template<class Sink> void arg(Sink& s, int v) { signed_arg(s, v); }
+template<class Sink> void arg(Sink& s, long v) { signed_arg(s, v); }
+template<class Sink> void arg(Sink& s, long long v) { signed_arg(s, v); }
+template<class Sink> void arg(Sink& s, unsigned v) { unsigned_arg(s, v); }
+template<class Sink> void arg(Sink& s, unsigned long v) { unsigned_arg(s, v); }
+template<class Sink> void arg(Sink& s, unsigned long long v) { unsigned_arg(s, v); }
+
+template<class Sink>
+void arg(Sink& s, double v)
+{
+    if(isnan(v))
+        return s.put("nan", 3);
+    if(isinf(v))
+        return v < 0 ? s.put("-inf", 4) : s.put("inf", 3);
+
+    char b[32];
+    s.put(b, format_double(v, b));
+}
+
+template<class Sink> void arg(Sink& s, float v) { arg(s, static_cast<double>(v)); }
+
+// the text up to the next placeholder, @return past it or at the NUL
+template<class Sink>
+const char* literal(Sink& s, const char* fmt)
+{
+    while(true)
+    {
+        const char* p = fmt;
+        while(*p && *p != '{' && *p != '}')
+            ++p;
+        s.put(fmt, p - fmt);
+
+        if(!*p)
+            return p;
+        if(*p == '{' && p[1] == '}')
+            return p + 2;
+
+        //a doubled brace stands for one, a lone one in an unchecked format for itself
+        s.put(p, 1);
+        fmt = p + (p[1] == *p ? 2 : 1);
+    }
+}
+
+template<class Sink>
+void run(Sink& s, const char* fmt)
+{
+    literal(s, fmt);
+}
+
+template<class Sink, class T, class... Rest>
+void run(Sink& s, const char* fmt, const T& first, const Rest&... rest)
+{
+    fmt = literal(s, fmt);
+    arg(s, first);
+    run(s, fmt, rest...);
+}
+
+template<int Arity, int Args>
+struct Check
+{
+    static_assert(Arity >= 0, "format string has a lone '{' or '}'");
+    static_assert(Arity < 0 || Arity == Args, "format string placeholders don't match the arguments");
+};
+
+}
+
+// appends to out, the macro form checks fmt
+template<class... Args>
+void format_to(std::string& out, const char* fmt, const Args&... args)
+{
+    format_detail::StringSink s(out);
+    format_detail::run(s, fmt, args...);
+}
+
+// at most size - 1 bytes and a NUL, @return the length untruncated output would have
+template<class... Args>
+size_t format_buf(char* buf, size_t size, const char* fmt, const Args&... args)
+{
+    if(size == 0)
+        return 0;
+
+    format_detail::ArraySink s(buf, size - 1);
+    format_detail::run(s, fmt, args...);
+    *s.p = '\0';
+    return s.need;
+}
+
+template<class... Args>
+std::string format(const char* fmt, const Args&... args)
+{
+    std::string out;
+    format_to(out, fmt, args...);
+    return out;
+}
+
+template<int Arity, class... Args>
+std::string format_checked(const char* fmt, const Args&... args)
+{
+    format_detail::Check<Arity, sizeof...(Args)>();
+    return format(fmt, args...);
+}
+
+template<int Arity, class... Args>
+void format_to_checked(std::string& out, const char* fmt, const Args&... args)
+{
+    format_detail::Check<Arity, sizeof...(Args)>();
+    format_to(out, fmt, args...);
+}
+
+template<int Arity, class... Args>
+size_t format_buf_checked(char* buf, size_t size, const char* fmt, const Args&... args)
+{
+    format_detail::Check<Arity, sizeof...(Args)>();
+    return format_buf(buf, size, fmt, args...);
+}
+
+}
+
+#endif
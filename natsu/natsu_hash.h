@@ -0,0 +1,17 @@
+#ifndef NATSU_HASH_H_
+#define NATSU_HASH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace natsu {
+
+// XXH64, fast non cryptographic hash of len bytes
+uint64_t xxhash64(const void* data, size_t len, uint64_t seed = 0);
+
+// SHA-1, only where a protocol demands it (websocket handshake)
+void sha1(const void* data, size_t len, unsigned char digest[20]);
+
+}
+
+#endif
@@ -0,0 +1,760 @@
+#include "natsu_json.h"
+#include "json_simd.h"
+#include "natsu_number.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+
+namespace natsu {
+namespace json {
+
+static const int kMaxDepth = 256;
+static const size_t kMinBlock = 4096;
+static const size_t kMaxIdleStack = 64 * 1024;  // scratch entries kept between parses
+static const size_t kPadding = 16;  // a NUL and the rest of a vector load
+
+static const Value kNullValue;
+
+struct Document::Block
+{
+    Block* next;
+    size_t cap;
+    size_t used;
+};
+
+static size_t align8(size_t n)
+{
+    return (n + 7) & ~static_cast<size_t>(7);
+}
+
+/* *
+ * Parser
+ * one pass over the NUL terminated copy, iterative so a deep document can't
+ * overflow a small coroutine stack. values of an open array or object wait
+ * on the document's scratch stack and move into the arena in one piece when
+ * it closes, children of a node are therefore contiguous.
+*/
+class Parser
+{
+public:
+    Parser(Document& doc, char* p, char* end)
+    : doc_(doc), stack_(doc.stack_), begin_(p), p_(p), end_(end) {}
+
+    bool run(Value& root)
+    {
+        uint32_t starts[kMaxDepth];
+        bool objects[kMaxDepth];
+        int depth = 0;
+
+        skip_ws();
+        while(true)
+        {
+            //a value is expected here
+            char c = *p_;
+            if(c == '{' || c == '[')
+            {
+                if(depth == kMaxDepth)
+                    return fail("document nested too deep");
+
+                ++p_;
+                starts[depth] = stack_.size();
+                objects[depth] = (c == '{');
+                ++depth;
+                skip_ws();
+                if(*p_ == (c == '{' ? '}' : ']'))
+                {
+                    ++p_;
+                    close(starts[depth - 1], objects[depth - 1]);
+                    --depth;
+                }
+                else if(c == '{')
+                {
+                    if(!key())
+                        return false;
+                    continue;
+                }
+                else
+                {
+                    continue;
+                }
+            }
+            else
+            {
+                Value v;
+                if(!scalar(v))
+                    return false;
+                stack_.push_back(v);
+            }
+
+            //the value is complete, what follows depends on the enclosing container
+            while(true)
+            {
+                if(depth == 0)
+                {
+                    skip_ws();
+                    if(p_ != end_)
+                        return fail("trailing characters");
+
+                    root = stack_.back();
+                    stack_.pop_back();
+                    return true;
+                }
+
+                skip_ws();
+                bool object = objects[depth - 1];
+                if(*p_ == ',')
+                {
+                    ++p_;
+                    skip_ws();
+                    if(object && !key())
+                        return false;
+                    break;
+                }
+
+                if(*p_ != (object ? '}' : ']'))
+                    return fail(object ? "expected ',' or '}'" : "expected ',' or ']'");
+
+                ++p_;
+                close(starts[depth - 1], object);
+                --depth;
+            }
+        }
+    }
+
+private:
+    // a member name and its colon
+    bool key()
+    {
+        if(*p_ != '"')
+            return fail("expected a member name");
+
+        Value name;
+        if(!string_value(name))
+            return false;
+        stack_.push_back(name);
+
+        skip_ws();
+        if(*p_ != ':')
+            return fail("expected ':'");
+        ++p_;
+        skip_ws();
+        return true;
+    }
+
+    void close(uint32_t start, bool object)
+    {
+        size_t count = stack_.size() - start;
+        Value v;
+        v.type_ = object ? JSON_OBJECT : JSON_ARRAY;
+        v.size_ = object ? count / 2 : count;
+        if(count)
+        {
+            //a Member is laid out like the name and value pair on the stack
+            Value* items = static_cast<Value*>(doc_.allocate(count * sizeof(Value)));
+            memcpy(items, &stack_[start], count * sizeof(Value));
+            v.u_.items_ = items;
+        }
+        else
+        {
+            v.u_.items_ = NULL;
+        }
+
+        stack_.resize(start);
+        stack_.push_back(v);
+    }
+
+    bool scalar(Value& v)
+    {
+        switch(*p_)
+        {
+        case '"':
+            return string_value(v);
+
+        case 't':
+            if(memcmp(p_, "true", 4) != 0)
+                return fail("invalid literal");
+            p_ += 4;
+            v.type_ = JSON_BOOL;
+            v.u_.bool_ = true;
+            return true;
+
+        case 'f':
+            if(memcmp(p_, "false", 5) != 0)
+                return fail("invalid literal");
+            p_ += 5;
+            v.type_ = JSON_BOOL;
+            v.u_.bool_ = false;
+            return true;
+
+        case 'n':
+            if(memcmp(p_, "null", 4) != 0)
+                return fail("invalid literal");
+            p_ += 4;
+            return true;
+
+        default:
+            if(*p_ == '-' || (*p_ >= '0' && *p_ <= '9'))
+                return number(v);
+            return fail(p_ == end_ ? "unexpected end" : "expected a value");
+        }
+    }
+
+    bool number(Value& v)
+    {
+        char* start = p_;
+        bool negative = (*p_ == '-');
+        if(negative)
+            ++p_;
+
+        uint64_t magnitude = 0;
+        int digits = 0;
+        if(*p_ == '0')
+        {
+            ++p_;
+            digits = 1;
+        }
+        else if(*p_ >= '1' && *p_ <= '9')
+        {
+            while(*p_ >= '0' && *p_ <= '9')
+            {
+                magnitude = magnitude * 10 + (*p_ - '0');
+                ++digits;
+                ++p_;
+            }
+        }
+        else
+        {
+            return fail("invalid number");
+        }
+
+        bool integral = true;
+        if(*p_ == '.')
+        {
+            ++p_;
+            if(*p_ < '0' || *p_ > '9')
+                return fail("invalid number");
+            while(*p_ >= '0' && *p_ <= '9')
+                ++p_;
+            integral = false;
+        }
+
+        if(*p_ == 'e' || *p_ == 'E')
+        {
+            ++p_;
+            if(*p_ == '+' || *p_ == '-')
+                ++p_;
+            if(*p_ < '0' || *p_ > '9')
+                return fail("invalid number");
+            while(*p_ >= '0' && *p_ <= '9')
+                ++p_;
+            integral = false;
+        }
+
+        v.type_ = JSON_NUMBER;
+        //19 digits never overflow the accumulator, -2^63 is the one magnitude above INT64_MAX allowed
+        if(integral && digits <= 19 &&
+           (magnitude <= static_cast<uint64_t>(INT64_MAX) || (negative && magnitude == static_cast<uint64_t>(INT64_MAX) + 1)))
+        {
+            v.integral_ = true;
+            v.u_.int_ = negative ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+            return true;
+        }
+
+        v.u_.real_ = strtod(start, NULL);
+        return true;
+    }
+
+    static int hex(char c)
+    {
+        if(c >= '0' && c <= '9') return c - '0';
+        if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    bool hex4(const char* p, uint32_t& u)
+    {
+        u = 0;
+        for(int i = 0; i < 4; ++i)
+        {
+            int h = hex(p[i]);
+            if(h < 0)
+                return fail("invalid \\u escape");
+            u = (u << 4) | h;
+        }
+        return true;
+    }
+
+    // decoded over the input itself, the result is never longer than its escaped form
+    bool string_value(Value& v)
+    {
+        char* start = ++p_;
+        p_ = const_cast<char*>(scan_string(p_));
+        if(*p_ != '"')
+        {
+            if(*p_ == '\\')
+                return unescape(v, start);
+            return fail(p_ == end_ ? "unterminated string" : "control character in string");
+        }
+
+        *p_ = '\0';
+        v.type_ = JSON_STRING;
+        v.u_.str_ = start;
+        v.size_ = p_ - start;
+        ++p_;
+        return true;
+    }
+
+    bool unescape(Value& v, char* start)
+    {
+        char* w = p_;
+        while(*p_ != '"')
+        {
+            unsigned char c = *p_;
+            if(c < 0x20)
+                return fail(p_ == end_ ? "unterminated string" : "control character in string");
+
+            if(c != '\\')
+            {
+                //the run up to the next quote, backslash or control character
+                char* run = const_cast<char*>(scan_string(p_));
+                memmove(w, p_, run - p_);
+                w += run - p_;
+                p_ = run;
+                continue;
+            }
+
+            switch(p_[1])
+            {
+            case '"': *w++ = '"'; break;
+            case '\\': *w++ = '\\'; break;
+            case '/': *w++ = '/'; break;
+            case 'b': *w++ = '\b'; break;
+            case 'f': *w++ = '\f'; break;
+            case 'n': *w++ = '\n'; break;
+            case 'r': *w++ = '\r'; break;
+            case 't': *w++ = '\t'; break;
+            case 'u':
+            {
+                uint32_t u;
+                if(!hex4(p_ + 2, u))
+                    return false;
+
+                if(u >= 0xD800 && u <= 0xDBFF)
+                {
+                    uint32_t low;
+                    if(p_[6] != '\\' || p_[7] != 'u' || !hex4(p_ + 8, low) || low < 0xDC00 || low > 0xDFFF)
+                        return fail("invalid surrogate pair");
+                    u = 0x10000 + ((u - 0xD800) << 10) + (low - 0xDC00);
+                    p_ += 6;
+                }
+                else if(u >= 0xDC00 && u <= 0xDFFF)
+                {
+                    return fail("invalid surrogate pair");
+                }
+
+                if(u < 0x80)
+                {
+                    *w++ = static_cast<char>(u);
+                }
+                else if(u < 0x800)
+                {
+                    *w++ = static_cast<char>(0xC0 | (u >> 6));
+                    *w++ = static_cast<char>(0x80 | (u & 0x3F));
+                }
+                else if(u < 0x10000)
+                {
+                    *w++ = static_cast<char>(0xE0 | (u >> 12));
+                    *w++ = static_cast<char>(0x80 | ((u >> 6) & 0x3F));
+                    *w++ = static_cast<char>(0x80 | (u & 0x3F));
+                }
+                else
+                {
+                    *w++ = static_cast<char>(0xF0 | (u >> 18));
+                    *w++ = static_cast<char>(0x80 | ((u >> 12) & 0x3F));
+                    *w++ = static_cast<char>(0x80 | ((u >> 6) & 0x3F));
+                    *w++ = static_cast<char>(0x80 | (u & 0x3F));
+                }
+                p_ += 4;
+            }
+            break;
+
+            default:
+                return fail("invalid escape");
+            }
+
+            p_ += 2;
+        }
+
+        *w = '\0';
+        v.type_ = JSON_STRING;
+        v.u_.str_ = start;
+        v.size_ = w - start;
+        ++p_;
+        return true;
+    }
+
+    void skip_ws()
+    {
+        while(*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')
+            ++p_;
+    }
+
+    bool fail(const char* what)
+    {
+        char buf[96];
+        snprintf(buf, sizeof(buf), "%s at offset %zu", what, static_cast<size_t>(p_ - begin_));
+        doc_.error_ = buf;
+        return false;
+    }
+
+private:
+    Document& doc_;
+    std::vector<Value>& stack_;
+    char* begin_;
+    char* p_;
+    char* end_;
+};
+
+bool Value::as_bool() const
+{
+    if(type_ != JSON_BOOL)
+        throw std::logic_error("json value is not a bool");
+    return u_.bool_;
+}
+
+int64_t Value::as_int() const
+{
+    if(type_ != JSON_NUMBER)
+        throw std::logic_error("json value is not a number");
+    return integral_ ? u_.int_ : static_cast<int64_t>(u_.real_);
+}
+
+double Value::as_double() const
+{
+    if(type_ != JSON_NUMBER)
+        throw std::logic_error("json value is not a number");
+    return integral_ ? static_cast<double>(u_.int_) : u_.real_;
+}
+
+std::string Value::as_string() const
+{
+    return std::string(c_str(), size_);
+}
+
+const char* Value::c_str() const
+{
+    if(type_ != JSON_STRING)
+        throw std::logic_error("json value is not a string");
+    return u_.str_;
+}
+
+const Value& Value::operator[](size_t index) const
+{
+    if(type_ != JSON_ARRAY || index >= size_)
+        return kNullValue;
+    return u_.items_[index];
+}
+
+const Value& Value::operator[](const char* key) const
+{
+    const Value* v = find(key, strlen(key));
+    return v ? *v : kNullValue;
+}
+
+const Value& Value::operator[](const std::string& key) const
+{
+    const Value* v = find(key.data(), key.size());
+    return v ? *v : kNullValue;
+}
+
+const Value* Value::find(const char* key, size_t len) const
+{
+    if(type_ != JSON_OBJECT)
+        return NULL;
+
+    for(const Member* m = u_.members_; m != u_.members_ + size_; ++m)
+    {
+        if(m->name.size_ == len && memcmp(m->name.u_.str_, key, len) == 0)
+            return &m->value;
+    }
+
+    return NULL;
+}
+
+void Value::dump(std::string& out) const
+{
+    Writer w(out);
+    w.value(*this);
+}
+
+std::string Value::to_string() const
+{
+    std::string out;
+    dump(out);
+    return out;
+}
+
+Document::Document()
+: blocks_(NULL)
+{
+}
+
+Document::~Document()
+{
+    release();
+}
+
+bool Document::parse(const char* p, size_t n)
+{
+    root_ = Value();
+    error_.clear();
+
+    //the copy plus room for about two nodes per three input bytes, a typical
+    //document fits the first block
+    size_t want = sizeof(Block) + align8(n + kPadding) + std::max(align8(n + n / 2), kMinBlock);
+    if(blocks_ && blocks_->next == NULL && blocks_->cap >= want && blocks_->cap <= want * 4)
+    {
+        blocks_->used = sizeof(Block);
+    }
+    else
+    {
+        release();
+        blocks_ = static_cast<Block*>(::malloc(want));
+        if(blocks_ == NULL)
+            throw std::bad_alloc();
+        blocks_->next = NULL;
+        blocks_->cap = want;
+        blocks_->used = sizeof(Block);
+    }
+
+    //zeroes after the copy, the first ends it and string scans may load a whole vector past it
+    char* text = static_cast<char*>(allocate(n + kPadding));
+    memcpy(text, p, n);
+    memset(text + n, 0, kPadding);
+
+    Parser parser(*this, text, text + n);
+    bool ok = parser.run(root_);
+    stack_.clear();
+    if(stack_.capacity() > kMaxIdleStack)
+        std::vector<Value>().swap(stack_);
+
+    if(!ok)
+        root_ = Value();
+    return ok;
+}
+
+void* Document::allocate(size_t n)
+{
+    n = align8(n);
+    if(blocks_->cap - blocks_->used < n)
+    {
+        //blocks are chained newest first, only the newest one is bumped
+        size_t cap = sizeof(Block) + std::max(n, (blocks_->cap - sizeof(Block)) * 2);
+        Block* block = static_cast<Block*>(::malloc(cap));
+        if(block == NULL)
+            throw std::bad_alloc();
+        block->next = blocks_;
+        block->cap = cap;
+        block->used = sizeof(Block);
+        blocks_ = block;
+    }
+
+    void* p = reinterpret_cast<char*>(blocks_) + blocks_->used;
+    blocks_->used += n;
+    return p;
+}
+
+void Document::release()
+{
+    while(blocks_)
+    {
+        Block* next = blocks_->next;
+        ::free(blocks_);
+        blocks_ = next;
+    }
+}
+
+Writer& Writer::begin_object()
+{
+    separate();
+    out_.push_back('{');
+    comma_ = false;
+    return *this;
+}
+
+Writer& Writer::end_object()
+{
+    out_.push_back('}');
+    comma_ = true;
+    return *this;
+}
+
+Writer& Writer::begin_array()
+{
+    separate();
+    out_.push_back('[');
+    comma_ = false;
+    return *this;
+}
+
+Writer& Writer::end_array()
+{
+    out_.push_back(']');
+    comma_ = true;
+    return *this;
+}
+
+Writer& Writer::key(const char* k, size_t len)
+{
+    separate();
+    string(k, len);
+    out_.push_back(':');
+    comma_ = false;
+    return *this;
+}
+
+Writer& Writer::raw_key(const char* text, size_t len)
+{
+    separate();
+    out_.append(text, len);
+    comma_ = false;
+    return *this;
+}
+
+Writer& Writer::value(const char* s, size_t len)
+{
+    separate();
+    string(s, len);
+    comma_ = true;
+    return *this;
+}
+
+Writer& Writer::value(bool b)
+{
+    separate();
+    if(b)
+        out_.append("true", 4);
+    else
+        out_.append("false", 5);
+    comma_ = true;
+    return *this;
+}
+
+Writer& Writer::value(double v)
+{
+    if(!isfinite(v))
+        return null();
+
+    char buf[32];
+    separate();
+    out_.append(buf, format_double(v, buf));
+    comma_ = true;
+    return *this;
+}
+
+Writer& Writer::value(const Value& v)
+{
+    switch(v.type())
+    {
+    case JSON_NULL:
+        return null();
+
+    case JSON_BOOL:
+        return value(v.as_bool());
+
+    case JSON_NUMBER:
+        return v.is_integer() ? integer(v.as_int()) : value(v.as_double());
+
+    case JSON_STRING:
+        return value(v.c_str(), v.size());
+
+    case JSON_ARRAY:
+        begin_array();
+        for(const Value* it = v.begin(); it != v.end(); ++it)
+            value(*it);
+        return end_array();
+
+    case JSON_OBJECT:
+        begin_object();
+        for(const Member* m = v.member_begin(); m != v.member_end(); ++m)
+            key(m->name.c_str(), m->name.size()).value(m->value);
+        return end_object();
+    }
+
+    return *this;
+}
+
+Writer& Writer::null()
+{
+    separate();
+    out_.append("null", 4);
+    comma_ = true;
+    return *this;
+}
+
+Writer& Writer::raw(const char* json, size_t len)
+{
+    separate();
+    out_.append(json, len);
+    comma_ = true;
+    return *this;
+}
+
+Writer& Writer::integer(int64_t v)
+{
+    char buf[24];
+    separate();
+    out_.append(buf, format_int(v, buf));
+    comma_ = true;
+    return *this;
+}
+
+Writer& Writer::unsigned_integer(uint64_t v)
+{
+    char buf[24];
+    separate();
+    out_.append(buf, format_uint(v, buf));
+    comma_ = true;
+    return *this;
+}
+
+void Writer::string(const char* s, size_t len)
+{
+    static const char kHex[] = "0123456789abcdef";
+
+    const char* end = s + len;
+    out_.push_back('"');
+    while(true)
+    {
+        //plain runs are copied whole, found 16 bytes at a time
+        const char* run = find_escape(s, end);
+        out_.append(s, run - s);
+        if(run == end)
+            break;
+
+        unsigned char c = *run;
+        switch(c)
+        {
+        case '"': out_.append("\\\"", 2); break;
+        case '\\': out_.append("\\\\", 2); break;
+        case '\n': out_.append("\\n", 2); break;
+        case '\r': out_.append("\\r", 2); break;
+        case '\t': out_.append("\\t", 2); break;
+        case '\b': out_.append("\\b", 2); break;
+        case '\f': out_.append("\\f", 2); break;
+        default:
+        {
+            char u[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xF]};
+            out_.append(u, 6);
+        }
+        }
+        s = run + 1;
+    }
+    out_.push_back('"');
+}
+
+}}
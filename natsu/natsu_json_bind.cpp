@@ -0,0 +1,676 @@
+#include "natsu_json_bind.h"
+#include "json_simd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+namespace natsu {
+namespace json {
+
+static const int kMaxDepth = 256;
+
+static bool digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static int hex(char c)
+{
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool hex4(const char* p, uint32_t& u)
+{
+    u = 0;
+    for(int i = 0; i < 4; ++i)
+    {
+        int h = hex(p[i]);
+        if(h < 0)
+            return false;
+        u = (u << 4) | h;
+    }
+    return true;
+}
+
+static void append_utf8(uint32_t u, std::string& out)
+{
+    if(u < 0x80)
+    {
+        out.push_back(static_cast<char>(u));
+    }
+    else if(u < 0x800)
+    {
+        out.push_back(static_cast<char>(0xC0 | (u >> 6)));
+        out.push_back(static_cast<char>(0x80 | (u & 0x3F)));
+    }
+    else if(u < 0x10000)
+    {
+        out.push_back(static_cast<char>(0xE0 | (u >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((u >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (u & 0x3F)));
+    }
+    else
+    {
+        out.push_back(static_cast<char>(0xF0 | (u >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((u >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((u >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (u & 0x3F)));
+    }
+}
+
+Reader::Reader(const char* p, size_t n)
+: begin_(p), p_(p), end_(p + n), first_(false), failed_(false)
+{
+}
+
+Reader::Reader(const std::string& s)
+: Reader(s.data(), s.size())
+{
+}
+
+bool Reader::read(bool& v)
+{
+    if(failed_)
+        return false;
+    if(null())
+        return true;
+
+    if(end_ - p_ >= 4 && memcmp(p_, "true", 4) == 0)
+    {
+        p_ += 4;
+        v = true;
+        return true;
+    }
+
+    if(end_ - p_ >= 5 && memcmp(p_, "false", 5) == 0)
+    {
+        p_ += 5;
+        v = false;
+        return true;
+    }
+
+    return fail("expected a bool");
+}
+
+bool Reader::read(int& v)
+{
+    if(failed_)
+        return false;
+    if(null())
+        return true;
+
+    int64_t x;
+    if(!signed_integer(x, INT_MIN, INT_MAX))
+        return false;
+    v = static_cast<int>(x);
+    return true;
+}
+
+bool Reader::read(long& v)
+{
+    if(failed_)
+        return false;
+    if(null())
+        return true;
+
+    int64_t x;
+    if(!signed_integer(x, LONG_MIN, LONG_MAX))
+        return false;
+    v = static_cast<long>(x);
+    return true;
+}
+
+bool Reader::read(long long& v)
+{
+    if(failed_)
+        return false;
+    if(null())
+        return true;
+
+    int64_t x;
+    if(!signed_integer(x, LLONG_MIN, LLONG_MAX))
+        return false;
+    v = static_cast<long long>(x);
+    return true;
+}
+
+bool Reader::read(unsigned& v)
+{
+    if(failed_)
+        return false;
+    if(null())
+        return true;
+
+    uint64_t x;
+    if(!unsigned_integer(x, UINT_MAX))
+        return false;
+    v = static_cast<unsigned>(x);
+    return true;
+}
+
+bool Reader::read(unsigned long& v)
+{
+    if(failed_)
+        return false;
+    if(null())
+        return true;
+
+    uint64_t x;
+    if(!unsigned_integer(x, ULONG_MAX))
+        return false;
+    v = static_cast<unsigned long>(x);
+    return true;
+}
+
+bool Reader::read(unsigned long long& v)
+{
+    if(failed_)
+        return false;
+    if(null())
+        return true;
+
+    uint64_t x;
+    if(!unsigned_integer(x, ULLONG_MAX))
+        return false;
+    v = static_cast<unsigned long long>(x);
+    return true;
+}
+
+bool Reader::read(double& v)
+{
+    if(failed_)
+        return false;
+    if(null())
+        return true;
+
+    const char* start = p_;
+    bool integral;
+    if(!number(integral))
+        return false;
+
+    //up to 18 digits fit an int64_t, its conversion rounds once like strtod
+    size_t n = p_ - start;
+    if(integral && n <= 18)
+    {
+        const char* p = start;
+        bool negative = (*p == '-');
+        if(negative)
+            ++p;
+
+        int64_t m = 0;
+        while(p != p_)
+            m = m * 10 + (*p++ - '0');
+        v = static_cast<double>(negative ? -m : m);
+        return true;
+    }
+
+    //strtod wants a terminated string, the input need not be
+    char buf[64];
+    if(n < sizeof(buf))
+    {
+        memcpy(buf, start, n);
+        buf[n] = '\0';
+        v = strtod(buf, NULL);
+    }
+    else
+    {
+        v = strtod(std::string(start, n).c_str(), NULL);
+    }
+    return true;
+}
+
+bool Reader::read(float& v)
+{
+    if(failed_)
+        return false;
+    if(null())
+        return true;
+
+    double d;
+    if(!read(d))
+        return false;
+    v = static_cast<float>(d);
+    return true;
+}
+
+bool Reader::read(std::string& v)
+{
+    if(failed_)
+        return false;
+    if(null())
+        return true;
+
+    const char* s;
+    size_t len;
+    if(!string(v, s, len))
+        return false;
+    if(s != v.data())
+        v.assign(s, len);
+    return true;
+}
+
+bool Reader::skip()
+{
+    if(failed_)
+        return false;
+
+    //a bit per open container, set for objects
+    uint64_t objects[kMaxDepth / 64] = {0};
+    int depth = 0;
+    while(true)
+    {
+        skip_ws();
+        if(p_ != end_ && (*p_ == '{' || *p_ == '['))
+        {
+            if(depth == kMaxDepth)
+                return fail("document nested too deep");
+
+            bool object = (*p_ == '{');
+            if(object)
+                objects[depth / 64] |= 1ULL << (depth % 64);
+            else
+                objects[depth / 64] &= ~(1ULL << (depth % 64));
+            ++depth;
+            ++p_;
+
+            skip_ws();
+            if(p_ != end_ && *p_ == (object ? '}' : ']'))
+            {
+                ++p_;
+                --depth;
+            }
+            else
+            {
+                if(object && !skip_key())
+                    return false;
+                continue;
+            }
+        }
+        else if(!skip_scalar())
+        {
+            return false;
+        }
+
+        //the value is complete, what follows depends on the enclosing container
+        while(true)
+        {
+            if(depth == 0)
+                return true;
+
+            bool object = (objects[(depth - 1) / 64] >> ((depth - 1) % 64)) & 1;
+            skip_ws();
+            if(p_ != end_ && *p_ == ',')
+            {
+                ++p_;
+                if(object && !skip_key())
+                    return false;
+                break;
+            }
+
+            if(p_ == end_ || *p_ != (object ? '}' : ']'))
+                return fail(object ? "expected ',' or '}'" : "expected ',' or ']'");
+            ++p_;
+            --depth;
+        }
+    }
+}
+
+bool Reader::finish()
+{
+    if(failed_)
+        return false;
+
+    skip_ws();
+    return p_ == end_ || fail("trailing characters");
+}
+
+bool Reader::begin_object()
+{
+    if(failed_)
+        return false;
+
+    skip_ws();
+    if(p_ == end_ || *p_ != '{')
+        return fail("expected an object");
+    ++p_;
+    first_ = true;
+    return true;
+}
+
+bool Reader::next_member(const char*& key, size_t& len)
+{
+    if(!more('}'))
+        return false;
+
+    if(!string(key_, key, len))
+        return false;
+
+    skip_ws();
+    if(p_ == end_ || *p_ != ':')
+        return fail("expected ':'");
+    ++p_;
+    return true;
+}
+
+bool Reader::begin_array()
+{
+    if(failed_)
+        return false;
+
+    skip_ws();
+    if(p_ == end_ || *p_ != '[')
+        return fail("expected an array");
+    ++p_;
+    first_ = true;
+    return true;
+}
+
+bool Reader::next_element()
+{
+    return more(']');
+}
+
+bool Reader::null()
+{
+    if(failed_)
+        return false;
+
+    skip_ws();
+    if(end_ - p_ >= 4 && memcmp(p_, "null", 4) == 0)
+    {
+        p_ += 4;
+        return true;
+    }
+    return false;
+}
+
+bool Reader::signed_integer(int64_t& v, int64_t min, int64_t max)
+{
+    bool negative = (p_ != end_ && *p_ == '-');
+    if(negative)
+        ++p_;
+
+    uint64_t magnitude;
+    if(!digits(negative ? 0 - static_cast<uint64_t>(min) : static_cast<uint64_t>(max), magnitude))
+        return false;
+
+    v = negative ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+    return true;
+}
+
+bool Reader::unsigned_integer(uint64_t& v, uint64_t max)
+{
+    return digits(max, v);
+}
+
+bool Reader::digits(uint64_t limit, uint64_t& v)
+{
+    const char* start = p_;
+    v = 0;
+    if(p_ != end_ && *p_ == '0')
+    {
+        ++p_;
+    }
+    else
+    {
+        while(p_ != end_ && digit(*p_))
+        {
+            unsigned d = *p_ - '0';
+            if(v > (limit - d) / 10)
+                return fail("integer out of range");
+            v = v * 10 + d;
+            ++p_;
+        }
+    }
+
+    if(p_ == start || (p_ != end_ && (*p_ == '.' || *p_ == 'e' || *p_ == 'E' || digit(*p_))))
+        return fail("expected an integer");
+    return true;
+}
+
+bool Reader::number(bool& integral)
+{
+    const char* p = p_;
+    integral = true;
+    if(p != end_ && *p == '-')
+        ++p;
+
+    if(p != end_ && *p == '0')
+    {
+        ++p;
+    }
+    else if(p != end_ && digit(*p))
+    {
+        while(p != end_ && digit(*p))
+            ++p;
+    }
+    else
+    {
+        return fail("expected a number");
+    }
+
+    if(p != end_ && *p == '.')
+    {
+        ++p;
+        if(p == end_ || !digit(*p))
+            return fail("invalid number");
+        while(p != end_ && digit(*p))
+            ++p;
+        integral = false;
+    }
+
+    if(p != end_ && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        if(p != end_ && (*p == '+' || *p == '-'))
+            ++p;
+        if(p == end_ || !digit(*p))
+            return fail("invalid number");
+        while(p != end_ && digit(*p))
+            ++p;
+        integral = false;
+    }
+
+    p_ = p;
+    return true;
+}
+
+bool Reader::string(std::string& out, const char*& s, size_t& len)
+{
+    skip_ws();
+    if(p_ == end_ || *p_ != '"')
+        return fail("expected a string");
+
+    //most strings have no escapes and are used where they lie
+    const char* start = ++p_;
+    const char* run = find_escape(p_, end_);
+    if(run != end_ && *run == '"')
+    {
+        s = start;
+        len = run - start;
+        p_ = run + 1;
+        return true;
+    }
+
+    out.assign(start, run - start);
+    p_ = run;
+    while(true)
+    {
+        if(p_ == end_)
+            return fail("unterminated string");
+
+        unsigned char c = *p_;
+        if(c == '"')
+            break;
+        if(c < 0x20)
+            return fail("control character in string");
+
+        if(end_ - p_ < 2)
+            return fail("unterminated string");
+
+        switch(p_[1])
+        {
+        case '"': out.push_back('"'); break;
+        case '\\': out.push_back('\\'); break;
+        case '/': out.push_back('/'); break;
+        case 'b': out.push_back('\b'); break;
+        case 'f': out.push_back('\f'); break;
+        case 'n': out.push_back('\n'); break;
+        case 'r': out.push_back('\r'); break;
+        case 't': out.push_back('\t'); break;
+        case 'u':
+        {
+            uint32_t u;
+            if(end_ - p_ < 6 || !hex4(p_ + 2, u))
+                return fail("invalid \\u escape");
+
+            if(u >= 0xD800 && u <= 0xDBFF)
+            {
+                uint32_t low;
+                if(end_ - p_ < 12 || p_[6] != '\\' || p_[7] != 'u' || !hex4(p_ + 8, low) || low < 0xDC00 || low > 0xDFFF)
+                    return fail("invalid surrogate pair");
+                u = 0x10000 + ((u - 0xD800) << 10) + (low - 0xDC00);
+                p_ += 6;
+            }
+            else if(u >= 0xDC00 && u <= 0xDFFF)
+            {
+                return fail("invalid surrogate pair");
+            }
+
+            append_utf8(u, out);
+            p_ += 4;
+        }
+        break;
+
+        default:
+            return fail("invalid escape");
+        }
+        p_ += 2;
+
+        run = find_escape(p_, end_);
+        out.append(p_, run - p_);
+        p_ = run;
+    }
+
+    ++p_;
+    s = out.data();
+    len = out.size();
+    return true;
+}
+
+bool Reader::skip_string()
+{
+    ++p_;
+    while(true)
+    {
+        p_ = find_escape(p_, end_);
+        if(p_ == end_)
+            return fail("unterminated string");
+
+        if(*p_ == '"')
+        {
+            ++p_;
+            return true;
+        }
+
+        if(*p_ != '\\')
+            return fail("control character in string");
+        if(end_ - p_ < 2 || !strchr("\"\\/bfnrtu", p_[1]))
+            return fail("invalid escape");
+        p_ += 2;
+    }
+}
+
+bool Reader::skip_key()
+{
+    skip_ws();
+    if(p_ == end_ || *p_ != '"')
+        return fail("expected a member name");
+    if(!skip_string())
+        return false;
+
+    skip_ws();
+    if(p_ == end_ || *p_ != ':')
+        return fail("expected ':'");
+    ++p_;
+    skip_ws();
+    return true;
+}
+
+bool Reader::skip_scalar()
+{
+    bool integral;
+    switch(p_ == end_ ? '\0' : *p_)
+    {
+    case '"':
+        return skip_string();
+
+    case 't':
+        if(end_ - p_ < 4 || memcmp(p_, "true", 4) != 0)
+            return fail("invalid literal");
+        p_ += 4;
+        return true;
+
+    case 'f':
+        if(end_ - p_ < 5 || memcmp(p_, "false", 5) != 0)
+            return fail("invalid literal");
+        p_ += 5;
+        return true;
+
+    case 'n':
+        if(end_ - p_ < 4 || memcmp(p_, "null", 4) != 0)
+            return fail("invalid literal");
+        p_ += 4;
+        return true;
+
+    default:
+        if(p_ == end_)
+            return fail("unexpected end");
+        if(*p_ == '-' || digit(*p_))
+            return number(integral);
+        return fail("expected a value");
+    }
+}
+
+bool Reader::more(char close)
+{
+    if(failed_)
+        return false;
+
+    skip_ws();
+    if(p_ != end_ && *p_ == close)
+    {
+        ++p_;
+        first_ = false;
+        return false;
+    }
+
+    if(first_)
+    {
+        first_ = false;
+        return true;
+    }
+
+    if(p_ == end_ || *p_ != ',')
+        return fail(close == '}' ? "expected ',' or '}'" : "expected ',' or ']'");
+    ++p_;
+    return true;
+}
+
+bool Reader::fail(const char* what)
+{
+    //the first error is the one that explains the rest
+    if(!failed_)
+    {
+        char buf[96];
+        snprintf(buf, sizeof(buf), "%s at offset %zu", what, static_cast<size_t>(p_ - begin_));
+        error_ = buf;
+        failed_ = true;
+    }
+    return false;
+}
+
+}}
@@ -0,0 +1,245 @@
+#include "natsu_json_cursor.h"
+#include "json_simd.h"
+#include <stdexcept>
+
+namespace natsu {
+namespace json {
+
+static const char* skip_ws(const char* p, const char* end)
+{
+    while(p != end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+        ++p;
+    return p;
+}
+
+// p at the opening quote, @return past the closing one or NULL
+static const char* skip_string(const char* p, const char* end)
+{
+    ++p;
+    while(true)
+    {
+        p = find_escape(p, end);
+        if(p == end)
+            return NULL;
+        if(*p == '"')
+            return p + 1;
+        //a backslash takes the next byte with it, a stray control byte is stepped over
+        p += (*p == '\\') ? 2 : 1;
+        if(p > end)
+            return NULL;
+    }
+}
+
+// p at the first byte of a value, @return past its last or NULL
+static const char* skip_value(const char* p, const char* end)
+{
+    if(*p == '"')
+        return skip_string(p, end);
+
+    if(*p != '{' && *p != '[')
+    {
+        const char* start = p;
+        while(p != end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t')
+            ++p;
+        return p != start ? p : NULL;
+    }
+
+    return skip_container(p, end);
+}
+
+// p just past a value inside a container, @return at the next entry or NULL at the end
+static const char* next_entry(const char* p, const char* end)
+{
+    p = skip_ws(p, end);
+    if(p == end || *p != ',')
+        return NULL;
+    p = skip_ws(p + 1, end);
+    return p != end ? p : NULL;
+}
+
+Cursor::Cursor(const char* p, size_t n)
+: p_(NULL), end_(p + n)
+{
+    p = skip_ws(p, end_);
+    if(p != end_)
+        p_ = p;
+}
+
+Type Cursor::type() const
+{
+    if(!p_)
+        return JSON_NULL;
+
+    switch(*p_)
+    {
+    case '{': return JSON_OBJECT;
+    case '[': return JSON_ARRAY;
+    case '"': return JSON_STRING;
+    case 't':
+    case 'f': return JSON_BOOL;
+    case 'n': return JSON_NULL;
+    default: return JSON_NUMBER;
+    }
+}
+
+bool Cursor::as_bool() const
+{
+    bool v;
+    if(!is_bool() || !get(v))
+        throw std::logic_error("json value is not a bool");
+    return v;
+}
+
+int64_t Cursor::as_int() const
+{
+    //fractions and integers beyond 64 bits truncate like Value::as_int
+    long long v;
+    if(is_number() && get(v))
+        return v;
+    return static_cast<int64_t>(as_double());
+}
+
+double Cursor::as_double() const
+{
+    double v;
+    if(!is_number() || !get(v))
+        throw std::logic_error("json value is not a number");
+    return v;
+}
+
+std::string Cursor::as_string() const
+{
+    std::string v;
+    if(!is_string() || !get(v))
+        throw std::logic_error("json value is not a string");
+    return v;
+}
+
+Cursor Cursor::operator[](size_t index) const
+{
+    if(!is_array())
+        return Cursor();
+
+    const char* p = skip_ws(p_ + 1, end_);
+    if(p == end_ || *p == ']')
+        return Cursor();
+
+    for(size_t i = 0; i < index; ++i)
+    {
+        p = skip_value(p, end_);
+        if(!p || !(p = next_entry(p, end_)))
+            return Cursor();
+    }
+    return Cursor(p, end_);
+}
+
+Cursor Cursor::find(const char* key, size_t len) const
+{
+    if(!is_object())
+        return Cursor();
+
+    const char* p = skip_ws(p_ + 1, end_);
+    while(p != end_ && *p == '"')
+    {
+        const char* name = p + 1;
+        const char* q = skip_string(p, end_);
+        if(!q)
+            return Cursor();
+
+        size_t n = q - 1 - name;
+        bool match = false;
+        if(!memchr(name, '\\', n))
+        {
+            match = (n == len && memcmp(name, key, len) == 0);
+        }
+        else if(n >= len)
+        {
+            //an escaped name compares decoded, rare enough to go through a Reader
+            std::string decoded;
+            Reader r(p, q - p);
+            match = r.read(decoded) && decoded.size() == len && memcmp(decoded.data(), key, len) == 0;
+        }
+
+        p = skip_ws(q, end_);
+        if(p == end_ || *p != ':')
+            return Cursor();
+        p = skip_ws(p + 1, end_);
+        if(p == end_)
+            return Cursor();
+        if(match)
+            return Cursor(p, end_);
+
+        p = skip_value(p, end_);
+        if(!p || !(p = next_entry(p, end_)))
+            return Cursor();
+    }
+    return Cursor();
+}
+
+Cursor Cursor::at(const char* pointer, size_t len) const
+{
+    Cursor c = *this;
+    const char* p = pointer;
+    const char* end = pointer + len;
+    std::string token;
+    while(p != end && c.valid())
+    {
+        if(*p != '/')
+            return Cursor();
+
+        const char* start = ++p;
+        while(p != end && *p != '/')
+            ++p;
+
+        //~1 stands for '/' and ~0 for '~' inside a reference token
+        const char* name = start;
+        size_t n = p - start;
+        if(memchr(start, '~', n))
+        {
+            token.clear();
+            for(const char* s = start; s != p; ++s)
+            {
+                if(*s != '~')
+                    token.push_back(*s);
+                else if(s + 1 != p && (s[1] == '0' || s[1] == '1'))
+                    token.push_back(*++s == '0' ? '~' : '/');
+                else
+                    return Cursor();
+            }
+            name = token.data();
+            n = token.size();
+        }
+
+        if(c.is_array())
+        {
+            //decimal without leading zeros, "-" (past the end) never exists
+            if(n == 0 || n > 19 || (n > 1 && name[0] == '0'))
+                return Cursor();
+
+            size_t index = 0;
+            for(size_t i = 0; i < n; ++i)
+            {
+                if(name[i] < '0' || name[i] > '9')
+                    return Cursor();
+                index = index * 10 + (name[i] - '0');
+            }
+            c = c[index];
+        }
+        else
+        {
+            c = c.find(name, n);
+        }
+    }
+    return c;
+}
+
+std::string Cursor::raw() const
+{
+    if(!p_)
+        return std::string();
+
+    const char* q = skip_value(p_, end_);
+    return q ? std::string(p_, q) : std::string();
+}
+
+}}
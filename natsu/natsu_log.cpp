@@ -0,0 +1,581 @@
+#include "natsu_log.h"
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+
+namespace natsu {
+
+namespace {
+
+enum
+{
+    kRecordData = 232,
+    kRingSize = 1024,
+    kPrefixLen = 48,
+    kLineMax = 512,
+    kIovPerRecord = 3,
+    kBatch = IOV_MAX / kIovPerRecord,
+};
+
+static const char* kLevelName[] = { "DEBUG", "INFO", "WARN", "ERROR", "ACCESS" };
+static const uint16_t kNullString = 0xFFFF;
+
+// fixed-size record, data holds the packed arguments: a type byte, then
+// 8 bytes of value, or for a string a 2 byte length and the NUL terminated text
+struct LogRecord
+{
+    uint64_t time_us;
+    const char* fmt;
+    uint32_t tid;
+    uint16_t len;
+    uint8_t level;
+    uint8_t nargs;
+    char data[kRecordData];
+};
+
+// single producer (owner thread) / single consumer (log thread) ring
+struct LogRing
+{
+    std::atomic<uint64_t> head;
+    char pad_[64 - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> retired;  // the owner thread exited, the log thread frees the ring once drained
+    LogRecord records[kRingSize];
+
+    LogRing() : head(0), tail(0), dropped(0), retired(false) {}
+};
+
+// the owner thread's handle on its ring, retires it when the thread exits
+struct LocalRing
+{
+    LocalRing() : ring(NULL) {}
+    ~LocalRing()
+    {
+        if (ring)
+            ring->retired.store(true, std::memory_order_release);
+    }
+
+    LogRing* ring;
+};
+
+// @return the bytes used, 0 when the argument no longer fits
+size_t pack(char* p, size_t left, const LogArg& arg)
+{
+    if (arg.type != LogArg::kString)
+    {
+        if (left < 1 + sizeof(uint64_t))
+            return 0;
+        p[0] = static_cast<char>(arg.type);
+        memcpy(p + 1, &arg.u, sizeof(uint64_t));
+        return 1 + sizeof(uint64_t);
+    }
+
+    if (left < 4)
+        return 0;
+
+    //a string that doesn't fit is cut short
+    uint16_t n = kNullString;
+    size_t used = 3;
+    if (arg.s)
+    {
+        size_t len = strlen(arg.s);
+        if (len > left - 4)
+            len = left - 4;
+        memcpy(p + 3, arg.s, len);
+        p[3 + len] = '\0';
+        n = static_cast<uint16_t>(len);
+        used += len + 1;
+    }
+
+    p[0] = static_cast<char>(LogArg::kString);
+    memcpy(p + 1, &n, sizeof(n));
+    return used;
+}
+
+// walks the packed arguments of a record
+class ArgReader
+{
+public:
+    explicit ArgReader(const LogRecord& rec) : p_(rec.data), left_(rec.nargs) {}
+
+    bool next(LogArg& arg)
+    {
+        if (left_ == 0)
+            return false;
+
+        --left_;
+        arg.type = static_cast<LogArg::Type>(*p_++);
+        if (arg.type != LogArg::kString)
+        {
+            memcpy(&arg.u, p_, sizeof(uint64_t));
+            p_ += sizeof(uint64_t);
+            return true;
+        }
+
+        uint16_t n;
+        memcpy(&n, p_, sizeof(n));
+        p_ += sizeof(n);
+        arg.s = NULL;
+        if (n != kNullString)
+        {
+            arg.s = p_;
+            p_ += n + 1;
+        }
+        return true;
+    }
+
+private:
+    const char* p_;
+    size_t left_;
+};
+
+// integer conversions are cut to the width their length modifier names,
+// as the producer's printf would have read them from the va_list
+int64_t signed_as(const LogArg& arg, const char* length)
+{
+    if (!strcmp(length, "hh")) return static_cast<signed char>(arg.i);
+    if (!strcmp(length, "h")) return static_cast<short>(arg.i);
+    if (!*length) return static_cast<int>(arg.i);
+    return arg.i;
+}
+
+uint64_t unsigned_as(const LogArg& arg, const char* length)
+{
+    if (!strcmp(length, "hh")) return static_cast<unsigned char>(arg.u);
+    if (!strcmp(length, "h")) return static_cast<unsigned short>(arg.u);
+    if (!*length) return static_cast<unsigned>(arg.u);
+    return arg.u;
+}
+
+/* *
+ * format_text
+ * printf of a record on the log thread. every conversion is handed to
+ * snprintf on its own with the length modifier replaced by the width the
+ * argument was packed at. @return bytes in buf, at most cap - 1
+*/
+size_t format_text(const LogRecord& rec, char* buf, size_t cap)
+{
+    ArgReader args(rec);
+    const char* f = rec.fmt;
+    size_t n = 0;
+    while (*f && n + 1 < cap)
+    {
+        if (*f != '%')
+        {
+            buf[n++] = *f++;
+            continue;
+        }
+
+        const char* start = f++;
+        if (*f == '%')
+        {
+            buf[n++] = *f++;
+            continue;
+        }
+
+        //%[flags][width][.precision][length]conversion, stars are filled in
+        char spec[64];
+        size_t sn = 0;
+        spec[sn++] = '%';
+        while (*f && strchr("-+ #0", *f) && sn < 8)
+            spec[sn++] = *f++;
+
+        bool ok = true;
+        LogArg star;
+        if (*f == '*')
+        {
+            ++f;
+            ok = args.next(star);
+            sn += snprintf(spec + sn, 16, "%d", static_cast<int>(star.i));
+        }
+        else
+        {
+            while (*f >= '0' && *f <= '9' && sn < 24)
+                spec[sn++] = *f++;
+        }
+
+        if (*f == '.')
+        {
+            ++f;
+            if (*f == '*')
+            {
+                ++f;
+                ok = ok && args.next(star);
+                //a negative precision is taken as if it were omitted
+                if (static_cast<int>(star.i) >= 0)
+                    sn += snprintf(spec + sn, 16, ".%d", static_cast<int>(star.i));
+            }
+            else
+            {
+                spec[sn++] = '.';
+                while (*f >= '0' && *f <= '9' && sn < 40)
+                    spec[sn++] = *f++;
+            }
+        }
+
+        char length[3] = { 0 };
+        for (size_t k = 0; k < 2 && *f && strchr("hlLjztq", *f); ++k)
+            length[k] = *f++;
+
+        char conv = *f;
+        if (!conv)
+            break;
+        ++f;
+
+        LogArg arg;
+        ok = ok && args.next(arg);
+        if (ok && conv == 's' && arg.type != LogArg::kString)
+            ok = false;
+
+        int w = -1;
+        size_t room = cap - n;
+        if (ok)
+        {
+            switch (conv)
+            {
+            case 'd': case 'i':
+                memcpy(spec + sn, "ll", 2);
+                spec[sn + 2] = conv;
+                spec[sn + 3] = '\0';
+                w = snprintf(buf + n, room, spec, static_cast<long long>(signed_as(arg, length)));
+                break;
+            case 'u': case 'o': case 'x': case 'X':
+                memcpy(spec + sn, "ll", 2);
+                spec[sn + 2] = conv;
+                spec[sn + 3] = '\0';
+                w = snprintf(buf + n, room, spec, static_cast<unsigned long long>(unsigned_as(arg, length)));
+                break;
+            case 'c':
+                spec[sn] = conv;
+                spec[sn + 1] = '\0';
+                w = snprintf(buf + n, room, spec, static_cast<int>(arg.i));
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                spec[sn] = conv;
+                spec[sn + 1] = '\0';
+                w = snprintf(buf + n, room, spec, arg.d);
+                break;
+            case 's':
+                spec[sn] = conv;
+                spec[sn + 1] = '\0';
+                w = snprintf(buf + n, room, spec, arg.s ? arg.s : "(null)");
+                break;
+            case 'p':
+                spec[sn] = conv;
+                spec[sn + 1] = '\0';
+                w = snprintf(buf + n, room, spec, reinterpret_cast<void*>(static_cast<uintptr_t>(arg.u)));
+                break;
+            default:
+                break;
+            }
+        }
+
+        //an unknown conversion, or one past the arguments the record could hold, stays as written
+        if (w < 0)
+        {
+            size_t k = f - start;
+            w = static_cast<int>(k < room - 1 ? k : room - 1);
+            memcpy(buf + n, start, w);
+        }
+
+        n += static_cast<size_t>(w) < room ? w : room - 1;
+    }
+
+    while (n > 0 && buf[n - 1] == '\n') --n;
+    return n;
+}
+
+inline uint32_t current_tid()
+{
+    static thread_local uint32_t tid = static_cast<uint32_t>(syscall(SYS_gettid));
+    return tid;
+}
+
+inline uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+class Logger
+{
+public:
+    static Logger& instance()
+    {
+        //ignore memory leak, the log thread outlives static destruction
+        static Logger* logger = new Logger();
+        return *logger;
+    }
+
+    void init(int fd, LogLevel level, bool access)
+    {
+        fd_.store(fd, std::memory_order_relaxed);
+        level_.store(level, std::memory_order_relaxed);
+        access_.store(access, std::memory_order_relaxed);
+    }
+
+    bool enabled(LogLevel level)
+    {
+        if (level == LOG_ACCESS)
+            return access_.load(std::memory_order_relaxed);
+        return level >= level_.load(std::memory_order_relaxed);
+    }
+
+    void push(LogLevel level, const char* fmt, const LogArg* args, size_t nargs)
+    {
+        LogRing* ring = local_ring();
+        uint64_t h = ring->head.load(std::memory_order_relaxed);
+        if (h - ring->tail.load(std::memory_order_acquire) >= kRingSize)
+        {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        //only copies here, the log thread formats
+        LogRecord& rec = ring->records[h % kRingSize];
+        size_t used = 0;
+        size_t i = 0;
+        for (; i < nargs && i < 255; ++i)
+        {
+            size_t k = pack(rec.data + used, kRecordData - used, args[i]);
+            if (k == 0)
+                break;
+            used += k;
+        }
+
+        rec.fmt = fmt;
+        rec.nargs = static_cast<uint8_t>(i);
+        rec.len = static_cast<uint16_t>(used);
+        rec.level = static_cast<uint8_t>(level);
+        rec.tid = current_tid();
+        rec.time_us = now_us();
+        ring->head.store(h + 1, std::memory_order_release);
+    }
+
+    size_t drain()
+    {
+        std::unique_lock<std::mutex> consume(consume_lock_);
+        std::vector<LogRing*> rings;
+        {
+            std::unique_lock<std::mutex> lock(rings_lock_);
+            rings = rings_;
+        }
+
+        size_t total = 0;
+        uint64_t dropped = 0;
+        std::vector<LogRing*> dead;
+        for (size_t i = 0; i < rings.size(); ++i)
+        {
+            //read before draining, every record of a retired ring is in by then
+            bool retired = rings[i]->retired.load(std::memory_order_acquire);
+            total += drain(rings[i]);
+            if (retired)
+            {
+                retired_dropped_ += rings[i]->dropped.load(std::memory_order_relaxed);
+                dead.push_back(rings[i]);
+            }
+            else
+                dropped += rings[i]->dropped.load(std::memory_order_relaxed);
+        }
+
+        if (dead.size())
+            free_rings(dead);
+
+        report_dropped(dropped + retired_dropped_);
+        return total;
+    }
+
+private:
+    Logger() : fd_(STDERR_FILENO), level_(LOG_INFO), access_(false),
+        reported_dropped_(0), retired_dropped_(0), last_report_us_(0), cached_second_(-1)
+    {
+        atexit(&log_flush);
+        std::thread(&Logger::loop, this).detach();
+    }
+
+    LogRing* local_ring()
+    {
+        static thread_local LocalRing local;
+        if (!local.ring)
+        {
+            local.ring = new LogRing();
+            std::unique_lock<std::mutex> lock(rings_lock_);
+            rings_.push_back(local.ring);
+        }
+
+        return local.ring;
+    }
+
+    // called with consume_lock_ held, only the consumer ever frees a ring
+    void free_rings(const std::vector<LogRing*>& dead)
+    {
+        {
+            std::unique_lock<std::mutex> lock(rings_lock_);
+            for (size_t i = 0; i < dead.size(); ++i)
+                rings_.erase(std::find(rings_.begin(), rings_.end(), dead[i]));
+        }
+
+        for (size_t i = 0; i < dead.size(); ++i)
+            delete dead[i];
+    }
+
+    void loop()
+    {
+        while (true)
+        {
+            if (drain() == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+
+    size_t drain(LogRing* ring)
+    {
+        struct iovec iov[kBatch * kIovPerRecord];
+
+        size_t total = 0;
+        uint64_t t = ring->tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            uint64_t h = ring->head.load(std::memory_order_acquire);
+            if (t == h) break;
+
+            size_t n = 0;
+            for (; t + n < h && n < kBatch; ++n)
+            {
+                LogRecord& rec = ring->records[(t + n) % kRingSize];
+                iov[n * kIovPerRecord].iov_base = prefix_[n];
+                iov[n * kIovPerRecord].iov_len = format_prefix(rec, prefix_[n]);
+                iov[n * kIovPerRecord + 1].iov_base = text_[n];
+                iov[n * kIovPerRecord + 1].iov_len = format_text(rec, text_[n], kLineMax);
+                iov[n * kIovPerRecord + 2].iov_base = const_cast<char*>("\n");
+                iov[n * kIovPerRecord + 2].iov_len = 1;
+            }
+
+            writev_all(iov, n * kIovPerRecord);
+            t += n;
+            total += n;
+            ring->tail.store(t, std::memory_order_release);
+        }
+
+        return total;
+    }
+
+    size_t format_prefix(const LogRecord& rec, char* buf)
+    {
+        time_t second = static_cast<time_t>(rec.time_us / 1000000);
+        if (second != cached_second_)
+        {
+            struct tm tm;
+            localtime_r(&second, &tm);
+            strftime(cached_time_, sizeof(cached_time_), "%Y-%m-%d %H:%M:%S", &tm);
+            cached_second_ = second;
+        }
+
+        int n = snprintf(buf, kPrefixLen, "%s.%06u [%s][%u] ", cached_time_,
+                         static_cast<unsigned>(rec.time_us % 1000000),
+                         kLevelName[rec.level], rec.tid);
+        return n < kPrefixLen ? n : kPrefixLen - 1;
+    }
+
+    void report_dropped(uint64_t dropped)
+    {
+        if (dropped == reported_dropped_) return;
+
+        uint64_t now = now_us();
+        if (now - last_report_us_ < 1000000) return;
+
+        char buf[96];
+        int n = snprintf(buf, sizeof(buf), "natsu log overflow, %llu records dropped\n",
+                         static_cast<unsigned long long>(dropped - reported_dropped_));
+        struct iovec iov;
+        iov.iov_base = buf;
+        iov.iov_len = n;
+        writev_all(&iov, 1);
+        reported_dropped_ = dropped;
+        last_report_us_ = now;
+    }
+
+    void writev_all(struct iovec* iov, size_t cnt)
+    {
+        int fd = fd_.load(std::memory_order_relaxed);
+        while (cnt > 0)
+        {
+            ssize_t n = ::writev(fd, iov, static_cast<int>(cnt));
+            if (n == -1)
+            {
+                if (EINTR == errno || EAGAIN == errno)
+                    continue;
+                return;
+            }
+
+            while (cnt > 0 && static_cast<size_t>(n) >= iov->iov_len)
+            {
+                n -= iov->iov_len;
+                ++iov;
+                --cnt;
+            }
+
+            if (cnt > 0)
+            {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+                iov->iov_len -= n;
+            }
+        }
+    }
+
+private:
+    std::atomic<int> fd_;
+    std::atomic<int> level_;
+    std::atomic<bool> access_;
+
+    std::mutex rings_lock_;
+    std::vector<LogRing*> rings_;
+
+    // consumer side, only touched with consume_lock_ held
+    std::mutex consume_lock_;
+    uint64_t reported_dropped_;
+    uint64_t retired_dropped_;  // drops counted by rings already freed
+    uint64_t last_report_us_;
+    time_t cached_second_;
+    char cached_time_[24];
+    char prefix_[kBatch][kPrefixLen];
+    char text_[kBatch][kLineMax];
+};
+
+}
+
+void log_init(int fd, LogLevel level, bool access)
+{
+    Logger::instance().init(fd, level, access);
+}
+
+bool log_enabled(LogLevel level)
+{
+    return Logger::instance().enabled(level);
+}
+
+void log_push(LogLevel level, const char* fmt, const LogArg* args, size_t n)
+{
+    Logger::instance().push(level, fmt, args, n);
+}
+
+void log_flush()
+{
+    Logger::instance().drain();
+}
+
+}
@@ -0,0 +1,26 @@
+#ifndef NATSU_NUMBER_H_
+#define NATSU_NUMBER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace natsu {
+
+// decimal digits, two per step, buf holds at least 20 bytes (21 signed)
+// @return bytes written, nothing is terminated
+size_t format_uint(uint64_t v, char* buf);
+size_t format_int(int64_t v, char* buf);
+
+/* *
+ * format_double
+ * the shortest decimal that reads back as exactly v (Ryu), laid out like
+ * python's repr: 0.1, 3.0, 1e+16, 1.5e-07. a '.' or an exponent is always
+ * there so the text stays a floating point number. v must be finite and
+ * buf hold at least 32 bytes.
+ * @return bytes written, nothing is terminated
+*/
+size_t format_double(double v, char* buf);
+
+}
+
+#endif
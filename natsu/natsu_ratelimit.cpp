@@ -0,0 +1,172 @@
+#include "natsu_ratelimit.h"
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+namespace natsu {
+
+static const size_t kWays = 4;
+
+struct RateLimiter::Set
+{
+    struct Slot
+    {
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> tat;  // theoretical arrival time, the bucket is full from then on
+    };
+
+    Slot slot[kWays];
+};
+
+static uint64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// FNV-1a, keys are short addresses or tokens
+static uint64_t hash_key(const char* key, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for(size_t i = 0; i < len; ++i)
+    {
+        h ^= static_cast<unsigned char>(key[i]);
+        h *= 1099511628211ULL;
+    }
+
+    return h ? h : 1;
+}
+
+RateLimiter::RateLimiter(const RateLimitOptions& opts)
+{
+    size_t sets = 1;
+    while(sets * kWays < opts.max_keys)
+        sets <<= 1;
+
+    //one set per cache line, so a decision touches a single line
+    void* mem = NULL;
+    if(posix_memalign(&mem, 64, sets * sizeof(Set)) != 0)
+        throw std::bad_alloc();
+
+    sets_ = static_cast<Set*>(mem);
+    for(size_t i = 0; i < sets; ++i)
+    {
+        for(size_t w = 0; w < kWays; ++w)
+        {
+            sets_[i].slot[w].key.store(0, std::memory_order_relaxed);
+            sets_[i].slot[w].tat.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    mask_ = sets - 1;
+    interval_ = static_cast<uint64_t>(1e9 / std::max(opts.rate, 1e-3));
+    tolerance_ = interval_ * std::max(opts.burst, 1u);
+}
+
+RateLimiter::~RateLimiter()
+{
+    free(sets_);
+}
+
+bool RateLimiter::allow(const std::string& key)
+{
+    unsigned retry_after = 0;
+    return allow(key.c_str(), key.size(), retry_after);
+}
+
+bool RateLimiter::allow(const char* key, size_t len, unsigned& retry_after)
+{
+    uint64_t h = hash_key(key, len);
+    Set& set = sets_[(h >> 16) & mask_];
+    uint64_t now = now_ns();
+
+    Set::Slot* slot = NULL;
+    for(size_t w = 0; w < kWays; ++w)
+    {
+        if(set.slot[w].key.load(std::memory_order_relaxed) == h)
+        {
+            slot = &set.slot[w];
+            break;
+        }
+    }
+
+    if(slot == NULL)
+    {
+        //the bucket refilled longest ago belongs to the idlest key
+        slot = &set.slot[0];
+        uint64_t oldest = slot->tat.load(std::memory_order_relaxed);
+        for(size_t w = 1; w < kWays; ++w)
+        {
+            uint64_t tat = set.slot[w].tat.load(std::memory_order_relaxed);
+            if(tat < oldest)
+            {
+                oldest = tat;
+                slot = &set.slot[w];
+            }
+        }
+
+        //racing inserts may both land here, the loser just shares a bucket for a while
+        slot->tat.store(0, std::memory_order_relaxed);
+        slot->key.store(h, std::memory_order_relaxed);
+    }
+
+    uint64_t tat = slot->tat.load(std::memory_order_relaxed);
+    while(true)
+    {
+        uint64_t next = std::max(tat, now) + interval_;
+        if(next - now > tolerance_)
+        {
+            retry_after = static_cast<unsigned>((next - now - tolerance_ + 999999999ULL) / 1000000000ULL);
+            return false;
+        }
+
+        if(slot->tat.compare_exchange_weak(tat, next, std::memory_order_relaxed))
+            return true;
+    }
+}
+
+RateLimitInject::RateLimitInject(const RateLimitOptions& opts, std::shared_ptr<Inject> next)
+: limiter_(opts), header_(opts.header), next_(next)
+{
+    //the parser stores header names in lower case
+    std::transform(header_.begin(), header_.end(), header_.begin(), ::tolower);
+}
+
+void RateLimitInject::before(std::shared_ptr<natsu::http::HttpRequest>& req,
+                             std::shared_ptr<natsu::http::HttpResponse>& rsp)
+{
+    std::string key;
+    if(header_.size())
+        key = req->header(header_);
+
+    const std::string& k = key.empty() ? req->remote() : key;
+    unsigned retry_after = 0;
+    if(!limiter_.allow(k.c_str(), k.size(), retry_after))
+    {
+        rsp->response(429);
+        rsp->header("Retry-After", std::to_string(retry_after));
+        return;
+    }
+
+    if(next_) next_->before(req, rsp);
+}
+
+void RateLimitInject::after(std::shared_ptr<natsu::http::HttpRequest>& req,
+                            std::shared_ptr<natsu::http::HttpResponse>& rsp)
+{
+    if(next_) next_->after(req, rsp);
+}
+
+void RateLimitInject::fail(std::shared_ptr<natsu::http::HttpRequest>& req,
+                           std::shared_ptr<natsu::http::HttpResponse>& rsp)
+{
+    if(next_)
+        next_->fail(req, rsp);
+    else
+        rsp->response(500);
+}
+
+}
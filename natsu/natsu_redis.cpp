@@ -4,8 +4,9 @@
 #include <exception>
 #include "singleton.h"
 #include "hiredis/hiredis.h"
-#include "gci-json.h"
-#include "format.h"
+#include "natsu_json.h"
+#include "natsu_format.h"
+#include "natsu_deadline.h"
  
 
 namespace natsu {
@@ -36,25 +37,20 @@ public:
 	: redis_name_(name)
 	{
 		redis_config_.reset(new RedisConfig);
-		ggicci::Json object = ggicci::Json::Parse(config.c_str());
-		if(object.IsNull())
+		json::Document object;
+		if(!object.parse(config) || !object.root().is_object())
 		{
 			throw std::logic_error("json parse failed");
 		}
 
-		redis_config_->addr = object[_NATSU_REDIS_SERVER_ADDR_].AsString();
-		redis_config_->port = object[_NATSU_REDIS_SERVER_PORT_].AsInt();
+		redis_config_->addr = object[_NATSU_REDIS_SERVER_ADDR_].as_string();
+		redis_config_->port = object[_NATSU_REDIS_SERVER_PORT_].as_int();
 
-		try
-		{
-			redis_config_->conntimeout = object[_NATSU_REDIS_CONNECT_TIMEOUT_].AsInt();
-			if(redis_config_->conntimeout < 1)
-				redis_config_->conntimeout = _NATSU_REDIS_CONNECT_TIMEOUT_DEFAULT_;
-		}
-		catch(...)
-		{
+		const json::Value& conntimeout = object[_NATSU_REDIS_CONNECT_TIMEOUT_];
+		if(conntimeout.is_number() && conntimeout.as_int() >= 1)
+			redis_config_->conntimeout = conntimeout.as_int();
+		else
 			redis_config_->conntimeout = _NATSU_REDIS_CONNECT_TIMEOUT_DEFAULT_;
-		}
 
 		connect_timeout_.tv_sec = redis_config_->conntimeout;
 		connect_timeout_.tv_usec = 0;
@@ -189,7 +185,7 @@ public:
     	v.push_back(key);
     	v.push_back(value);
     	v.push_back("PX");
-    	v.push_back(format("%d", millisecond));
+    	v.push_back(NATSU_FORMAT("{}", millisecond));
     	v.push_back(set_when_exist ? "XX" : "NX");
     	if(do_redis_command_format("set", v))
     	{
@@ -356,17 +352,13 @@ private:
 	    return NULL;
 	}
 
-	bool do_redis_command_format(const std::string& cmd, std::vector<std::string> v)
+	bool do_redis_command_format(const std::string& cmd, const std::vector<std::string>& v)
 	{
 		redis_reply_.reset();
 		cmd_cache_.clear();
-		cmd_cache_ = format("*%d\r\n$%d\r\n%s\r\n", v.size() + 1, cmd.size(), cmd.c_str());
+		NATSU_FORMAT_TO(cmd_cache_, "*{}\r\n${}\r\n{}\r\n", v.size() + 1, cmd.size(), cmd);
 		for (size_t i = 0; i < v.size(); ++i)
-		{
-			cmd_cache_.append(format("$%d\r\n", v[i].size()));
-			cmd_cache_.append(v[1]);
-			cmd_cache_.append("\r\n");
-		}
+			NATSU_FORMAT_TO(cmd_cache_, "${}\r\n{}\r\n", v[i].size(), v[i]);
 
 		redis_error_.clear();
 		if(NULL == redis_context_.get())
@@ -391,7 +383,7 @@ private:
 			}
 		}
 		
-		if(REDIS_OK == redisAppendFormattedCommand(redis_context_.get(), cmd.c_str(), cmd.size()))
+		if(REDIS_OK != redisAppendFormattedCommand(redis_context_.get(), cmd_cache_.data(), cmd_cache_.size()))
 		{
 			redis_error_.code() = redis_context_.get() ? redis_context_->err : -1;
 			redis_error_.reason() = redis_context_.get() ? redis_context_->errstr : "";
@@ -409,7 +401,7 @@ private:
 				return false;
 			}
 
-			if(REDIS_OK == redisAppendFormattedCommand(redis_context_.get(), cmd.c_str(), cmd.size()))
+			if(REDIS_OK != redisAppendFormattedCommand(redis_context_.get(), cmd_cache_.data(), cmd_cache_.size()))
 			{
 				redis_error_.code() = redis_context_.get() ? redis_context_->err : -1;
 				redis_error_.reason() = redis_context_.get() ? redis_context_->errstr : "";
@@ -532,7 +524,12 @@ public:
 		std::map<std::string,std::shared_ptr<co_chan<RedisClientImpl*>>>::iterator iter = redis_.find(redisname);
 		if(iter != redis_.end())
 		{
-			(*iter->second) >> client;
+			//every link busy past the deadline gives no client at all
+			Deadline until = deadline();
+			if(until == Deadline::max())
+				(*iter->second) >> client;
+			else
+				iter->second->TimedPop(client, until);
 		}
 
 		return client;
@@ -565,7 +562,11 @@ void delRedisInstance(RedisClientImpl* client)
 
 std::shared_ptr<RedisClient> newRedisInstance(const std::string& redisname)
 {
-	std::shared_ptr<RedisClient> client(RedisManager::instance().get_redis_server(redisname), delRedisInstance);
+	RedisClientImpl* impl = RedisManager::instance().get_redis_server(redisname);
+	if(impl == NULL)
+		return std::shared_ptr<RedisClient>();
+
+	std::shared_ptr<RedisClient> client(impl, delRedisInstance);
 	return client;
 }
 
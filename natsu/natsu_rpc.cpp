@@ -1,10 +1,13 @@
 #include "coroutine.h"
 #include "natsu_rpc.h"
 #include "natsu_config.h"
+#include "natsu_log.h"
 #include "natsu_snowflake.h"
-#include "format.h"
-#include "gci-json.h"
-#include <curl/curl.h>
+#include "natsu_format.h"
+#include "natsu_json.h"
+#include "http_client.h"
+#include "natsu_buffer.h"
+#include "natsu_deadline.h"
 
 namespace natsu
 {
@@ -23,6 +26,14 @@ enum { PACKET_SIZE_MAX = 4096, };
 const int kHeaderLen = 12;
 const int kMaxChannelSize = 1024;
 
+// timer callbacks run on the scheduler loop instead of a coroutine, so
+// anything that may block on network IO is started as a coroutine from there
+template <typename F>
+static void go_after(std::chrono::seconds delay, F const& fn)
+{
+    co_timer_add(delay, [fn]{ go fn; });
+}
+
 int64_t generate()
 {
     return SnowFlake::instance().generate();
@@ -58,12 +69,17 @@ public:
     // WARN: Decode() & GetMessage() is not threadsafe
     // 	     caller need locked before called
 
-    // unpcak tcp stream data
+    // unpcak tcp stream data in place
     // when this called, then can call GetMessage()
-    void Decode(const char* data, size_t len)
+    // a trailing partial packet is not consumed, caller keeps it buffered
+    // return bytes consumed
+    size_t Decode(const char* data, size_t len)
     {
-        buffer_.append(data, len);
-        while (ParseStream()) {};
+        size_t pos = 0;
+        while (size_t n = ParseStream(data + pos, len - pos))
+            pos += n;
+
+        return pos;
     }
 
     // get unpacked google protobuf message poniter
@@ -116,33 +132,32 @@ public:
     }
 
 private:
-    bool ParseStream()
+    // return bytes of one packet, 0 when it is not complete yet
+    size_t ParseStream(const char* buf, size_t len)
     {
-        if (buffer_.size() < 12)
-            return false;
+        if (len < kHeaderLen)
+            return 0;
 
         unsigned int packetlen = 0;
-        ::memcpy(&packetlen, buffer_.c_str(), sizeof(packetlen));
-        if (buffer_.size() < packetlen)
+        ::memcpy(&packetlen, buf, sizeof(packetlen));
+        if (packetlen > PACKET_SIZE_MAX)
         {
-            return false;
+            // stream is out of sync, drop what we have
+            return len;
         }
 
-        if (packetlen > PACKET_SIZE_MAX)
+        if (len < packetlen + kHeaderLen)
         {
-            buffer_.clear();
-            return false;
+            return 0;
         }
 
         int64_t rid = 0;
-        ::memcpy(&rid, buffer_.c_str() + sizeof(int32_t), sizeof(rid));
-
-        Message* message = DecodeMessage(buffer_.c_str() + kHeaderLen, packetlen);
-        buffer_.erase(0, packetlen + kHeaderLen);
+        ::memcpy(&rid, buf + sizeof(int32_t), sizeof(rid));
 
+        Message* message = DecodeMessage(buf + kHeaderLen, packetlen);
         if (message)
             message_[rid] = message;
-        return true;
+        return packetlen + kHeaderLen;
     }
 
     inline Message* DecodeMessage(const char* buf, size_t bufferlength)
@@ -184,7 +199,7 @@ private:
             }//else { // check sum error }
             else
             {
-                fprintf(stderr, "checksum error\n");
+                NATSU_LOG_WARN("rpc packet checksum error");
             }
         }
 
@@ -210,7 +225,6 @@ private:
     }
 
 private:
-    std::string buffer_;
     std::map<int64_t, Message*> message_;
 };
 
@@ -235,7 +249,7 @@ public:
             socklen_t len = sizeof(addr);
             if (-1 == bind(sock, (sockaddr*)&addr, len))
             {
-                fprintf(stderr, "rpc bind [%d] error: %s\n", port, strerror(errno));
+                NATSU_LOG_ERROR("rpc bind [%d] error: %s", port, strerror(errno));
                 close(sock);
                 co_sleep(3000);
                 sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -245,7 +259,7 @@ public:
 
             if (-1 == ::listen(sock, 5))
             {
-                fprintf(stderr, "rpc listen error: %s\n", strerror(errno));
+                NATSU_LOG_ERROR("rpc listen error: %s", strerror(errno));
                 close(sock);
                 co_sleep(3000);
                 sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -253,9 +267,9 @@ public:
                 continue;
             }
 
-            NatsuConfig::config("rpc_instance_id", format("%lld", generate()));
-            fprintf(stderr, "etcd provider provide %s\n", NatsuConfig::config("rpc_instance_id").c_str());
-            co_timer_add(std::chrono::seconds(1), std::bind(&EtcdProvider::register_to_etcd, this, servicename, etcdaddr, port));
+            NatsuConfig::config("rpc_instance_id", NATSU_FORMAT("{}", generate()));
+            NATSU_LOG_INFO("etcd provider provide %s", NatsuConfig::config("rpc_instance_id").c_str());
+            go_after(std::chrono::seconds(1), std::bind(&EtcdProvider::register_to_etcd, this, servicename, etcdaddr, port));
             break;
         }
 
@@ -269,7 +283,7 @@ public:
                 if (EAGAIN == errno || EINTR == errno)
                     continue;
 
-                fprintf(stderr, "accept error: %s\n", strerror(errno));
+                NATSU_LOG_ERROR("rpc accept error: %s", strerror(errno));
                 break ;
             }
 
@@ -283,46 +297,38 @@ private:
     void register_to_etcd(const std::string& sname, const std::string& addr, unsigned short port)
     {
         //curl -L http://127.0.0.1:2379/v2/keys/foo -XPUT -d value=bar -d ttl=5
-        std::string request_url = format("http://%s/v2/keys/natsu/%s/provider/%s", addr.c_str(), sname.c_str(),
-                                         NatsuConfig::config("rpc_instance_id").c_str());
-
-        CURL* curl = curl_easy_init();
-        if (curl)
+        std::shared_ptr<const ConfigSnapshot> conf = NatsuConfig::snapshot();
+        std::string request_url = NATSU_FORMAT("http://{}/v2/keys/natsu/{}/provider/{}", addr, sname,
+                                               conf->get("rpc_instance_id"));
+
+        std::string data = NATSU_FORMAT("value={}:{}&ttl=15", conf->get("local_ipv4"), port);
+        NatsuError err;
+        std::shared_ptr<http::HttpClientResponse> rsp = http::HttpClient::instance().put(request_url, data,
+                                                            "application/x-www-form-urlencoded", err);
+        if(!rsp)
         {
-            curl_easy_setopt(curl, CURLOPT_URL, request_url.c_str());
-            curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT"); /* !!! */
-            std::string data = format("value=%s:%d&ttl=15",NatsuConfig::config("local_ipv4").c_str(), port);
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
-            curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5);
-
-            CURLcode res = curl_easy_perform(curl);
-            if(res != CURLE_OK)
-            {
-                std::string err = curl_easy_strerror(res);
-                fprintf(stderr, "register_to_etcd request etcd error : %s\n", err.c_str());
-            }
-
-            curl_easy_cleanup(curl);
+            NATSU_LOG_ERROR("register_to_etcd request etcd error : %s", err.reason().c_str());
         }
 
-        co_timer_add(std::chrono::seconds(10), std::bind(&EtcdProvider::register_to_etcd, this, sname, addr, port));
+        go_after(std::chrono::seconds(10), std::bind(&EtcdProvider::register_to_etcd, this, sname, addr, port));
     }
 
     void handle(int sockfd)
     {
-        fprintf(stderr, "provider accept producer connection %d\n", sockfd);
+        NATSU_LOG_INFO("provider accept producer connection %d", sockfd);
         co_chan<std::shared_ptr<std::string>> channel_write(kMaxChannelSize);
         co_mutex locker;
         locker.lock();
         go std::bind(&EtcdProvider::sendrpc, this, sockfd, channel_write, locker);
 
-        char buf[1024];
+        RpcPacketParser parser;
+        ReadBuffer input;
         while(true)
         {
-            int n = read(sockfd, buf, sizeof(buf));
+            ssize_t n = input.read(sockfd);
             if (n == -1)
             {
-                fprintf(stderr, "provider read failed %d\n", errno);
+                NATSU_LOG_DEBUG("provider read failed %d", errno);
                 if (EAGAIN == errno || EINTR == errno)
                     continue;
 
@@ -330,17 +336,17 @@ private:
             }
             else if (n == 0)
             {
-                fprintf(stderr, "provider read timeout\n");
+                NATSU_LOG_INFO("provider read timeout");
                 break;
             }
             else
             {
-                rpc_parser_.Decode(buf, n);
+                input.consume(parser.Decode(input.data(), input.size()));
                 MessagePtr message;
                 while( true )
                 {
                     int64_t rid = 0;
-                    message = rpc_parser_.GetMessage(rid);
+                    message = parser.GetMessage(rid);
                     if(message.get())
                         go std::bind(&EtcdProvider::handle_parse, this, message, rid, channel_write);
                     else
@@ -352,12 +358,12 @@ private:
 
         locker.lock();
         close(sockfd);
-        fprintf(stderr, "provider find producer lost %d\n", sockfd);
+        NATSU_LOG_INFO("provider find producer lost %d", sockfd);
     }
 
     void handle_parse(MessagePtr message, int64_t rid, co_chan<std::shared_ptr<std::string>>& channel_write)
     {
-        fprintf(stderr, "got one rpc request and handle it\n");
+        NATSU_LOG_DEBUG("got one rpc request and handle it");
         if(!message) return;
 
         if(kRpcMethod.find(message->GetTypeName()) != kRpcMethod.end())
@@ -371,7 +377,7 @@ private:
             }
             else
             {
-                fprintf(stderr, "handle rpc failed\n");
+                NATSU_LOG_WARN("handle rpc %s failed", message->GetTypeName().c_str());
             }
         }
     }
@@ -413,8 +419,8 @@ public:
     void produce_service_etcd(const std::string& servicename, const std::string& etcdaddr)
     {
         service_name_ = servicename;
-        co_timer_add(std::chrono::seconds(1), std::bind(&EtcdProducer::produce_from_etcd, this, servicename, etcdaddr));
-        co_timer_add(std::chrono::seconds(10), std::bind(&EtcdProducer::handle_produce_timeout, this));
+        go_after(std::chrono::seconds(1), std::bind(&EtcdProducer::produce_from_etcd, this, servicename, etcdaddr));
+        go_after(std::chrono::seconds(10), std::bind(&EtcdProducer::handle_produce_timeout, this));
     }
 
     MessagePtr invoke(MessagePtr& ptr)
@@ -422,12 +428,23 @@ public:
         uint64_t id = generate();
         RpcChannelData data;
         data.id = id;
-        std::shared_ptr<co_chan<MessagePtr>> newchannel(new co_chan<MessagePtr>);
+        //a reply arriving after the caller gave up must not block the reader
+        std::shared_ptr<co_chan<MessagePtr>> newchannel(new co_chan<MessagePtr>(1));
         data.msg = ptr;
         natsu::kClientRpcChannel[id] = newchannel;
-        (*natsu::kServiceRpcChannel[service_name_]) << data;
+        std::shared_ptr<co_chan<RpcChannelData>>& service = natsu::kServiceRpcChannel[service_name_];
         MessagePtr rsp;
-        (*newchannel) >> rsp;
+        Deadline until = deadline();
+        if(until == Deadline::max())
+        {
+            (*service) << data;
+            (*newchannel) >> rsp;
+        }
+        else if(!service->TimedPush(data, until) || !newchannel->TimedPop(rsp, until))
+        {
+            NATSU_LOG_WARN("%lu deadline exceeded and return null", id);
+        }
+
         natsu::kClientRpcChannel.erase(id);
         return rsp;
     }
@@ -443,129 +460,114 @@ private:
         {
             if((n - it->first) > diff)
             {
-                fprintf(stderr, "%lu timeout and return null\n", it->first);
+                NATSU_LOG_WARN("%lu timeout and return null", it->first);
                 MessagePtr ptr;
                 (*it->second) << ptr;
             }
         }
 
-        co_timer_add(std::chrono::seconds(10), std::bind(&EtcdProducer::handle_produce_timeout, this));
+        go_after(std::chrono::seconds(10), std::bind(&EtcdProducer::handle_produce_timeout, this));
     }
 
     void produce_from_etcd(const std::string& servicename, const std::string& etcdaddr)
     {
-        std::string request_url = format("http://%s/v2/keys/natsu/%s/provider/", etcdaddr.c_str(), servicename.c_str());
-        //fprintf(stderr, "rpc get: %s\n", request_url.c_str());
-        CURL* curl = curl_easy_init();
-        std::string body;
-        if (curl)
+        std::string request_url = NATSU_FORMAT("http://{}/v2/keys/natsu/{}/provider/", etcdaddr, servicename);
+        //NATSU_LOG_DEBUG("rpc get: %s", request_url.c_str());
+        NatsuError err;
+        std::shared_ptr<http::HttpClientResponse> rsp = http::HttpClient::instance().get(request_url, err);
+        if(!rsp)
         {
-            curl_easy_setopt(curl, CURLOPT_URL, request_url.c_str());
-            curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
-            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &EtcdProducer::writer);
-            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
-            curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5);
-
-            CURLcode res = curl_easy_perform(curl);
-            if(res != CURLE_OK)
-            {
-                std::string err = curl_easy_strerror(res);
-                fprintf(stderr, "produce_from_etcd request etcd error : %s\n", err.c_str());
+            NATSU_LOG_ERROR("produce_from_etcd request etcd error : %s", err.reason().c_str());
+        }
+        else
+        {
+            const std::string& body = rsp->body();
+            //parse etcd response and update ip list
+            /*
+            {"action":"get",
+            	"node":{ "key":"/natsu/im/provider","dir":true,"nodes":
+            		[{   "key":"/natsu/im/provider/6182415165179297793",
+            			"value":"127.0.0.1:9383",
+            			"expiration":"2016-09-16T06:20:41.169943308Z",
+            			"ttl":9,
+            			"modifiedIndex":5,
+            			"createdIndex":5
+            		}],
+            		"modifiedIndex":4,"createdIndex":4
+            	}
             }
-            else
-            {
-                //parse etcd response and update ip list
-                /*
-                {"action":"get",
-                	"node":{ "key":"/natsu/im/provider","dir":true,"nodes":
-                		[{   "key":"/natsu/im/provider/6182415165179297793",
-                			"value":"127.0.0.1:9383",
-                			"expiration":"2016-09-16T06:20:41.169943308Z",
-                			"ttl":9,
-                			"modifiedIndex":5,
-                			"createdIndex":5
-                		}],
-                		"modifiedIndex":4,"createdIndex":4
-                	}
-                }
 
-                //or
-                {"action":"get","node":{"key":"/natsu/im/provider","dir":true,"modifiedIndex":4,"createdIndex":4}}
+            //or
+            {"action":"get","node":{"key":"/natsu/im/provider","dir":true,"modifiedIndex":4,"createdIndex":4}}
 
-                //or
-                {"errorCode":100,"message":"Key not found","cause":"/natsu/ims","index":25}
-                */
+            //or
+            {"errorCode":100,"message":"Key not found","cause":"/natsu/ims","index":25}
+            */
 
-                try
+            try
+            {
+                json::Document object;
+                if(!object.parse(body))
+                    throw std::runtime_error(object.error());
+
+                const json::Value& action = object["action"];
+                if(action.is_string())
                 {
-                    ggicci::Json object = ggicci::Json::Parse(body.c_str());
-                    if(object.Contains("action"))
+                    if(action.equals("get", 3) && object.root().contains("node"))
                     {
-                        if(object["action"].AsString() == "get" && object.Contains("node"))
+                        const json::Value& object_node = object["node"];
+                        if(object_node.contains("nodes"))
                         {
-                            ggicci::Json object_node = object["node"];
-                            if(object_node.Contains("nodes"))
+                            std::map<std::string,std::string> result;
+                            std::map<std::string,std::string> nodelist = service_node_;
+                            service_node_.clear();
+                            const json::Value& object_nodes = object_node["nodes"];
+                            for(size_t i = 0; i < object_nodes.size(); i++)
                             {
-                                std::map<std::string,std::string> result;
-                                std::map<std::string,std::string> nodelist = service_node_;
-                                service_node_.clear();
-                                ggicci::Json object_nodes = object_node["nodes"];
-                                for(int i = 0; i < object_nodes.Size(); i++)
+                                const json::Value& object_item = object_nodes[i];
+                                std::string key = object_item["key"].as_string();
+                                std::string value = object_item["value"].as_string();
+                                result[key] = value;
+                                service_node_[key] = value;
+
+                                if(nodelist.find(key) == nodelist.end())
                                 {
-                                    ggicci::Json object_item = object_nodes[i];
-                                    result[object_item["key"].AsString()] = object_item["value"].AsString();
-                                    service_node_[object_item["key"].AsString()] = object_item["value"].AsString();
-
-                                    if(nodelist.find(object_item["key"].AsString()) == nodelist.end())
-                                    {
-                                        fprintf(stderr, "got one server : %s=%s\n",object_item["key"].AsString().c_str(), object_item["value"].AsString().c_str());
-                                        go std::bind(&EtcdProducer::comm_one_server, this, object_item["key"].AsString());
-                                    }
-
-                                    service_node_.clear();
-                                    service_node_ = result;
+                                    NATSU_LOG_INFO("got one server : %s=%s", key.c_str(), value.c_str());
+                                    go std::bind(&EtcdProducer::comm_one_server, this, key);
                                 }
 
-                                //log
-                                std::map<std::string,std::string>::iterator it = nodelist.begin();
-                                for (; it != nodelist.end(); ++it)
+                                service_node_.clear();
+                                service_node_ = result;
+                            }
+
+                            //log
+                            std::map<std::string,std::string>::iterator it = nodelist.begin();
+                            for (; it != nodelist.end(); ++it)
+                            {
+                                if(service_node_.find(it->first) == service_node_.end())
                                 {
-                                    if(service_node_.find(it->first) == service_node_.end())
-                                    {
-                                        fprintf(stderr, "del one server : %s=%s\n", it->first.c_str(), it->second.c_str());
-                                    }
+                                    NATSU_LOG_INFO("del one server : %s=%s", it->first.c_str(), it->second.c_str());
                                 }
-
                             }
+
                         }
                     }
                 }
-                catch(...)
-                {
-                    fprintf(stderr, "etcd response exception :%s\n", body.c_str());
-                }
             }
-
-            curl_easy_cleanup(curl);
+            catch(...)
+            {
+                NATSU_LOG_ERROR("etcd response exception :%s", body.c_str());
+            }
         }
 
-        co_timer_add(std::chrono::seconds(10), std::bind(&EtcdProducer::produce_from_etcd, this, servicename, etcdaddr));
-    }
-
-    static long writer(void *data, int size, int nmemb, std::string &content)
-    {
-        long sizes = size * nmemb;
-        std::string temp;
-        temp = std::string((char*)data,sizes);
-        content += temp;
-        return sizes;
+        go_after(std::chrono::seconds(10), std::bind(&EtcdProducer::produce_from_etcd, this, servicename, etcdaddr));
     }
 
     void comm_one_server(const std::string& node)
     {
         if(service_node_.find(node) == service_node_.end())
         {
-            fprintf(stderr, "comm_one_server no this node %s\n", node.c_str());
+            NATSU_LOG_WARN("comm_one_server no this node %s", node.c_str());
             return ;
         }
 
@@ -584,8 +586,8 @@ private:
 
         if(bind(sockfd,(struct sockaddr*)&client_addr,sizeof(client_addr)))
         {
-            fprintf(stderr, "etcd produce bind failed!\n");
-            co_timer_add(std::chrono::seconds(10), std::bind(&EtcdProducer::comm_one_server, this, node));
+            NATSU_LOG_ERROR("etcd produce bind failed!");
+            go_after(std::chrono::seconds(10), std::bind(&EtcdProducer::comm_one_server, this, node));
             close(sockfd);
             return ;
         }
@@ -595,8 +597,8 @@ private:
         server_addr.sin_family = AF_INET;
         if(inet_aton(ip.c_str(), &server_addr.sin_addr) == 0)
         {
-            fprintf(stderr,"etcd produce inet_aton failed %s!\n", ip.c_str());
-            co_timer_add(std::chrono::seconds(10), std::bind(&EtcdProducer::comm_one_server, this, node));
+            NATSU_LOG_ERROR("etcd produce inet_aton failed %s!", ip.c_str());
+            go_after(std::chrono::seconds(10), std::bind(&EtcdProducer::comm_one_server, this, node));
             close(sockfd);
             return ;
         }
@@ -605,8 +607,8 @@ private:
         socklen_t server_addr_length = sizeof(server_addr);
         if(connect(sockfd,(struct sockaddr*)&server_addr, server_addr_length) < 0)
         {
-            fprintf(stderr,"etcd produce connect failed %s:%s!\n", ip.c_str(),port.c_str());
-            co_timer_add(std::chrono::seconds(10), std::bind(&EtcdProducer::comm_one_server, this, node));
+            NATSU_LOG_ERROR("etcd produce connect failed %s:%s!", ip.c_str(), port.c_str());
+            go_after(std::chrono::seconds(10), std::bind(&EtcdProducer::comm_one_server, this, node));
             close(sockfd);
             return ;
         }
@@ -619,11 +621,11 @@ private:
         {
             RpcChannelData data;
             (*kServiceRpcChannel[service_name_]) >> data;
-            fprintf(stderr, "process one rpc request\n");
+            NATSU_LOG_DEBUG("process one rpc request");
             std::shared_ptr<std::string> bin = RpcPacketParser::Encode(data.msg.get(), data.id);
             if(!bin)
             {
-                fprintf(stderr, "encoding rpc data failed\n");
+                NATSU_LOG_WARN("encoding rpc data failed");
                 continue;
             }
 
@@ -634,8 +636,8 @@ private:
                 ssize_t n = write(sockfd, bin->c_str() + pos, bin->size() - pos);
                 if(n == -1)
                 {
-                    fprintf(stderr, "%s send failed\n", node.c_str() );
-                    co_timer_add(std::chrono::seconds(10), std::bind(&EtcdProducer::comm_one_server, this, node));
+                    NATSU_LOG_ERROR("%s send failed", node.c_str());
+                    go_after(std::chrono::seconds(10), std::bind(&EtcdProducer::comm_one_server, this, node));
                     locker.lock();
                     close(sockfd);
                     return ;
@@ -649,10 +651,10 @@ private:
     void handle_parse(int sockfd, co_mutex locker)
     {
         RpcPacketParser rpc_parser_;
-        char buf[1024];
+        ReadBuffer input;
         while(true)
         {
-            int n = read(sockfd, buf, sizeof(buf));
+            ssize_t n = input.read(sockfd);
             if (n == -1)
             {
                 if (EAGAIN == errno || EINTR == errno)
@@ -666,7 +668,7 @@ private:
             }
             else
             {
-                rpc_parser_.Decode(buf, n);
+                input.consume(rpc_parser_.Decode(input.data(), input.size()));
                 MessagePtr message;
                 while( true )
                 {
@@ -680,7 +682,7 @@ private:
                         }
                         else
                         {
-                            fprintf(stderr, "unable find %ld message\n", rid);
+                            NATSU_LOG_WARN("unable find %ld message", rid);
                         }
                     }
                     else
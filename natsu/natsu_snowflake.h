@@ -1,69 +1,86 @@
 #ifndef NATSU_SNOWFLAKE_H_
 #define NATSU_SNOWFLAKE_H_
 
-#include <sys/time.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <atomic>
 
 #include "singleton.h"
 
 namespace natsu{
 
+/* *
+ * SnowFlake
+ * 64 bit ids: milliseconds since 1970 << 22 | machine << 12 | sequence.
+ * the millisecond and the sequence share one atomic word, an id is a single
+ * CAS on it from any thread. when 4096 ids in a millisecond run out the
+ * next millisecond is taken before the clock gets there instead of waiting,
+ * and a clock stepping back is ignored the same way, so ids only grow.
+ * the clock is the coarse one the kernel keeps, read without a syscall.
+*/
 class SnowFlake : public singleton<SnowFlake>
 {
 public:
-	// generate unique id
-	int64_t generate()
-	{
-		int64_t value = 0;
-		value = now() << 22;
+    // generate unique id
+    int64_t generate()
+    {
+        return compose(reserve(1));
+    }
 
-        value |= (machine_ & 0x3FF) << 12;
+    // n ids in increasing order for one CAS, a burst of n costs one id's atomics
+    void generate(int64_t* ids, size_t n)
+    {
+        if(n == 0)
+            return;
 
-        if(last_timestamp_ != value)
-        {
-            sequence_ = 0;
-            last_timestamp_ = value;
-        }
+        uint64_t state = reserve(n) - (n - 1);
+        for(size_t i = 0; i < n; ++i)
+            ids[i] = compose(state + i);
+    }
 
-		// warn : if > 0x1000 ,must wait next second
-		if(++sequence_ >= 0x1000)
-        {
-            while(true)
-            {
-                value = now() << 22;
-                value |= (machine_ & 0x3FF) << 12;
-                if(last_timestamp_ != value)
-                    break;
-            }
+    // 0 ~ 1023
+    void set_machine(int machine)
+    {
+        machine_ = static_cast<uint64_t>(machine & 0x3FF) << 12;
+    }
 
-            sequence_ = 0;
-            last_timestamp_ = value;
-        }
+private:
+    SnowFlake() : machine_(0), state_(0) {}
+    friend class singleton<SnowFlake>;
 
-        value |= sequence_ & 0xFFF;
-        return value;
-	}
+    // moves the state on by n, @return the last one taken
+    uint64_t reserve(size_t n)
+    {
+        uint64_t floor = (now() << 12) + (n - 1);
+        uint64_t state = state_.load(std::memory_order_relaxed);
+        uint64_t next;
+        do
+        {
+            //the sequence carries into the millisecond by itself
+            next = state + n;
+            if(next < floor)
+                next = floor;
+        }
+        while(!state_.compare_exchange_weak(state, next, std::memory_order_relaxed));
+        return next;
+    }
 
-	// 0 ~ 1023
-	void set_machine(int machine)
-	{
-		machine_ = machine;
-	}
+    int64_t compose(uint64_t state) const
+    {
+        return static_cast<int64_t>(((state >> 12) << 22) | machine_ | (state & 0xFFF));
+    }
 
-private:
-	uint64_t now()
+    static uint64_t now()
     {
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        uint64_t time = tv.tv_usec;
-        time /= 1000;
-        time += (tv.tv_sec * 1000);
-        return time;
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
     }
 
 private:
-	int machine_;
-	int sequence_;
-	int64_t last_timestamp_;
+    uint64_t machine_;
+    std::atomic<uint64_t> state_;   // millisecond << 12 | sequence of the last id
 };
 
 }
@@ -0,0 +1,300 @@
+#include "natsu_sse.h"
+#include "natsu_buffer.h"
+#include "coroutine.h"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+namespace natsu {
+namespace http {
+
+static const int kMaxBatch = 16;
+static const int kSendTimeout = 30;     // seconds a write may block before the client counts as gone
+
+typedef std::shared_ptr<const std::string> Event;
+
+struct Subscriber
+{
+    Subscriber(size_t capacity, int fd) : queue(capacity), dropped(false), gone(false), sock(fd), done(false) {}
+
+    // the writer may be stuck in writev() to a stalled client, shutdown() wakes it
+    void drop()
+    {
+        dropped = true;
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!done)
+            shutdown(sock, SHUT_RDWR);
+    }
+
+    // called by the writer before the socket is handed back, drop() leaves it alone from here on
+    void finish()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+
+    co_chan<Event> queue;
+    std::atomic<bool> dropped;
+    std::atomic<bool> gone;     // unsubscribed, still in the snapshot until the next rebuild
+
+    std::mutex mutex;
+    int sock;
+    bool done;
+};
+
+static std::string format_event(const std::string& data, const std::string& event, const std::string& id)
+{
+    std::string s;
+    s.reserve(data.size() + event.size() + id.size() + 32);
+    if(id.size())
+    {
+        s.append("id: ");
+        s.append(id);
+        s.append("\n");
+    }
+
+    if(event.size())
+    {
+        s.append("event: ");
+        s.append(event);
+        s.append("\n");
+    }
+
+    //every line of the payload is a data field of its own
+    size_t begin = 0;
+    do
+    {
+        size_t end = data.find('\n', begin);
+        if(end == std::string::npos)
+            end = data.size();
+
+        s.append("data: ");
+        s.append(data, begin, end - begin);
+        s.append("\n");
+        begin = end + 1;
+    } while(begin <= data.size());
+
+    s.append("\n");
+    return s;
+}
+
+static bool write_events(int sock, Event* events, int count)
+{
+    iovec iov[kMaxBatch];
+    for(int i = 0; i < count; ++i)
+    {
+        iov[i].iov_base = const_cast<char*>(events[i]->data());
+        iov[i].iov_len = events[i]->size();
+    }
+
+    return writev_all(sock, iov, count);
+}
+
+class SseBroadcaster::SseBroadcasterImpl : public std::enable_shared_from_this<SseBroadcasterImpl>
+{
+    typedef std::vector<std::shared_ptr<Subscriber>> Subscribers;
+
+    // publish() walks a snapshot without the lock. joins and leaves are only
+    // recorded, the next publish() folds them into a new snapshot in one copy,
+    // so a burst of churn costs one rebuild instead of one copy per change
+    struct Topic
+    {
+        Topic() : live(0), left(0) {}
+
+        std::shared_ptr<const Subscribers> snapshot;
+        Subscribers joined;
+        size_t live;
+        size_t left;        // gone subscribers still in snapshot or joined
+    };
+
+public:
+    SseBroadcasterImpl(const SseOptions& opts)
+    : options_(opts), keepalive_(std::make_shared<const std::string>(":\n\n"))
+    {
+        if(options_.retry > 0)
+            retry_ = std::make_shared<const std::string>("retry: " + std::to_string(options_.retry) + "\n\n");
+    }
+
+    void subscribe(const std::string& topic, std::shared_ptr<HttpResponse>& rsp)
+    {
+        rsp->header("Content-Type", "text/event-stream");
+        rsp->header("Cache-Control", "no-cache");
+        rsp->header("X-Accel-Buffering", "no");
+
+        std::shared_ptr<SseBroadcasterImpl> self = shared_from_this();
+        rsp->stream([self, topic](int sock) {
+            return self->serve(topic, sock);
+        });
+    }
+
+    size_t publish(const std::string& topic, const std::string& data,
+                   const std::string& event, const std::string& id)
+    {
+        Event e = std::make_shared<const std::string>(format_event(data, event, id));
+
+        std::shared_ptr<const Subscribers> subs;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto t = topics_.find(topic);
+            if(t == topics_.end())
+                return 0;
+            if(t->second.joined.size() || t->second.left)
+                rebuild(t->second);
+            subs = t->second.snapshot;
+        }
+
+        size_t queued = 0;
+        std::vector<std::shared_ptr<Subscriber>> behind;
+        for(auto& sub : *subs)
+        {
+            if(sub->gone)
+                continue;
+
+            if(sub->queue.TryPush(e))
+                ++queued;
+            else if(!sub->dropped)
+                behind.push_back(sub);
+        }
+
+        //too far behind, the connection is cut and its writer quits
+        for(auto& sub : behind)
+        {
+            sub->drop();
+            unsubscribe(topic, sub);
+        }
+
+        return queued;
+    }
+
+    size_t subscribers(const std::string& topic)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto t = topics_.find(topic);
+        return t == topics_.end() ? 0 : t->second.live;
+    }
+
+private:
+    // runs on the connection coroutine, owns the socket until it returns
+    bool serve(const std::string& topic, int sock)
+    {
+        //a client that stops reading can't hold the coroutine for longer than this
+        timeval tv;
+        tv.tv_sec = kSendTimeout;
+        tv.tv_usec = 0;
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        std::shared_ptr<Subscriber> sub = std::make_shared<Subscriber>(std::max<size_t>(options_.max_queue, 1), sock);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Topic& t = topics_[topic];
+            t.joined.push_back(sub);
+            ++t.live;
+        }
+
+        bool ok = true;
+        if(retry_)
+            ok = write_events(sock, &retry_, 1);
+
+        Event batch[kMaxBatch];
+        while(ok)
+        {
+            int count = 0;
+            if(!sub->queue.TimedPop(batch[count], std::chrono::seconds(std::max(options_.keepalive, 1))))
+            {
+                //silence, a comment line finds out whether the client is still there
+                ok = write_events(sock, &keepalive_, 1);
+                continue;
+            }
+
+            //whatever else is queued goes out in the same writev
+            ++count;
+            while(count < kMaxBatch && sub->queue.TryPop(batch[count]))
+                ++count;
+
+            if(sub->dropped)
+                break;
+
+            ok = write_events(sock, batch, count);
+            for(int i = 0; i < count; ++i)
+                batch[i].reset();
+        }
+
+        unsubscribe(topic, sub);
+        sub->finish();
+        return ok && !sub->dropped;
+    }
+
+    void unsubscribe(const std::string& topic, std::shared_ptr<Subscriber>& sub)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto t = topics_.find(topic);
+        if(t == topics_.end() || sub->gone.exchange(true))
+            return;
+
+        if(--t->second.live == 0)
+        {
+            topics_.erase(t);
+            return;
+        }
+
+        //a topic nobody publishes to still sheds its dead weight, at most once per doubling
+        if(++t->second.left > t->second.live)
+            rebuild(t->second);
+    }
+
+    // called with mutex_ held
+    void rebuild(Topic& t)
+    {
+        std::shared_ptr<Subscribers> subs = std::make_shared<Subscribers>();
+        subs->reserve(t.live);
+        if(t.snapshot)
+        {
+            for(auto& sub : *t.snapshot)
+                if(!sub->gone)
+                    subs->push_back(sub);
+        }
+
+        for(auto& sub : t.joined)
+            if(!sub->gone)
+                subs->push_back(sub);
+
+        t.snapshot = subs;
+        Subscribers().swap(t.joined);
+        t.left = 0;
+    }
+
+private:
+    SseOptions options_;
+    Event keepalive_;
+    Event retry_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, Topic> topics_;
+};
+
+SseBroadcaster::SseBroadcaster(const SseOptions& opts)
+: broadcaster_(std::make_shared<SseBroadcasterImpl>(opts))
+{
+}
+
+void SseBroadcaster::subscribe(const std::string& topic, std::shared_ptr<HttpResponse> rsp)
+{
+    broadcaster_->subscribe(topic, rsp);
+}
+
+size_t SseBroadcaster::publish(const std::string& topic, const std::string& data,
+                               const std::string& event, const std::string& id)
+{
+    return broadcaster_->publish(topic, data, event, id);
+}
+
+size_t SseBroadcaster::subscribers(const std::string& topic)
+{
+    return broadcaster_->subscribers(topic);
+}
+
+}}
@@ -1,39 +1,134 @@
 #include "natsu_string.h"
+#include <string.h>
 
 namespace natsu {
 
-void tokenize(const std::string& str, std::vector<std::string>& tokens, const std::string& delimiters)  
-{  
-    std::string::size_type lastpos = str.find_first_not_of(delimiters, 0);  
-    std::string::size_type pos = str.find_first_of(delimiters, lastpos);  
-    while (std::string::npos != pos || std::string::npos != lastpos)  
-    {  
-        tokens.push_back(str.substr(lastpos, pos - lastpos));  
-        lastpos = str.find_first_not_of(delimiters, pos);  
-        pos = str.find_first_of(delimiters, lastpos);  
-    }  
+Tokenizer::Tokenizer(StringView s, char delimiter)
+: p_(s.begin()), end_(s.end()), delimiter_(delimiter), single_(true)
+{
 }
 
-std::string replace_all(const std::string &src, std::string org_str, std::string rep_str)  
-{  
+Tokenizer::Tokenizer(StringView s, StringView delimiters)
+: p_(s.begin()), end_(s.end()), delimiter_(delimiters.size() ? delimiters[0] : '\0'), single_(delimiters.size() == 1)
+{
+    if(single_)
+        return;
+
+    memset(table_, 0, sizeof(table_));
+    for(char c : delimiters)
+        table_[static_cast<unsigned char>(c)] = true;
+}
+
+bool Tokenizer::next(StringView& token)
+{
+    if(single_)
+    {
+        while(p_ != end_ && *p_ == delimiter_)
+            ++p_;
+        if(p_ == end_)
+            return false;
+
+        const char* stop = static_cast<const char*>(memchr(p_, delimiter_, end_ - p_));
+        if(!stop)
+            stop = end_;
+        token = StringView(p_, stop - p_);
+        p_ = stop;
+        return true;
+    }
+
+    while(p_ != end_ && is_delimiter(*p_))
+        ++p_;
+    if(p_ == end_)
+        return false;
+
+    const char* start = p_;
+    while(p_ != end_ && !is_delimiter(*p_))
+        ++p_;
+    token = StringView(start, p_ - start);
+    return true;
+}
+
+void tokenize(const std::string& str, std::vector<std::string>& tokens, const std::string& delimiters)
+{
+    Tokenizer t(str, delimiters);
+    for(StringView token; t.next(token); )
+        tokens.push_back(token.str());
+}
+
+std::string replace_all(const std::string& src, const std::string& chars, const std::string& rep)
+{
     std::string result;
-    std::string::size_type lastpos = 0;
+    result.reserve(src.size());
+    size_t lastpos = 0;
     while(true)
     {
-        std::string::size_type pos = src.find_first_of(org_str, lastpos);
+        size_t pos = src.find_first_of(chars, lastpos);
         if(pos == std::string::npos)
         {
-            result.append(src.substr(lastpos));
+            result.append(src, lastpos, std::string::npos);
             break;
         }
 
-        result.append(src.substr(lastpos, pos - lastpos));
-        result.append(rep_str);
+        result.append(src, lastpos, pos - lastpos);
+        result.append(rep);
         lastpos = pos + 1;
     }
 
     return result;
-} 
+}
+
+static inline int hexvalue(char c)
+{
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+std::string url_decode(const char* str, size_t len)
+{
+    std::string result;
+    result.reserve(len);
+    for(size_t i = 0; i < len; ++i)
+    {
+        if(str[i] == '%' && i + 2 < len)
+        {
+            int hi = hexvalue(str[i + 1]);
+            int lo = hexvalue(str[i + 2]);
+            if(hi >= 0 && lo >= 0)
+            {
+                result.push_back(static_cast<char>((hi << 4) | lo));
+                i += 2;
+                continue;
+            }
+        }
+
+        result.push_back(str[i] == '+' ? ' ' : str[i]);
+    }
+
+    return result;
+}
+
 
+static const char kBase64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string base64_encode(const unsigned char* data, size_t len)
+{
+    std::string result;
+    result.reserve((len + 2) / 3 * 4);
+    for(size_t i = 0; i < len; i += 3)
+    {
+        unsigned v = data[i] << 16;
+        if(i + 1 < len) v |= data[i + 1] << 8;
+        if(i + 2 < len) v |= data[i + 2];
+
+        result.push_back(kBase64[(v >> 18) & 63]);
+        result.push_back(kBase64[(v >> 12) & 63]);
+        result.push_back(i + 1 < len ? kBase64[(v >> 6) & 63] : '=');
+        result.push_back(i + 2 < len ? kBase64[v & 63] : '=');
+    }
+
+    return result;
+}
 
 }
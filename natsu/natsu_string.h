@@ -1,14 +1,105 @@
 #ifndef NATSU_STRING_H_
 #define NATSU_STRING_H_
 
+#include <string.h>
 #include <string>
 #include <vector>
 
 namespace natsu {
 
+/* *
+ * StringView
+ * a pointer and a length into text owned elsewhere, not NUL terminated.
+ * the C++14 library has no std::string_view, this is the part natsu needs.
+*/
+class StringView
+{
+public:
+    StringView() : data_(""), size_(0) {}
+    StringView(const char* s, size_t n) : data_(s), size_(n) {}
+    StringView(const char* s) : data_(s), size_(strlen(s)) {}
+    StringView(const std::string& s) : data_(s.data()), size_(s.size()) {}
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + size_; }
+    char operator[](size_t i) const { return data_[i]; }
+
+    // npos when absent
+    size_t find(char c, size_t from = 0) const
+    {
+        if(from >= size_)
+            return std::string::npos;
+        const void* p = memchr(data_ + from, c, size_ - from);
+        return p ? static_cast<const char*>(p) - data_ : std::string::npos;
+    }
+
+    StringView substr(size_t pos, size_t n = std::string::npos) const
+    {
+        if(pos > size_)
+            pos = size_;
+        return StringView(data_ + pos, n < size_ - pos ? n : size_ - pos);
+    }
+
+    bool operator==(StringView o) const { return size_ == o.size_ && memcmp(data_, o.data_, size_) == 0; }
+    bool operator!=(StringView o) const { return !(*this == o); }
+
+    std::string str() const { return std::string(data_, size_); }
+
+private:
+    const char* data_;
+    size_t size_;
+};
+
+/* *
+ * Tokenizer
+ * the non-empty tokens of a text between delimiters, as views into it, one
+ * per next(). a single delimiter is found with memchr, several through a
+ * byte table, nothing is copied or allocated:
+ *
+ *     Tokenizer t(query, '&');
+ *     for(StringView tok; t.next(tok); ) ...
+*/
+class Tokenizer
+{
+public:
+    Tokenizer(StringView s, char delimiter);
+    Tokenizer(StringView s, StringView delimiters);
+
+    bool next(StringView& token);
+
+private:
+    bool is_delimiter(char c) const { return table_[static_cast<unsigned char>(c)]; }
+
+private:
+    const char* p_;
+    const char* end_;
+    char delimiter_;    // when there is only one
+    bool single_;
+    bool table_[256];
+};
+
+// calls fn(StringView) for each token, as Tokenizer gives them
+template<class F>
+void split(StringView s, char delimiter, F fn)
+{
+    Tokenizer t(s, delimiter);
+    for(StringView token; t.next(token); )
+        fn(token);
+}
+
 void tokenize(const std::string& str,  std::vector<std::string>& tokens,  const std::string& delimiters);
 
-std::string replace_all(const std::string &src, std::string org_str, std::string rep_str);
+// every byte of src that is one of chars is replaced by rep
+std::string replace_all(const std::string& src, const std::string& chars, const std::string& rep);
+
+// decode %XX escapes and '+' of application/x-www-form-urlencoded data
+std::string url_decode(const char* str, size_t len);
+
+// standard alphabet with padding
+std::string base64_encode(const unsigned char* data, size_t len);
 
 
 }
@@ -0,0 +1,403 @@
+#include "natsu_websocket.h"
+#include "websocket_frame.h"
+#include "natsu_buffer.h"
+#include "natsu_hash.h"
+#include "natsu_string.h"
+#include "coroutine.h"
+#include <sys/uio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace natsu {
+namespace http {
+
+static const char* kWebSocketGuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+enum CloseCode
+{
+    CLOSE_NORMAL = 1000,
+    CLOSE_PROTOCOL = 1002,
+    CLOSE_INVALID_DATA = 1007,
+    CLOSE_TOO_BIG = 1009,
+};
+
+size_t parse_frame_header(const char* data, size_t n, FrameHeader& h)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    if(n < 2)
+        return 0;
+
+    h.fin = (p[0] & 0x80) != 0;
+    h.rsv = (p[0] >> 4) & 0x07;
+    h.opcode = p[0] & 0x0F;
+    h.masked = (p[1] & 0x80) != 0;
+    h.length = p[1] & 0x7F;
+
+    size_t size = 2;
+    if(h.length == 126)
+    {
+        if(n < 4) return 0;
+        h.length = (p[2] << 8) | p[3];
+        size = 4;
+    }
+    else if(h.length == 127)
+    {
+        if(n < 10) return 0;
+        h.length = 0;
+        for(int i = 0; i < 8; ++i)
+            h.length = (h.length << 8) | p[2 + i];
+        size = 10;
+    }
+
+    if(h.masked)
+    {
+        if(n < size + 4) return 0;
+        memcpy(h.mask, p + size, 4);
+        size += 4;
+    }
+
+    return size;
+}
+
+size_t build_frame_header(char* out, int opcode, uint64_t len, bool fin)
+{
+    unsigned char* p = reinterpret_cast<unsigned char*>(out);
+    p[0] = (fin ? 0x80 : 0) | (opcode & 0x0F);
+    if(len < 126)
+    {
+        p[1] = static_cast<unsigned char>(len);
+        return 2;
+    }
+
+    if(len <= 0xFFFF)
+    {
+        p[1] = 126;
+        p[2] = static_cast<unsigned char>(len >> 8);
+        p[3] = static_cast<unsigned char>(len);
+        return 4;
+    }
+
+    p[1] = 127;
+    for(int i = 0; i < 8; ++i)
+        p[9 - i] = static_cast<unsigned char>(len >> (i * 8));
+    return 10;
+}
+
+void unmask(char* dst, const char* src, size_t n, const unsigned char mask[4])
+{
+    uint32_t m32;
+    memcpy(&m32, mask, 4);
+    uint64_t m64 = (static_cast<uint64_t>(m32) << 32) | m32;
+
+    //every step covers a multiple of 4 bytes, the key stays aligned with i
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i m128 = _mm_set1_epi32(static_cast<int>(m32));
+    for(; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(v, m128));
+    }
+#endif
+
+    for(; i + 8 <= n; i += 8)
+    {
+        uint64_t v;
+        memcpy(&v, src + i, 8);
+        v ^= m64;
+        memcpy(dst + i, &v, 8);
+    }
+
+    for(; i < n; ++i)
+        dst[i] = src[i] ^ mask[i & 3];
+}
+
+bool valid_utf8(const char* data, size_t n)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+    while(i < n)
+    {
+        //ascii runs are checked a word at a time
+        if(i + 8 <= n)
+        {
+            uint64_t v;
+            memcpy(&v, p + i, 8);
+            if((v & 0x8080808080808080ULL) == 0)
+            {
+                i += 8;
+                continue;
+            }
+        }
+
+        unsigned char c = p[i];
+        if(c < 0x80)
+        {
+            ++i;
+            continue;
+        }
+
+        size_t len;
+        uint32_t cp;
+        if((c & 0xE0) == 0xC0)      { len = 2; cp = c & 0x1F; }
+        else if((c & 0xF0) == 0xE0) { len = 3; cp = c & 0x0F; }
+        else if((c & 0xF8) == 0xF0) { len = 4; cp = c & 0x07; }
+        else return false;
+
+        if(i + len > n)
+            return false;
+
+        for(size_t k = 1; k < len; ++k)
+        {
+            if((p[i + k] & 0xC0) != 0x80)
+                return false;
+            cp = (cp << 6) | (p[i + k] & 0x3F);
+        }
+
+        //overlong forms, surrogates and values past U+10FFFF
+        if((len == 2 && cp < 0x80) || (len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000) ||
+           (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF)
+            return false;
+
+        i += len;
+    }
+
+    return true;
+}
+
+std::string websocket_accept(const std::string& key)
+{
+    std::string s = key + kWebSocketGuid;
+    unsigned char digest[20];
+    sha1(s.data(), s.size(), digest);
+    return base64_encode(digest, sizeof(digest));
+}
+
+class WebSocket::WebSocketImpl
+{
+public:
+    WebSocketImpl(int sockfd, const std::string& remote, const WebSocketOptions& opts)
+    : fd_(sockfd), remote_(remote), options_(opts), close_sent_(false), closed_(false)
+    {
+    }
+
+    ~WebSocketImpl()
+    {
+        ::close(fd_);
+    }
+
+    bool receive(std::string& message, Opcode* opcode)
+    {
+        message.clear();
+        int message_opcode = -1;
+        while(!closed_)
+        {
+            FrameHeader h;
+            size_t head = parse_frame_header(input_.data(), input_.size(), h);
+            if(head && h.length > options_.max_message - message.size())
+            {
+                fail(CLOSE_TOO_BIG);
+                break;
+            }
+
+            if(head == 0 || input_.size() - head < h.length)
+            {
+                //a frame of known size is read into storage that fits it
+                if(head)
+                    input_.reserve(head + h.length);
+
+                ssize_t n = input_.read(fd_);
+                if(n == -1 && (errno == EINTR || errno == EAGAIN))
+                    continue;
+                if(n <= 0)
+                    closed_ = true;
+                continue;
+            }
+
+            bool control = (h.opcode & 0x08) != 0;
+            if(h.rsv || !h.masked || (control && (!h.fin || h.length > 125)) ||
+               (h.opcode > BINARY && !control) || h.opcode > PONG)
+            {
+                fail(CLOSE_PROTOCOL);
+                break;
+            }
+
+            const char* payload = input_.data() + head;
+            size_t len = h.length;
+            if(control)
+            {
+                char buf[125];
+                unmask(buf, payload, len, h.mask);
+                input_.consume(head + len);
+                if(!control_frame(h.opcode, buf, len))
+                    break;
+                continue;
+            }
+
+            if((h.opcode == CONTINUATION) != (message_opcode >= 0))
+            {
+                fail(CLOSE_PROTOCOL);
+                break;
+            }
+
+            if(h.opcode != CONTINUATION)
+                message_opcode = h.opcode;
+
+            //the payload is unmasked straight from the read buffer into the message
+            size_t old = message.size();
+            message.resize(old + len);
+            unmask(&message[old], payload, len, h.mask);
+            input_.consume(head + len);
+
+            if(h.fin)
+            {
+                if(message_opcode == TEXT && !valid_utf8(message.data(), message.size()))
+                {
+                    fail(CLOSE_INVALID_DATA);
+                    break;
+                }
+
+                if(opcode) *opcode = static_cast<Opcode>(message_opcode);
+                return true;
+            }
+        }
+
+        message.clear();
+        return false;
+    }
+
+    bool send(const char* data, size_t len, int opcode)
+    {
+        std::lock_guard<co_mutex> lock(send_lock_);
+        if(close_sent_)
+            return false;
+        if(opcode == CLOSE)
+            close_sent_ = true;
+
+        char head[10];
+        iovec iov[2];
+        iov[0].iov_base = head;
+        iov[0].iov_len = build_frame_header(head, opcode, len);
+        iov[1].iov_base = const_cast<char*>(data);
+        iov[1].iov_len = len;
+
+        if(!writev_all(fd_, iov, len ? 2 : 1))
+        {
+            closed_ = true;
+            return false;
+        }
+
+        return true;
+    }
+
+    void close(uint16_t code, const std::string& reason)
+    {
+        std::string payload;
+        payload.push_back(static_cast<char>(code >> 8));
+        payload.push_back(static_cast<char>(code & 0xFF));
+        payload.append(reason, 0, 123);
+        send(payload.data(), payload.size(), CLOSE);
+        closed_ = true;
+    }
+
+    bool closed()
+    {
+        return closed_ || close_sent_;
+    }
+
+    const std::string& remote()
+    {
+        return remote_;
+    }
+
+private:
+    // @return false once the connection is closing
+    bool control_frame(int opcode, const char* payload, size_t len)
+    {
+        switch(opcode)
+        {
+        case PING:
+            send(payload, len, PONG);
+            return true;
+
+        case PONG:
+            return true;
+
+        default:
+        {
+            //echo the peer's status code, then the connection is done
+            uint16_t code = CLOSE_NORMAL;
+            if(len >= 2)
+                code = (static_cast<unsigned char>(payload[0]) << 8) | static_cast<unsigned char>(payload[1]);
+            close(len == 1 ? static_cast<uint16_t>(CLOSE_PROTOCOL) : code, "");
+            return false;
+        }
+        }
+    }
+
+    void fail(uint16_t code)
+    {
+        close(code, "");
+    }
+
+private:
+    int fd_;
+    std::string remote_;
+    WebSocketOptions options_;
+    ReadBuffer input_;
+    co_mutex send_lock_;
+    std::atomic<bool> close_sent_;
+    std::atomic<bool> closed_;
+};
+
+WebSocket::WebSocket(int sockfd, const std::string& remote, const WebSocketOptions& opts)
+: socket_(new WebSocketImpl(sockfd, remote, opts))
+{
+}
+
+WebSocket::~WebSocket()
+{
+}
+
+bool WebSocket::receive(std::string& message, Opcode* opcode)
+{
+    return socket_->receive(message, opcode);
+}
+
+bool WebSocket::send(const std::string& message, Opcode opcode)
+{
+    return socket_->send(message.data(), message.size(), opcode);
+}
+
+bool WebSocket::send(const char* data, size_t len, Opcode opcode)
+{
+    return socket_->send(data, len, opcode);
+}
+
+bool WebSocket::ping(const std::string& payload)
+{
+    return socket_->send(payload.data(), std::min<size_t>(payload.size(), 125), PING);
+}
+
+void WebSocket::close(uint16_t code, const std::string& reason)
+{
+    socket_->close(code, reason);
+}
+
+bool WebSocket::closed()
+{
+    return socket_->closed();
+}
+
+const std::string& WebSocket::remote()
+{
+    return socket_->remote();
+}
+
+}}
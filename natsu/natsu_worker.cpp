@@ -0,0 +1,108 @@
+#include "natsu_worker.h"
+#include "coroutine.h"
+#include <thread>
+#include <chrono>
+#include <exception>
+
+namespace natsu {
+
+static const int kWorkerGroup = 1;
+
+static unsigned default_threads(unsigned n)
+{
+    if(n) return n;
+    unsigned cores = std::thread::hardware_concurrency();
+    return cores ? cores : 1;
+}
+
+Workers::Workers()
+: processors_(0), pool_(0)
+{
+}
+
+void Workers::threads(unsigned processors, unsigned pool)
+{
+    processors_ = processors;
+    pool_ = pool;
+}
+
+void Workers::start_processors()
+{
+    //the calling thread serves connections, it has to own processer 0
+    //before any worker thread registers
+    co_sched.Run(0);
+
+    unsigned n = default_threads(processors_);
+    for(unsigned i = 0; i < n; ++i)
+    {
+        std::thread t([]{ co_sched.RunLoop(kWorkerGroup); });
+        t.detach();
+    }
+
+    while(co_sched.GroupDispatch(kWorkerGroup) < 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void Workers::start_pool()
+{
+    unsigned n = default_threads(pool_);
+    for(unsigned i = 0; i < n; ++i)
+    {
+        std::thread t([]{ co_sched.GetThreadPool().RunLoop(); });
+        t.detach();
+    }
+}
+
+http::Handler Workers::offload(http::Handler h, Execution e)
+{
+    switch(e)
+    {
+    case EXEC_PROCESSOR:
+        std::call_once(processors_started_, &Workers::start_processors, this);
+        return [h](std::shared_ptr<http::HttpRequest> req, std::shared_ptr<http::HttpResponse> resp)
+        {
+            std::exception_ptr error;
+            co_chan<void> done(1);
+            go_dispatch(co_sched.GroupDispatch(kWorkerGroup)) [&]
+            {
+                try
+                {
+                    h(req, resp);
+                }
+                catch(...)
+                {
+                    error = std::current_exception();
+                }
+                done << nullptr;
+            };
+            done >> nullptr;
+
+            if(error) std::rethrow_exception(error);
+        };
+
+    case EXEC_THREAD_POOL:
+        std::call_once(pool_started_, &Workers::start_pool, this);
+        return [h](std::shared_ptr<http::HttpRequest> req, std::shared_ptr<http::HttpResponse> resp)
+        {
+            std::exception_ptr error;
+            co_await(void) [&]
+            {
+                try
+                {
+                    h(req, resp);
+                }
+                catch(...)
+                {
+                    error = std::current_exception();
+                }
+            };
+
+            if(error) std::rethrow_exception(error);
+        };
+
+    default:
+        return h;
+    }
+}
+
+}
@@ -0,0 +1,44 @@
+#ifndef NATSU_WORKER_H_
+#define NATSU_WORKER_H_
+
+#include <mutex>
+#include "natsu_app.h"
+#include "http_router.h"
+#include "singleton.h"
+
+namespace natsu {
+
+/* *
+ * Workers
+ * runs cpu bound handlers away from the threads serving connections.
+ * worker processors form their own scheduler group, they neither steal
+ * connection coroutines nor get theirs stolen, so a slow handler can't
+ * delay the io of other connections.
+*/
+class Workers : public singleton<Workers>
+{
+public:
+    // thread counts, 0 picks the number of cores
+    void threads(unsigned processors, unsigned pool);
+
+    // wrap h to run where e says, the wrapper parks the calling coroutine until h returned
+    http::Handler offload(http::Handler h, Execution e);
+
+private:
+    Workers();
+
+    void start_processors();
+    void start_pool();
+
+private:
+    unsigned processors_;
+    unsigned pool_;
+    std::once_flag processors_started_;
+    std::once_flag pool_started_;
+
+    friend class singleton<Workers>;
+};
+
+}
+
+#endif
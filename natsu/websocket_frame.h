@@ -0,0 +1,37 @@
+#ifndef WEBSOCKET_FRAME_H_
+#define WEBSOCKET_FRAME_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace natsu {
+namespace http {
+
+struct FrameHeader
+{
+    bool fin;
+    int rsv;                // extension bits, none are negotiated
+    int opcode;
+    bool masked;
+    unsigned char mask[4];
+    uint64_t length;        // payload bytes
+};
+
+// parse a frame head in place, @return its size or 0 while more input is needed
+size_t parse_frame_header(const char* p, size_t n, FrameHeader& h);
+
+// server frames are unmasked, @return bytes written to out, at most 10
+size_t build_frame_header(char* out, int opcode, uint64_t len, bool fin = true);
+
+// xor n bytes with the masking key, dst may be src
+void unmask(char* dst, const char* src, size_t n, const unsigned char mask[4]);
+
+bool valid_utf8(const char* p, size_t n);
+
+// Sec-WebSocket-Accept for a Sec-WebSocket-Key
+std::string websocket_accept(const std::string& key);
+
+}}
+
+#endif